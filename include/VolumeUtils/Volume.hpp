@@ -29,6 +29,14 @@
 #define VOL_CXX_IS_GNU
 #endif
 
+// SIMD
+#if defined(__AVX2__)
+#define VOL_SIMD_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOL_SIMD_SSE2
+#endif
+
 #define NOT_IMPL { std::cerr << "ERROR : Not Imply!!!" << std::endl; assert(false); }
 
 #include <iostream>
@@ -42,6 +50,18 @@
 #include <sstream>
 #include <iomanip>
 #include <variant>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <span>
+#include <atomic>
+
+#if defined(VOL_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(VOL_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
 
 VOL_BEGIN
 
@@ -181,6 +201,72 @@ struct Voxel<VoxelType::float32, VoxelFormat::R> {
 using VoxelRF32 = Voxel<VoxelType::float32, VoxelFormat::R>;
 static_assert(sizeof(VoxelRF32) == 4);
 
+template<>
+struct Voxel<VoxelType::uint8, VoxelFormat::RG> {
+    uint8_t r = 0, g = 0;
+    using VoxelDataType = uint8_t;
+    static constexpr VoxelType type = VoxelType::uint8;
+    static constexpr VoxelFormat format = VoxelFormat::RG;
+    static constexpr size_t size() noexcept { return 2; }
+};
+using VoxelRGU8 = Voxel<VoxelType::uint8, VoxelFormat::RG>;
+static_assert(sizeof(VoxelRGU8) == 2);
+
+template<>
+struct Voxel<VoxelType::uint8, VoxelFormat::RGB> {
+    uint8_t r = 0, g = 0, b = 0;
+    using VoxelDataType = uint8_t;
+    static constexpr VoxelType type = VoxelType::uint8;
+    static constexpr VoxelFormat format = VoxelFormat::RGB;
+    static constexpr size_t size() noexcept { return 3; }
+};
+using VoxelRGBU8 = Voxel<VoxelType::uint8, VoxelFormat::RGB>;
+static_assert(sizeof(VoxelRGBU8) == 3);
+
+template<>
+struct Voxel<VoxelType::uint8, VoxelFormat::RGBA> {
+    uint8_t r = 0, g = 0, b = 0, a = 0;
+    using VoxelDataType = uint8_t;
+    static constexpr VoxelType type = VoxelType::uint8;
+    static constexpr VoxelFormat format = VoxelFormat::RGBA;
+    static constexpr size_t size() noexcept { return 4; }
+};
+using VoxelRGBAU8 = Voxel<VoxelType::uint8, VoxelFormat::RGBA>;
+static_assert(sizeof(VoxelRGBAU8) == 4);
+
+template<>
+struct Voxel<VoxelType::uint16, VoxelFormat::RG> {
+    uint16_t r = 0, g = 0;
+    using VoxelDataType = uint16_t;
+    static constexpr VoxelType type = VoxelType::uint16;
+    static constexpr VoxelFormat format = VoxelFormat::RG;
+    static constexpr size_t size() noexcept { return 4; }
+};
+using VoxelRGU16 = Voxel<VoxelType::uint16, VoxelFormat::RG>;
+static_assert(sizeof(VoxelRGU16) == 4);
+
+template<>
+struct Voxel<VoxelType::uint16, VoxelFormat::RGB> {
+    uint16_t r = 0, g = 0, b = 0;
+    using VoxelDataType = uint16_t;
+    static constexpr VoxelType type = VoxelType::uint16;
+    static constexpr VoxelFormat format = VoxelFormat::RGB;
+    static constexpr size_t size() noexcept { return 6; }
+};
+using VoxelRGBU16 = Voxel<VoxelType::uint16, VoxelFormat::RGB>;
+static_assert(sizeof(VoxelRGBU16) == 6);
+
+template<>
+struct Voxel<VoxelType::uint16, VoxelFormat::RGBA> {
+    uint16_t r = 0, g = 0, b = 0, a = 0;
+    using VoxelDataType = uint16_t;
+    static constexpr VoxelType type = VoxelType::uint16;
+    static constexpr VoxelFormat format = VoxelFormat::RGBA;
+    static constexpr size_t size() noexcept { return 8; }
+};
+using VoxelRGBAU16 = Voxel<VoxelType::uint16, VoxelFormat::RGBA>;
+static_assert(sizeof(VoxelRGBAU16) == 8);
+
 struct Extend3D {
     uint32_t width = 0;
     uint32_t height = 0;
@@ -196,6 +282,16 @@ struct Extend3D {
     }
 };
 
+/**
+ * @brief Point in voxel space, voxel (x, y, z) is at its integer coordinate.
+ */
+struct Float3 {
+    float x = 0.f;
+    float y = 0.f;
+    float z = 0.f;
+};
+static_assert(sizeof(Float3) == 3 * sizeof(float));
+
 enum class VolumeType{
     Grid_RAW,
     Grid_SLICED,
@@ -395,6 +491,20 @@ inline bool CheckValidation(const RawGridVolumeDesc& desc) noexcept {
     return desc.extend.size() > 0 && desc.space.voxel() > 0.f;
 }
 
+/**
+ * @brief How RawGridVolume gets its memory. Pages always come zeroed from the os and are only committed on first touch.
+ */
+struct RawGridVolumeAllocInfo{
+    // try large pages first and fall back to normal pages, on linux transparent huge pages are advised otherwise
+    bool huge_pages = false;
+    // touch pages from worker threads along z so they are spread over the numa nodes of the workers,
+    // otherwise pages are touched by whichever thread writes them first.
+    // Best effort : workers are not pinned, so placement only holds while the os keeps threads on their node
+    bool parallel_first_touch = false;
+    // 0 for hardware concurrency
+    int thread_count = 0;
+};
+
 /**
  * @note Create by constructor will just create a memory model, will not associate with file.
  */
@@ -406,7 +516,7 @@ public:
     using SelfT = RawGridVolume<Voxel>;
     static constexpr VolumeType EVolumeType = VolumeType::Grid_RAW;
 
-    explicit RawGridVolume(const RawGridVolumeDesc &desc);
+    explicit RawGridVolume(const RawGridVolumeDesc &desc, const RawGridVolumeAllocInfo &alloc_info = {});
 
     ~RawGridVolume() override;
 
@@ -436,7 +546,79 @@ public:
 
     const Voxel* GetRawDataPtr() const noexcept;
 
+    Extend3D GetExtend() const noexcept;
+
+    /**
+     * @brief Call func(x, y, z, row, count) for each contiguous x row of [src, dst) clipped to the volume,
+     * row points to the voxel (x, y, z). Inlined without virtual call so per voxel work can be vectorized.
+     * Only for the linear layout, throw std::logic_error if called through a derived volume with its own layout.
+     * @param parallel split z over hardware threads, func must be thread safe then
+     */
+    template<typename F>
+    void ForEachRow(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false){
+        CheckLinearLayout();
+        auto extend = GetExtend();
+        ForEachGridRow(GetRawDataPtr(), extend.width, extend.height, extend.depth,
+                       srcX, srcY, srcZ, dstX, dstY, dstZ, std::forward<F>(func), parallel);
+    }
+
+    template<typename F>
+    void ForEachRow(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false) const{
+        CheckLinearLayout();
+        auto extend = GetExtend();
+        ForEachGridRow(GetRawDataPtr(), extend.width, extend.height, extend.depth,
+                       srcX, srcY, srcZ, dstX, dstY, dstZ, std::forward<F>(func), parallel);
+    }
+
+    /**
+     * @brief Call func(x, y, z, voxel) for each voxel of [src, dst) clipped to the volume, x is the inner loop.
+     */
+    template<typename F>
+    void ForEachVoxel(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false){
+        ForEachRow(srcX, srcY, srcZ, dstX, dstY, dstZ, [&func](int x, int y, int z, Voxel* row, int count){
+            for(int i = 0; i < count; i++) func(x + i, y, z, row[i]);
+        }, parallel);
+    }
+
+    template<typename F>
+    void ForEachVoxel(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false) const{
+        ForEachRow(srcX, srcY, srcZ, dstX, dstY, dstZ, [&func](int x, int y, int z, const Voxel* row, int count){
+            for(int i = 0; i < count; i++) func(x + i, y, z, row[i]);
+        }, parallel);
+    }
+
+    /**
+     * @brief Trilinear samples at voxel space points, points out of the volume are clamped to its border.
+     * Eight points are interpolated per iteration with AVX2 gathers when available.
+     * @note out must be as long as pts, results are rounded to the voxel type.
+     */
+    void Sample(std::span<const Float3> pts, std::span<Voxel> out) const;
+
+    void Sample(std::span<const Float3> pts, std::span<float> out) const;
+
+    /**
+     * @brief Central difference gradient of the trilinear field one voxel apart, one sided at the border.
+     */
+    void SampleGradient(std::span<const Float3> pts, std::span<Float3> out) const;
+
 protected:
+    void CheckLinearLayout() const{
+        if(GetVolumeType() != VolumeType::Grid_RAW)
+            throw std::logic_error(std::string("ForEachRow does not walk the storage layout of ") + VolumeTypeToStr(GetVolumeType()));
+    }
+
+    /**
+     * @brief Sample kernels of the storage layout, the linear one for Grid_RAW and operator() based for other types.
+     */
+    virtual void SampleTrilinear(const Float3* pts, size_t count, float* out) const;
+
+    virtual void SampleTrilinearGradient(const Float3* pts, size_t count, Float3* out) const;
+
+    /**
+     * @brief For derived volumes with their own layout, storage_bytes is allocated instead of the linear extend.
+     */
+    RawGridVolume(const RawGridVolumeDesc &desc, size_t storage_bytes, const RawGridVolumeAllocInfo &alloc_info);
+
     template<typename, VolumeType>
     friend class VolumeIOWrapper;
     template<typename>
@@ -510,11 +692,37 @@ inline bool CheckValidation(SliceAxis axis) noexcept {
         || axis == SliceAxis::AXIS_Z;
 }
 
+/**
+ * @brief Extend of a volume re-ordered so that slices perpendicular to axis are stacked along depth,
+ * i.e. (h, d, w) for AXIS_X, (d, w, h) for AXIS_Y.
+ */
+inline Extend3D GetPermutedExtend(const Extend3D& extend, SliceAxis axis) noexcept {
+    if(axis == SliceAxis::AXIS_X) return {extend.height, extend.depth, extend.width};
+    if(axis == SliceAxis::AXIS_Y) return {extend.depth, extend.width, extend.height};
+    return extend;
+}
+
+/**
+ * @brief Re-order a packed volume into GetPermutedExtend(extend, axis) layout.
+ * Planes are transposed by cache sized tiles with SIMD shuffles for 1 and 2 bytes elements,
+ * and spread over worker threads.
+ * @param workerCount 0 for hardware concurrency.
+ */
+void Permute3D(const void* src, const Extend3D& extend, size_t elementSize, SliceAxis axis, void* dst, int workerCount = 0);
+
 inline bool CheckValidation(const SlicedGridVolumeDesc& desc) noexcept {
     if(!CheckValidation(static_cast<const RawGridVolumeDesc&>(desc))) return false;
     return CheckValidation(desc.axis) && desc.setw >= 0;
 }
 
+/**
+ * @brief Out of core volume over a slice stack, slices are paged in through SlicedGridVolumeReader into a byte budgeted cache.
+ * Written slices are dirty and stored through SlicedGridVolumeWriter after eviction, on Flush or on destruction.
+ * ReadVoxels and WriteVoxels are thread safe.
+ * @note Only tif slice stacks can be written back, the sliced writer only supports tif, writes to others throw.
+ * @note Reference from operator() stays valid until the next call of it, it pins the last touched slice only.
+ * Writes through it are kept only if the slice is marked by MarkSliceDirty while still pinned.
+ */
 class SlicedGridVolumePrivate;
 template<typename Voxel>
 class SlicedGridVolume :public RawGridVolume<Voxel>{
@@ -523,7 +731,15 @@ public:
     using SelfT = RawGridVolume<Voxel>;
     static constexpr VolumeType EVolumeType = VolumeType::Grid_SLICED;
 
-    explicit SlicedGridVolume(const SlicedGridVolumeDesc& desc);
+    /**
+     * @brief Create a new slice stack, desc.data_path is the descriptor json file to create, all slices start as zero.
+     */
+    explicit SlicedGridVolume(const SlicedGridVolumeDesc& desc, size_t cacheBytes = VolumeMemorySettings::MaxSlicedGridMemoryUsageBytes);
+
+    /**
+     * @brief Open an existing slice stack by its descriptor json file, slices are read on first touch.
+     */
+    explicit SlicedGridVolume(const std::string& filename, size_t cacheBytes = VolumeMemorySettings::MaxSlicedGridMemoryUsageBytes);
 
     ~SlicedGridVolume() override;
 
@@ -542,7 +758,12 @@ public:
 
     const Voxel& operator()(int x, int y, int z) const override;
 
+    VolumeType GetVolumeType() const noexcept override;
+
 public:
+    /**
+     * @note Slice layout of AXIS_X and AXIS_Y follows GetPermutedExtend, i.e. (height, depth) and (depth, width).
+     */
     virtual void ReadSlice(SliceAxis axis, int sliceIndex, void* buf);
 
     virtual void ReadSlice(int srcX, int srcY, int dstX, int dstY, SliceAxis axis, int sliceIndex, void* buf);
@@ -551,6 +772,19 @@ public:
 
     virtual void WriteSlice(int srcX, int srcY, int dstX, int dstY, SliceAxis axis, int sliceIndex, const void* buf);
 
+    /**
+     * @brief Store all dirty slices.
+     */
+    void Flush();
+
+    /**
+     * @brief Record a write through operator(), WriteVoxels and WriteSlice mark their slices themselves.
+     */
+    void MarkSliceDirty(int sliceIndex);
+
+private:
+    SlicedGridVolume(std::unique_ptr<SlicedGridVolumeReader> reader, size_t cacheBytes);
+
 protected:
     std::unique_ptr<SlicedGridVolumePrivate> _;
 };
@@ -593,6 +827,13 @@ public:
 
     void ReadSliceData(int sliceIndex, SliceReadFunc reader);
 
+    /**
+     * @brief Read slices [begSlice, endSlice) along an axis other than the stored one into a linear buf.
+     * Slices keep the layout of GridData::GetSliceDataX/Y, i.e. (height, depth) for AXIS_X and (depth, width) for AXIS_Y.
+     * Stored slices are streamed by slabs and transposed by tiles, so each stored slice is read only once.
+     */
+    void ReadResliceData(SliceAxis axis, int begSlice, int endSlice, void* buf);
+
     /**
      * @brief If set use cached, reader will first try to read data from cache buffer and read entire slice if can,
      * so it will cost more memory if random access but will be more efficient for read by sequence for huge volume data.
@@ -602,6 +843,16 @@ public:
 
     bool GetIfUseCached() const noexcept;
 
+    /**
+     * @brief Drop cached slices, call it after slices are rewritten on disk.
+     */
+    void ClearCache();
+
+    /**
+     * @return extension of slice files, e.g. ".tif".
+     */
+    const std::string& GetSliceDataFormat() const noexcept;
+
 protected:
     std::unique_ptr<SlicedGridVolumeReaderPrivate> _;
 };
@@ -609,7 +860,10 @@ protected:
 class SlicedGridVolumeWriterPrivate;
 class SlicedGridVolumeWriter : public VolumeWriterInterface<SlicedGridVolumeDesc>{
 public:
-    SlicedGridVolumeWriter(const std::string& filename, const SlicedGridVolumeDesc& desc);
+    /**
+     * @param saveDesc false to write slices of an existing tif stack without rewriting its descriptor file.
+     */
+    SlicedGridVolumeWriter(const std::string& filename, const SlicedGridVolumeDesc& desc, bool saveDesc = true);
 
     ~SlicedGridVolumeWriter() override;
 
@@ -631,6 +885,11 @@ public:
 
     void Flush();
 
+    /**
+     * @brief Flush and close the current slice file, so it can be read back at once.
+     */
+    void Close();
+
 protected:
     std::unique_ptr<SlicedGridVolumeWriterPrivate> _;
 };
@@ -654,24 +913,149 @@ struct BlockedGridVolumeDesc : RawGridVolumeDesc{
     uint32_t padding = 0;
 };
 
+inline bool CheckValidation(const BlockedGridVolumeDesc& desc) noexcept {
+    if(!CheckValidation(static_cast<const RawGridVolumeDesc&>(desc))) return false;
+    return desc.block_length > 0 && desc.block_length > (desc.padding << 1);
+}
+
 /**
- * @note This class not implied and not used.
+ * @brief Interleave bits of x, y, z into a z-order curve code, x takes the lowest bit.
+ */
+inline constexpr uint64_t MortonEncode3D(uint32_t x, uint32_t y, uint32_t z) noexcept {
+    auto spread = [](uint64_t v){
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8)  & 0x100f00f00f00f00full;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2)  & 0x1249249249249249ull;
+        return v;
+    };
+    return spread(x) | spread(y) << 1 | spread(z) << 2;
+}
+
+/**
+ * @brief In memory volume stored as bricks of (block_length + 2 * padding)^3 voxels, x fastest inside a brick.
+ * Bricks are laid out in Morton order of their block index so spatially close bricks are close in memory.
+ * Padding voxels are copies of the neighbor bricks (zero outside the volume), kept in sync by WriteVoxels.
+ * @note Writing through operator() only touches the brick which owns the voxel, not the padding copies.
  */
 class BlockedGridVolumePrivate;
 template <typename Voxel>
 class BlockedGridVolume:public RawGridVolume<Voxel>{
 public:
     using VoxelT = typename RawGridVolume<Voxel>::VoxelT;
+    using SelfT = BlockedGridVolume<Voxel>;
+    static constexpr VolumeType EVolumeType = VolumeType::Grid_BLOCKED;
+
+    explicit BlockedGridVolume(const BlockedGridVolumeDesc& desc, const RawGridVolumeAllocInfo& alloc_info = {});
+
+    ~BlockedGridVolume() override;
+
+    BlockedGridVolumeDesc GetVolumeDesc() const noexcept;
 
-    BlockedGridVolume(const BlockedGridVolumeDesc& desc);
+public:
+    void ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, Voxel *buf)                      override;
+
+    void ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeReadFunc<Voxel> reader)   override;
+
+    void WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, const Voxel *buf)               override;
+
+    void WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeWriteFunc<Voxel> writer) override;
+
+    Voxel& operator()(int x, int y, int z) override;
+
+    const Voxel& operator()(int x, int y, int z) const override;
+
+    VolumeType GetVolumeType() const noexcept override;
+
+public:
+    /**
+     * @return block count along x, y and z.
+     */
+    Extend3D GetBlockDim() const noexcept;
+
+    /**
+     * @brief Copy one whole brick(padding included) into buf.
+     */
+    virtual void ReadBlockData(const BlockIndex&, VoxelT* buf);
+
+    /**
+     * @brief O(1) pointer to brick storage, padding included.
+     */
+    virtual Voxel* GetRawBlockData(const BlockIndex&);
 
-    void ReadBlockData(const BlockIndex&, VoxelT* buf);
+    virtual const Voxel* GetRawBlockData(const BlockIndex&) const;
 
-    Voxel* GetRawBlockData(const BlockIndex&);
+    /**
+     * @brief Same as RawGridVolume::ForEachRow but rows are cut at brick borders, padding copies are not visited.
+     * Throw std::logic_error if called through a derived volume which does not keep bricks in this storage.
+     * @param parallel split z at brick borders over hardware threads, func must be thread safe then
+     */
+    template<typename F>
+    void ForEachRow(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false){
+        ForEachBrickRow(*this, srcX, srcY, srcZ, dstX, dstY, dstZ, func, parallel);
+    }
+
+    template<typename F>
+    void ForEachRow(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false) const{
+        ForEachBrickRow(*this, srcX, srcY, srcZ, dstX, dstY, dstZ, func, parallel);
+    }
+
+    template<typename F>
+    void ForEachVoxel(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false){
+        ForEachRow(srcX, srcY, srcZ, dstX, dstY, dstZ, [&func](int x, int y, int z, Voxel* row, int count){
+            for(int i = 0; i < count; i++) func(x + i, y, z, row[i]);
+        }, parallel);
+    }
 
-    const Voxel* GetRawBlockData(const BlockIndex&) const;
+    template<typename F>
+    void ForEachVoxel(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel = false) const{
+        ForEachRow(srcX, srcY, srcZ, dstX, dstY, dstZ, [&func](int x, int y, int z, const Voxel* row, int count){
+            for(int i = 0; i < count; i++) func(x + i, y, z, row[i]);
+        }, parallel);
+    }
 
 protected:
+    template<typename Self, typename F>
+    static void ForEachBrickRow(Self& self, int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F& func, bool parallel){
+        if(self.GetVolumeType() != VolumeType::Grid_BLOCKED)
+            throw std::logic_error(std::string("ForEachRow does not walk the storage layout of ") + VolumeTypeToStr(self.GetVolumeType()));
+        const auto desc = self.GetVolumeDesc();
+        const int block_length = (int)desc.block_length;
+        const int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, desc.extend.depth);
+        if(beg_z >= end_z) return;
+        auto run = [&](int z0, int z1){
+            ForEachBlockRow(desc.extend.width, desc.extend.height, desc.extend.depth, block_length, desc.padding, false,
+                            srcX, srcY, z0, dstX, dstY, z1,
+                            [&self](int bx, int by, int bz){ return self.GetRawBlockData(BlockIndex{bx, by, bz}); }, func);
+        };
+        const int bz_beg = beg_z / block_length, bz_end = (end_z - 1) / block_length + 1;
+        const int slabs = parallel ? std::min<int>(bz_end - bz_beg, std::max(1u, std::thread::hardware_concurrency())) : 1;
+        if(slabs <= 1){
+            run(beg_z, end_z);
+            return;
+        }
+        // slabs own whole brick layers so no two threads touch one brick
+        ParallelForRange(0, slabs, [&](int, int i){
+            const int b0 = bz_beg + (bz_end - bz_beg) * i / slabs, b1 = bz_beg + (bz_end - bz_beg) * (i + 1) / slabs;
+            run(std::max(beg_z, b0 * block_length), std::min(end_z, b1 * block_length));
+        }, slabs);
+    }
+
+    /**
+     * @brief For derived volumes which keep bricks elsewhere, storage_bytes may be 0.
+     */
+    BlockedGridVolume(const BlockedGridVolumeDesc& desc, size_t storage_bytes, const RawGridVolumeAllocInfo& alloc_info);
+
+    /**
+     * @brief With padding all corners of a cell are in one brick and brick slots are gathered per lane,
+     * without padding corners are fetched one by one.
+     */
+    void SampleTrilinear(const Float3* pts, size_t count, float* out) const override;
+
+    void SampleTrilinearGradient(const Float3* pts, size_t count, Float3* out) const override;
+
     std::unique_ptr<BlockedGridVolumePrivate> _;
 };
 
@@ -730,13 +1114,82 @@ protected:
 enum class GridVolumeCodec: int {
     GRID_VOLUME_CODEC_NONE = 0,
     GRID_VOLUME_CODEC_VIDEO = 1,
-    GRID_VOLUME_CODEC_BITS = 2
+    GRID_VOLUME_CODEC_BITS = 2,
+    // uint16 only, high byte by bits codec(lossless) and low byte by video codec
+    GRID_VOLUME_CODEC_VIDEO_HILO = 3
 };
 
 using Packet = std::vector<uint8_t>;
 // Packets for store volume video encode results is not perfect, use linear buffer with a packet parser is best.
 // But when I realize this is too late... So user would better use a global memory pool will improve efficient.
 using Packets = std::vector<Packet>;
+// Linear buffer of [(size_t size)(bytes)]... packet records, same layout as a block stored in .ebd file.
+// Codecs only append to it, so an arena cleared and reused keeps its capacity between encodes.
+using PacketArena = std::vector<uint8_t>;
+
+/**
+ * @brief Append one size prefixed packet record into arena.
+ */
+inline void AppendPacketRecord(PacketArena& arena, const void* data, size_t size){
+    const size_t offset = arena.size();
+    arena.resize(offset + sizeof(size_t) + size);
+    std::memcpy(arena.data() + offset, &size, sizeof(size_t));
+    if(size) std::memcpy(arena.data() + offset + sizeof(size_t), data, size);
+}
+
+/**
+ * @return exact bytes of packets laid out as arena records.
+ */
+inline size_t GetPacketRecordsSize(const Packets& packets) noexcept {
+    size_t size = 0;
+    for(auto& packet : packets) size += sizeof(size_t) + packet.size();
+    return size;
+}
+
+/**
+ * @brief Append each record back to packets as one packet, a truncated record at the tail is not parsed.
+ * @return bytes of records parsed.
+ */
+inline size_t ParsePacketRecords(const void* records, size_t records_size, Packets& packets){
+    auto ptr = reinterpret_cast<const uint8_t*>(records);
+    size_t offset = 0;
+    while(offset + sizeof(size_t) <= records_size){
+        size_t size;
+        std::memcpy(&size, ptr + offset, sizeof(size_t));
+        if(size > records_size - offset - sizeof(size_t)) break;
+        offset += sizeof(size_t);
+        packets.emplace_back(ptr + offset, ptr + offset + size);
+        offset += size;
+    }
+    return offset;
+}
+
+/**
+ * @brief Copy encoded records into a caller buffer, throw instead of truncating if size is not enough.
+ */
+inline size_t CopyPacketRecords(const void* records, size_t records_size, void* buf, size_t size){
+    if(records_size > size)
+        throw VolumeCodecError("Encode buffer size " + std::to_string(size) + " is less than encoded size " + std::to_string(records_size));
+    if(records_size) std::memcpy(buf, records, records_size);
+    return records_size;
+}
+
+inline size_t CopyPacketRecords(const Packets& packets, void* buf, size_t size){
+    const size_t records_size = GetPacketRecordsSize(packets);
+    if(records_size > size)
+        throw VolumeCodecError("Encode buffer size " + std::to_string(size) + " is less than encoded size " + std::to_string(records_size));
+    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
+    size_t offset = 0;
+    for(auto& packet : packets){
+        size_t s = packet.size();
+        std::memcpy(dst_ptr + offset, &s, sizeof(size_t));
+        offset += sizeof(size_t);
+        std::memcpy(dst_ptr + offset, packet.data(), packet.size());
+        offset += packet.size();
+    }
+    return offset;
+}
+
 using EncodeWorker = std::function<size_t(const void*, Packets&)>;
 using DecodeWorker = std::function<size_t(const Packets&, void*)>;
 
@@ -805,8 +1258,36 @@ protected:
     std::unique_ptr<EncodedGridVolumeWriterPrivate> _;
 };
 
+/**
+ * @brief Encoder speed and quality knobs of video codec, decoding does not need them.
+ * Negative or empty values leave the encoder default.
+ */
+struct VideoEncodeSettings{
+    // ultrafast, superfast, veryfast, faster, fast, medium, slow, slower, veryslow, placebo
+    std::string preset = "medium";
+    // empty for none
+    std::string tune = "fastdecode";
+    // constant rate factor in [0, 51], higher is smaller and worse
+    int crf = -1;
+    // constant qp in [0, 51], overrides crf if set
+    int qp = -1;
+    // max frames between two keyframes
+    int gop_size = -1;
+    // force a closed gop keyframe every n frames so a part of frames can be decoded alone, overrides gop_size,
+    // 0 for only the first frame
+    int keyframe_interval = 0;
+    // encoder worker threads, 0 for hardware concurrency
+    int threads = 0;
+
+    bool operator==(const VideoEncodeSettings&) const = default;
+};
+
 struct EncodedBlockedGridVolumeDesc : BlockedGridVolumeDesc{
     GridVolumeCodec codec;
+    // how the video codec stream was encoded, only recorded for readers
+    VideoEncodeSettings encode_settings;
+    // float32 volume is quantized per block to this integer type before encode
+    VoxelType quantized_type = VoxelType::uint16;
     char preserve[32];
 };
 
@@ -814,6 +1295,9 @@ inline bool CheckValidation(const EncodedBlockedGridVolumeDesc& desc){
     if(desc.block_length == 0 || desc.block_length <= (desc.padding << 1)){
         return false;
     }
+    if(desc.voxel_info.type == VoxelType::float32 && !IsVoxelTypeInteger(desc.quantized_type)){
+        return false;
+    }
     if(desc.extend.width == 0 || desc.extend.height == 0 || desc.extend.depth == 0){
         return false;
     }
@@ -821,19 +1305,91 @@ inline bool CheckValidation(const EncodedBlockedGridVolumeDesc& desc){
 }
 
 /**
- * @note This class not implied and not used.
+ * @brief Bricked volume which keeps every block compressed in memory.
+ * Blocks are decoded on first touch into a bounded pool of decoded blocks, the page table maps a block index to its
+ * encoded records and its decoded block if resident. Written blocks are encoded again after eviction or on Flush.
+ * ReadVoxels and WriteVoxels are thread safe.
+ * @note Reference from operator() and pointer from GetRawBlockData stay valid until the next call of them,
+ * they pin the last touched block only, and writing through them does not update padding copies.
+ * Such writes are kept only if the block is marked by MarkBlockDirty while still pinned.
  */
 class EncodedBlockedGridVolumePrivate;
 template<typename Voxel>
 class EncodedBlockedGridVolume: public BlockedGridVolume<Voxel>{
 public:
-    explicit EncodedBlockedGridVolume(const EncodedBlockedGridVolumeDesc& desc);
+    using VoxelT = Voxel;
+    using SelfT = EncodedBlockedGridVolume<Voxel>;
+    static constexpr VolumeType EVolumeType = VolumeType::Grid_BLOCKED_ENCODED;
+
+    /**
+     * @brief Empty volume, all blocks are zero until written.
+     * @param decoded_block_count max decoded blocks kept at the same time, at least 2.
+     */
+    explicit EncodedBlockedGridVolume(const EncodedBlockedGridVolumeDesc& desc, size_t decoded_block_count = 64);
+
+    /**
+     * @brief Load all encoded blocks of an encoded blocked volume file into memory, blocks are not decoded here.
+     */
+    explicit EncodedBlockedGridVolume(const std::string& filename, size_t decoded_block_count = 64);
 
     ~EncodedBlockedGridVolume() override;
 
+    EncodedBlockedGridVolumeDesc GetVolumeDesc() const noexcept;
+
+public:
+    void ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, Voxel *buf)                      override;
+
+    void ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeReadFunc<Voxel> reader)   override;
+
+    void WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, const Voxel *buf)               override;
+
+    void WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeWriteFunc<Voxel> writer) override;
+
+    Voxel& operator()(int x, int y, int z) override;
+
+    const Voxel& operator()(int x, int y, int z) const override;
+
+    VolumeType GetVolumeType() const noexcept override;
+
+    void ReadBlockData(const BlockIndex&, Voxel* buf) override;
+
+    Voxel* GetRawBlockData(const BlockIndex&) override;
+
+    const Voxel* GetRawBlockData(const BlockIndex&) const override;
+
 public:
+    /**
+     * @brief Encode all written blocks still in the decoded pool.
+     */
+    void Flush();
+
+    /**
+     * @brief Record a write through operator() or GetRawBlockData, WriteVoxels marks its blocks itself.
+     */
+    void MarkBlockDirty(const BlockIndex&);
+
+    /**
+     * @return bytes of all encoded blocks held in memory.
+     */
+    size_t GetEncodedBytes() const;
+
+    /**
+     * @return encoded records of one block, same layout as in .ebd file, empty if the block is all zero.
+     */
+    size_t ReadEncodedBlockData(const BlockIndex&, PacketArena& records) const;
+
+private:
+    EncodedBlockedGridVolume(EncodedBlockedGridVolumeReader&& reader, size_t decoded_block_count);
 
 protected:
+    /**
+     * @brief Consecutive points in the same block are sampled as one run over the pinned decoded block,
+     * so coherent points like ray steps decode and pin each block once.
+     */
+    void SampleTrilinear(const Float3* pts, size_t count, float* out) const override;
+
+    void SampleTrilinearGradient(const Float3* pts, size_t count, Float3* out) const override;
+
     std::unique_ptr<EncodedBlockedGridVolumePrivate> _;
 };
 
@@ -863,6 +1419,17 @@ public:
      */
     void ReadBlockData(const BlockIndex& blockIndex, VolumeReadFunc reader);
 
+    /**
+     * @brief Decode packets of one block got from ReadEncodedBlockData into buf, so the file is not read again.
+     */
+    void DecodeBlockData(const BlockIndex& blockIndex, const Packets& packets, void* buf);
+
+    /**
+     * @brief Read slices [z0, z1) of one block(padding included) into buf.
+     * If the block was encoded with keyframe_interval, only gops cover the range are read and decoded.
+     */
+    void ReadBlockSlices(const BlockIndex& blockIndex, int z0, int z1, void* buf);
+
     /**
      * @param size should greater to equal to block bytes.
      * @note read data format is : [(packet_size)(packet_data)][(packet_size)(packet_data)]...
@@ -875,6 +1442,12 @@ public:
      */
     size_t ReadEncodedBlockData(const BlockIndex& blockIndex, Packets& packets);
 
+    /**
+     * @brief Scale and offset of a quantized float32 block, used to write its encoded data again.
+     * @return {0, 0} if the volume is not float32.
+     */
+    std::pair<float, float> GetBlockQuantization(const BlockIndex& blockIndex) const;
+
 private:
     std::unique_ptr<EncodedBlockedGridVolumeReaderPrivate> _;
 };
@@ -904,14 +1477,108 @@ public:
 
     void WriteBlockData(const BlockIndex& blockIndex, VolumeWriteFunc writer);
 
-    void WriteEncodedBlockData(const BlockIndex& blockIndex, const void* buf, size_t size);
-
-    void WriteEncodedBlockData(const BlockIndex& blockIndex, const Packets& packets);
+    /**
+     * @param quantScale quantOffset float32 volume block is stored as v = q * quantScale + quantOffset,
+     * scale must be positive for float32 volume and both are ignored for others.
+     */
+    void WriteEncodedBlockData(const BlockIndex& blockIndex, const void* buf, size_t size,
+                               float quantScale = 0.f, float quantOffset = 0.f);
+
+    void WriteEncodedBlockData(const BlockIndex& blockIndex, const Packets& packets,
+                               float quantScale = 0.f, float quantOffset = 0.f);
 
 private:
     std::unique_ptr<EncodedBlockedGridVolumeWriterPrivate> _;
 };
 
+struct VirtualBlockVolumeCreateInfo{
+    // capacity of the physical block pool in blocks
+    uint32_t physical_block_count = 256;
+    // each loader owns a reader so misses are decoded in parallel, 0 for hardware concurrency
+    int loader_count = 1;
+};
+
+/**
+ * @brief Residency manager of an encoded blocked volume file for renderers and tools.
+ * Decoded blocks(padding included) live in a fixed capacity physical pool, a dense page table maps every block to
+ * its pool slot or to one of the states MissingPage, LoadingPage and EmptyPage(all zero, never takes a slot).
+ * Misses are reported in batches and filled asynchronously by loader threads through EncodedBlockedGridVolumeReader.
+ * Full pool evicts with CLOCK order among blocks not looked up in the current frame.
+ * @note Block data returned by GetBlockData stays valid until the next BeginFrame, Lookup is thread safe.
+ */
+class VirtualBlockVolumePrivate;
+class VirtualBlockVolume{
+public:
+    static constexpr uint32_t MissingPage = 0xffffffffu;
+    static constexpr uint32_t EmptyPage   = 0xfffffffeu;
+    static constexpr uint32_t LoadingPage = 0xfffffffdu;
+
+    VirtualBlockVolume(const std::string& filename, const VirtualBlockVolumeCreateInfo& info = {});
+
+    ~VirtualBlockVolume();
+
+    EncodedBlockedGridVolumeDesc GetVolumeDesc() const noexcept;
+
+    /**
+     * @return block count along x, y and z.
+     */
+    Extend3D GetBlockDim() const noexcept { return block_dim; }
+
+    size_t GetBlockBytes() const noexcept { return block_bytes; }
+
+    uint32_t GetPhysicalBlockCount() const noexcept;
+
+    /**
+     * @return page entry of the block, a pool slot if resident and marks the block used in the current frame.
+     */
+    uint32_t Lookup(const BlockIndex& blockIndex) const noexcept {
+        assert(blockIndex.x >= 0 && blockIndex.y >= 0 && blockIndex.z >= 0 && blockIndex.x < (int)block_dim.width
+               && blockIndex.y < (int)block_dim.height && blockIndex.z < (int)block_dim.depth);
+        const size_t page = ((size_t)blockIndex.z * block_dim.height + blockIndex.y) * block_dim.width + blockIndex.x;
+        const uint32_t entry = page_table[page].load(std::memory_order_acquire);
+        if(entry >= LoadingPage) return entry;
+        // skip the store if already marked to keep the line shared between threads
+        const uint32_t f = frame.load(std::memory_order_relaxed);
+        if(slot_frame[entry].load() != f)
+            slot_frame[entry].store(f);
+        // eviction stores the entry then reloads the frame, so one of both sides sees the other
+        return page_table[page].load() == entry ? entry : MissingPage;
+    }
+
+    const void* GetBlockData(uint32_t slot) const noexcept {
+        assert(slot < LoadingPage);
+        return pool + (size_t)slot * block_bytes;
+    }
+
+    /**
+     * @brief Queue missing blocks for loading, blocks already resident, empty or loading are skipped.
+     */
+    void ReportMisses(std::span<const BlockIndex> blocks);
+
+    /**
+     * @brief Blocks looked up from now are protected from eviction until the next frame.
+     */
+    void BeginFrame() noexcept;
+
+    /**
+     * @brief Block until all queued misses are filled or dropped.
+     */
+    void WaitIdle();
+
+    uint32_t GetResidentBlockCount() const noexcept;
+
+private:
+    Extend3D block_dim;
+    size_t block_bytes = 0;
+    const uint8_t* pool = nullptr;
+    std::atomic<uint32_t>* page_table = nullptr;
+    // frame of the last lookup of each slot
+    std::atomic<uint32_t>* slot_frame = nullptr;
+    std::atomic<uint32_t> frame{1};
+
+    std::unique_ptr<VirtualBlockVolumePrivate> _;
+};
+
 enum class CodecDevice {
     CPU, GPU
 };
@@ -935,6 +1602,13 @@ inline constexpr bool VoxelVideoCodecV = VoxelVideoCodec<T,device>::Value;
 Register_VoxelVideoCodec(VoxelRU8,CodecDevice::CPU)
 Register_VoxelVideoCodec(VoxelRU8,CodecDevice::GPU)
 Register_VoxelVideoCodec(VoxelRU16,CodecDevice::CPU)
+// multi-channel voxels are encoded as one gray stream per channel
+Register_VoxelVideoCodec(VoxelRGU8,CodecDevice::CPU)
+Register_VoxelVideoCodec(VoxelRGBU8,CodecDevice::CPU)
+Register_VoxelVideoCodec(VoxelRGBAU8,CodecDevice::CPU)
+Register_VoxelVideoCodec(VoxelRGU16,CodecDevice::CPU)
+Register_VoxelVideoCodec(VoxelRGBU16,CodecDevice::CPU)
+Register_VoxelVideoCodec(VoxelRGBAU16,CodecDevice::CPU)
 
 class CVolumeCodecInterface{
 public:
@@ -951,6 +1625,21 @@ public:
      */
     virtual size_t Encode(const Extend3D& extend, const void* buf, size_t size, Packets& packets) = 0;
 
+    /**
+     * @brief Append encoded packets as size prefixed records into arena, existing content is kept.
+     * Codecs able to emit records directly override this, the default one goes through Packets.
+     * @return appended bytes
+     */
+    virtual size_t Encode(const Extend3D& extend, const void* buf, size_t size, PacketArena& arena){
+        Packets packets;
+        Encode(extend, buf, size, packets);
+        const size_t offset = arena.size();
+        arena.reserve(offset + GetPacketRecordsSize(packets));
+        for(auto& packet : packets)
+            AppendPacketRecord(arena, packet.data(), packet.size());
+        return arena.size() - offset;
+    }
+
     /**
      * @note throw on error
      * @note buf' size should be enough large for decoding
@@ -1006,15 +1695,22 @@ class VolumeVideoCodec<T, CodecDevice::CPU, std::enable_if_t<VoxelVideoCodecV<T,
 public:
     explicit VolumeVideoCodec(int threadCount = 1);
 
+    explicit VolumeVideoCodec(const VideoEncodeSettings& settings, int threadCount = 1);
+
     CodecDevice GetCodecDevice() const noexcept override{
         return CodecDevice::CPU;
     }
 
     size_t Encode(const Extend3D& extend, const void* buf, size_t size, Packets& packets) override;
 
+    size_t Encode(const Extend3D& extend, const void* buf, size_t size, PacketArena& arena) override;
+
     size_t Decode(const Extend3D &extend, const Packets &packets, void* buf, size_t size) override;
 
 public:
+    /**
+     * @note throw if size is less than the encoded size
+     */
     size_t Encode(const std::vector<SliceDataView<T>> &slices, void* buf, size_t size)  override;
 
     size_t Encode(const GridDataView<T>& volume,SliceAxis axis, void* buf, size_t size) override;
@@ -1023,6 +1719,11 @@ public:
 
     size_t Encode(const GridDataView<T>& volume,SliceAxis axis, Packets &packets)       override;
 
+private:
+    // encode_frame(src, size) for each slice and (nullptr, 0) for the end
+    template<typename EncodeFrame>
+    bool EncodeSlices(const std::vector<SliceDataView<T>> &slices, EncodeFrame&& encode_frame);
+
 protected:
     std::unique_ptr<CPUVolumeVideoCodecPrivate> _;
 };
@@ -1069,6 +1770,52 @@ protected:
 template<typename T>
 using GPUVolumeVideoCodec = VolumeVideoCodec<T, CodecDevice::GPU, std::enable_if_t<VoxelVideoCodecV<T,CodecDevice::GPU>>>;
 
+struct VolumeCodecCreateInfo{
+    GridVolumeCodec codec = GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO;
+    VoxelInfo voxel_info = {VoxelType::unknown, VoxelFormat::NONE};
+    CodecDevice device = CodecDevice::CPU;
+    // codec internal threads for cpu codec, 0 for hardware concurrency
+    int thread_count = 0;
+    // gpu index for gpu codec
+    int device_index = 0;
+    // only used by video codec
+    VideoEncodeSettings encode_settings = {};
+};
+
+using VolumeCodecFactory = std::function<std::unique_ptr<CVolumeCodecInterface>(const VolumeCodecCreateInfo&)>;
+
+/**
+ * @brief Map (codec, voxel info, device) to a codec factory, so reader and writer create codec by the id stored in file.
+ * Built-in codecs are registered on first use, user codecs can be registered or replaced at any time.
+ * @note thread safe.
+ */
+class VolumeCodecRegistryPrivate;
+class VolumeCodecRegistry{
+public:
+    static VolumeCodecRegistry& GetInstance();
+
+    ~VolumeCodecRegistry();
+
+    /**
+     * @brief Replace the old factory if already registered.
+     */
+    void Register(GridVolumeCodec codec, const VoxelInfo& voxel_info, CodecDevice device, VolumeCodecFactory factory);
+
+    bool Unregister(GridVolumeCodec codec, const VoxelInfo& voxel_info, CodecDevice device);
+
+    bool IsRegistered(GridVolumeCodec codec, const VoxelInfo& voxel_info, CodecDevice device) const;
+
+    /**
+     * @return nullptr if no factory registered.
+     */
+    std::unique_ptr<CVolumeCodecInterface> Create(const VolumeCodecCreateInfo& info) const;
+
+private:
+    VolumeCodecRegistry();
+
+    std::unique_ptr<VolumeCodecRegistryPrivate> _;
+};
+
 
 struct VolumeFileDesc{
     void Set(VolumeType type, const VolumeFileDesc& desc) noexcept {
@@ -1125,16 +1872,147 @@ public:
     //get tf...
 };
 
-//histogram
+struct VolumeStatisticsCreateInfo{
+    // histogram bins for float voxels, integer voxels always get one bin per value
+    uint32_t float_bin_count = 1024;
+    // upper bound of one slab, two slabs are kept so the next one is read while the current one is counted
+    size_t slab_bytes = 256ull << 20;
+    // 0 for hardware concurrency
+    int thread_count = 0;
+};
+
+/**
+ * @brief Statistics of the first channel of a volume, computed by streaming the reader in z slabs.
+ * Integer voxels are counted in a single pass, float voxels take a second pass to bin over [min, max].
+ * NaN and inf are not counted.
+ */
+class VolumeStatisticsPrivate;
+class CVolumeStatistics{
+public:
+    /**
+     * @note throw on read error
+     */
+    CVolumeStatistics(CVolumeReaderInterface& reader, const Extend3D& extend, const VoxelInfo& voxel_info,
+                      const VolumeStatisticsCreateInfo& info = {});
+
+    /**
+     * @brief From a histogram counted elsewhere, integer voxels only with one bin per value.
+     */
+    CVolumeStatistics(const VoxelInfo& voxel_info, std::vector<uint64_t> histogram);
+
+    virtual ~CVolumeStatistics();
+
+    /**
+     * @brief Write summary, percentiles and histogram as a .ss.json file.
+     */
+    bool SaveToFile(const std::string& filename) const;
+
+    VoxelInfo GetVoxelInfo() const noexcept;
+
+    uint64_t GetVoxelCount() const noexcept;
+
+    double GetMin() const noexcept;
+
+    double GetMax() const noexcept;
+
+    double GetMean() const noexcept;
+
+    /**
+     * @brief Population variance.
+     */
+    double GetVariance() const noexcept;
+
+    /**
+     * @brief Bin i counts values in [min + i * width, min + (i + 1) * width), the last bin also holds the max value.
+     */
+    const std::vector<uint64_t>& GetHistogram() const noexcept;
+
+    double GetHistogramMin() const noexcept;
+
+    double GetHistogramBinWidth() const noexcept;
+
+    /**
+     * @param percent in [0, 100]
+     * @return smallest value with at least percent of the voxels not above it,
+     * exact for integer voxels and interpolated inside the bin for float.
+     */
+    double GetPercentile(double percent) const noexcept;
+
+protected:
+    std::unique_ptr<VolumeStatisticsPrivate> _;
+};
+
 template<VolumeType type>
-class VolumeStatistics;
+class VolumeStatistics : public CVolumeStatistics{
+public:
+    using ReaderT = typename VolumeTypeTraits<VoxelRU8, type>::ReaderT;
 
-template<>
-class VolumeStatistics<VolumeType::Grid_RAW>{
+    /**
+     * @param filename volume desc file opened by the reader of this volume type
+     */
+    explicit VolumeStatistics(const std::string& filename, const VolumeStatisticsCreateInfo& info = {})
+    : VolumeStatistics(std::make_unique<ReaderT>(filename), info)
+    {}
+
+private:
+    VolumeStatistics(std::unique_ptr<ReaderT> reader, const VolumeStatisticsCreateInfo& info)
+    : CVolumeStatistics(*reader, reader->GetVolumeDesc().extend, reader->GetVolumeDesc().voxel_info, info)
+    {}
+};
+
+struct VolumeGradientHistogramCreateInfo{
+    uint32_t intensity_bin_count = 256;
+    uint32_t gradient_bin_count = 256;
+    // intensity axis of float voxels, integer voxels use the whole range of their type
+    float value_min = 0.f;
+    float value_max = 1.f;
+    // upper end of the gradient axis, 0 for the largest central difference the intensity range allows
+    float max_gradient = 0.f;
+    // upper bound of one slab including its halo slices
+    size_t slab_bytes = 256ull << 20;
+    // 0 for hardware concurrency
+    int thread_count = 0;
+};
+
+/**
+ * @brief Joint histogram of intensity and gradient magnitude of the first channel, for transfer function design.
+ * Gradients are central differences in voxel units, one-sided at the border, computed while streaming
+ * the reader once in z slabs with one halo slice on each side. Values outside the axes go to the edge bins,
+ * voxels with NaN or inf in their neighborhood are not counted.
+ */
+class VolumeGradientHistogramPrivate;
+class VolumeGradientHistogram{
 public:
-    VolumeStatistics(const std::string& filename, const RawGridVolumeDesc& desc){
+    /**
+     * @note throw on read error
+     */
+    VolumeGradientHistogram(CVolumeReaderInterface& reader, const Extend3D& extend, const VoxelInfo& voxel_info,
+                            const VolumeGradientHistogramCreateInfo& info = {});
 
-    }
+    ~VolumeGradientHistogram();
+
+    uint32_t GetIntensityBinCount() const noexcept;
+
+    uint32_t GetGradientBinCount() const noexcept;
+
+    double GetIntensityMin() const noexcept;
+
+    double GetIntensityMax() const noexcept;
+
+    double GetMaxGradient() const noexcept;
+
+    /**
+     * @brief Row major, bin (i, g) is at g * GetIntensityBinCount() + i.
+     */
+    const std::vector<uint64_t>& GetHistogram() const noexcept;
+
+    /**
+     * @brief Write axes and bins as a .tf.json file.
+     */
+    bool SaveToFile(const std::string& filename) const;
+
+private:
+    std::unique_ptr<VolumeGradientHistogramPrivate> _;
 };
 
 /**
@@ -1245,6 +2123,8 @@ public:
         bool encode = true;
         int device_index = 0;
         void* context = nullptr;
+        // only used for encode
+        VideoEncodeSettings encode_settings = {};
         friend std::ostream& operator<<(std::ostream& os, const CodecParams& params){
             os << "CodecParams Info :"
             << "\tframe_w : " << params.frame_w
@@ -1254,7 +2134,13 @@ public:
             << "\t bits_per_sampler : " << params.bits_per_sampler
             << "\t encode : " << params.encode
             << "\t device_index : " << params.device_index
-            << "\t context : " << params.context;
+            << "\t context : " << params.context
+            << "\t preset : " << params.encode_settings.preset
+            << "\t tune : " << params.encode_settings.tune
+            << "\t crf : " << params.encode_settings.crf
+            << "\t qp : " << params.encode_settings.qp
+            << "\t gop_size : " << params.encode_settings.gop_size
+            << "\t keyframe_interval : " << params.encode_settings.keyframe_interval;
             return os;
         }
     };
@@ -1272,6 +2158,18 @@ public:
      */
     virtual void EncodeFrameIntoPackets(const void* buf, size_t size, Packets& packets) = 0;
 
+    /**
+     * @brief Same as EncodeFrameIntoPackets but append size prefixed records into arena.
+     * @return appended packet count
+     */
+    virtual size_t EncodeFrameIntoArena(const void* buf, size_t size, PacketArena& arena){
+        Packets packets;
+        EncodeFrameIntoPackets(buf, size, packets);
+        for(auto& packet : packets)
+            AppendPacketRecord(arena, packet.data(), packet.size());
+        return packets.size();
+    }
+
     /**
      * @param buf start ptr for buffer to decode into
      * @param size buffer size for buf, must be large enough
@@ -1280,10 +2178,96 @@ public:
     virtual size_t DecodePacketIntoFrames(const Packet& packet, void* buf, size_t size) = 0;
 };
 
+/**
+ * @brief Split packed voxels into channel planes [channels][count] or merge back, sample_size is 1 or 2 bytes.
+ */
+void DeinterleaveVoxelChannels(const void* src, size_t count, int channels, int sample_size, void* dst);
+
+void InterleaveVoxelChannels(const void* src, size_t count, int channels, int sample_size, void* dst);
+
 class CPUVolumeVideoCodecPrivate{
 public:
     std::unique_ptr<VideoCodec> video_codec;
     int thread_count = 0;
+    VideoEncodeSettings encode_settings;
+    // channel planes of multi-channel voxel
+    std::vector<uint8_t> planes;
+    // records of the void* encode overloads, kept to reuse its capacity
+    PacketArena arena;
+
+    /**
+     * @brief Encode gray frames as one stream, encode_frame(src, size) is invoked for each frame and (nullptr, 0) for the end.
+     */
+    template<typename EncodeFrame>
+    void EncodeStream(const Extend3D& extend, const void* buf, int bits_per_sampler, EncodeFrame&& encode_frame){
+        auto [w, h, d] = extend;
+        VideoCodec::CodecParams params{
+                .frame_w = (int)w,
+                .frame_h = (int)h,
+                .frame_n = (int)d,
+                .samplers_per_pixel = 1,
+                .bits_per_sampler = bits_per_sampler,
+                .threads_count = thread_count,
+                .encode_settings = encode_settings
+        };
+        if(!video_codec->ReSet(params)){
+            std::cerr << "Invalid Video CodecParams, " << params << std::endl;
+            throw VolumeCodecError("CPU video encode reset failed");
+        }
+
+        auto src_ptr = reinterpret_cast<const uint8_t*>(buf);
+        const size_t slice_size = (size_t)w * h * (bits_per_sampler / 8);
+        for(uint32_t z = 0; z < d; z++)
+            encode_frame(src_ptr + (size_t)z * slice_size, slice_size);
+        // one more for end
+        encode_frame(nullptr, 0);
+    }
+
+    size_t EncodeStream(const Extend3D& extend, const void* buf, int bits_per_sampler, Packets& packets){
+        size_t packed_size = 0;
+        EncodeStream(extend, buf, bits_per_sampler, [&](const void* src, size_t size){
+            Packets tmp_packets;
+            video_codec->EncodeFrameIntoPackets(src, size, tmp_packets);
+            packed_size += GetPacketRecordsSize(tmp_packets);
+            packets.insert(packets.end(), std::make_move_iterator(tmp_packets.begin()), std::make_move_iterator(tmp_packets.end()));
+        });
+        return packed_size;
+    }
+
+    // @return appended packet count
+    size_t EncodeStream(const Extend3D& extend, const void* buf, int bits_per_sampler, PacketArena& arena){
+        size_t packet_count = 0;
+        EncodeStream(extend, buf, bits_per_sampler, [&](const void* src, size_t size){
+            packet_count += video_codec->EncodeFrameIntoArena(src, size, arena);
+        });
+        return packet_count;
+    }
+
+    // decode packets [beg, end) of one stream
+    size_t DecodeStream(Packets::const_iterator beg, Packets::const_iterator end, void* buf, size_t size){
+        VideoCodec::CodecParams params{
+            .threads_count = thread_count,
+            .encode = false
+        };
+        if(!video_codec->ReSet(params)){
+            std::cerr << "Invalid Video CodecParams, " << params << std::endl;
+            throw VolumeCodecError("CPU video decode reset failed");
+        }
+
+        auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
+        size_t decode_size = 0;
+        for(auto it = beg; it != end; ++it){
+            auto ret = video_codec->DecodePacketIntoFrames(*it, dst_ptr + decode_size, size - decode_size);
+            decode_size += ret;
+        }
+        // one more for end
+        auto ret = video_codec->DecodePacketIntoFrames({}, dst_ptr + decode_size, size - decode_size);
+        decode_size += ret;
+        if(decode_size > size){
+            throw VolumeCodecError("CPU volume video decode error : target decode buffer size is not enough large!");
+        }
+        return decode_size;
+    }
 };
 
 template<typename T>
@@ -1293,74 +2277,104 @@ CPUVolumeVideoCodec<T>::VolumeVideoCodec(int threadCount) {
     _->thread_count = threadCount;
 }
 
+template<typename T>
+CPUVolumeVideoCodec<T>::VolumeVideoCodec(const VideoEncodeSettings& settings, int threadCount)
+    : VolumeVideoCodec(threadCount){
+    _->encode_settings = settings;
+}
+
 // ===================
 // 主要使用的两个接口函数
+/**
+ * Multi-channel voxel is split into channel planes, each encoded as a gray stream.
+ * The first packet is then a header of uint32 [channels, packet count of each channel].
+ */
 template<typename T>
 size_t CPUVolumeVideoCodec<T>::Encode(const Extend3D &extend, const void *buf, size_t size, Packets &packets) {
-    auto [w, h, d] = extend;
-    VideoCodec::CodecParams params{
-            .frame_w = (int)w,
-            .frame_h = (int)h,
-            .frame_n = (int)d,
-            .samplers_per_pixel = GetVoxelSampleCount(T::format),
-            .bits_per_sampler = GetVoxelBits(T::type),
-            .threads_count = _->thread_count
-    };
-    if(!_->video_codec->ReSet(params)){
-        std::cerr << "Invalid Video CodecParams, " << params << std::endl;
-        throw VolumeCodecError("CPU video encode reset failed");
+    constexpr int channels = GetVoxelSampleCount(T::format);
+    constexpr int bits = GetVoxelBits(T::type);
+    assert(size == extend.size() * GetVoxelSize(T::type, T::format));
+    if constexpr(channels == 1){
+        return _->EncodeStream(extend, buf, bits, packets);
     }
-
-    auto src_ptr = reinterpret_cast<const uint8_t*>(buf);
-    auto voxel_size = GetVoxelSize(T::type, T::format);
-    const size_t slice_size = w * h * voxel_size;
-    assert(size == (size_t)w * h * d * voxel_size);
-    size_t packed_size = 0;
-    for(int z = 0; z < d + 1; z++){
-        Packets tmp_packets;
-        if(z < d){
-            size_t src_offset = (size_t)z * slice_size;
-            _->video_codec->EncodeFrameIntoPackets(src_ptr + src_offset, slice_size, tmp_packets);
+    else{
+        const size_t count = extend.size();
+        const size_t plane_size = count * (bits / 8);
+        _->planes.resize(plane_size * channels);
+        DeinterleaveVoxelChannels(buf, count, channels, bits / 8, _->planes.data());
+
+        uint32_t header[1 + channels] = {channels};
+        auto header_pos = packets.size();
+        packets.emplace_back(sizeof(header));
+        size_t packed_size = sizeof(header) + sizeof(size_t);
+        for(int c = 0; c < channels; c++){
+            auto before = packets.size();
+            packed_size += _->EncodeStream(extend, _->planes.data() + c * plane_size, bits, packets);
+            header[1 + c] = static_cast<uint32_t>(packets.size() - before);
         }
-        else
-            // one more for end
-            _->video_codec->EncodeFrameIntoPackets(nullptr, 0, tmp_packets);
-        for(auto& p : tmp_packets)
-            packed_size += p.size() + sizeof(size_t);
-        packets.insert(packets.end(), tmp_packets.begin(), tmp_packets.end());
+        std::memcpy(packets[header_pos].data(), header, sizeof(header));
+        return packed_size;
     }
-    return packed_size;
+}
+
+template<typename T>
+size_t CPUVolumeVideoCodec<T>::Encode(const Extend3D &extend, const void *buf, size_t size, PacketArena &arena) {
+    constexpr int channels = GetVoxelSampleCount(T::format);
+    constexpr int bits = GetVoxelBits(T::type);
+    assert(size == extend.size() * GetVoxelSize(T::type, T::format));
+    const size_t offset = arena.size();
+    if constexpr(channels == 1){
+        _->EncodeStream(extend, buf, bits, arena);
+    }
+    else{
+        const size_t count = extend.size();
+        const size_t plane_size = count * (bits / 8);
+        _->planes.resize(plane_size * channels);
+        DeinterleaveVoxelChannels(buf, count, channels, bits / 8, _->planes.data());
+
+        // header record is patched after all channels are encoded
+        uint32_t header[1 + channels] = {channels};
+        AppendPacketRecord(arena, header, sizeof(header));
+        for(int c = 0; c < channels; c++)
+            header[1 + c] = static_cast<uint32_t>(_->EncodeStream(extend, _->planes.data() + c * plane_size, bits, arena));
+        std::memcpy(arena.data() + offset + sizeof(size_t), header, sizeof(header));
+    }
+    return arena.size() - offset;
 }
 
 template<typename T>
 size_t CPUVolumeVideoCodec<T>::Decode(const Extend3D &extend, const Packets &packets, void *buf, size_t size) {
     assert(buf && size && !packets.empty());
 
-    auto voxel_size = GetVoxelSize(T::type, T::format);
-    assert(extend.size() * voxel_size <= size);
-
-    VideoCodec::CodecParams params{
-        .threads_count = _->thread_count,
-        .encode = false
-    };
-    if(!_->video_codec->ReSet(params)){
-        std::cerr << "Invalid Video CodecParams, " << params << std::endl;
-        throw VolumeCodecError("CPU video decode reset failed");
-    }
-
-    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
-    size_t decode_size = 0;
-    for(auto& packet : packets){
-        auto ret = _->video_codec->DecodePacketIntoFrames(packet, dst_ptr + decode_size, size - decode_size);
-        decode_size += ret;
+    constexpr int channels = GetVoxelSampleCount(T::format);
+    constexpr int bits = GetVoxelBits(T::type);
+    assert(extend.size() * GetVoxelSize(T::type, T::format) <= size);
+    if constexpr(channels == 1){
+        return _->DecodeStream(packets.begin(), packets.end(), buf, size);
     }
-    // one more for end
-    auto ret = _->video_codec->DecodePacketIntoFrames({}, dst_ptr + decode_size, size - decode_size);
-    decode_size += ret;
-    if(decode_size > size){
-        throw VolumeCodecError("CPU volume video decode error : target decode buffer size is not enough large!");
+    else{
+        uint32_t header[1 + channels];
+        if(packets.front().size() != sizeof(header))
+            throw VolumeCodecError("CPU volume video decode error : invalid channel header packet");
+        std::memcpy(header, packets.front().data(), sizeof(header));
+        size_t total = 1;
+        for(int c = 0; c < channels; c++) total += header[1 + c];
+        if(header[0] != channels || total != packets.size())
+            throw VolumeCodecError("CPU volume video decode error : packet count not match channel header");
+
+        const size_t count = extend.size();
+        const size_t plane_size = count * (bits / 8);
+        if(size < plane_size * channels)
+            throw VolumeCodecError("CPU volume video decode error : target decode buffer size is not enough large!");
+        _->planes.resize(plane_size * channels);
+        auto it = packets.begin() + 1;
+        for(int c = 0; c < channels; c++){
+            _->DecodeStream(it, it + header[1 + c], _->planes.data() + c * plane_size, plane_size);
+            it += header[1 + c];
+        }
+        InterleaveVoxelChannels(_->planes.data(), count, channels, bits / 8, buf);
+        return plane_size * channels;
     }
-    return decode_size;
 }
 // ===================
 
@@ -1369,78 +2383,29 @@ size_t CPUVolumeVideoCodec<T>::Encode(const std::vector<SliceDataView<T>> &slice
     if(!buf || !size) return 0;
     if(slices.empty()) return 0;
 
-    Packets packets;
-    auto ret = Encode(slices, packets);
-    if(!ret) return 0;
-    // packets to linear buf
-    size_t packet_size = 0;
-    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
-    for(auto& packet : packets){
-        if(packet_size >= size) break;
-        size_t s = packet.size();
-        std::memcpy(dst_ptr + packet_size, &s, sizeof(size_t));
-        packet_size += sizeof(size_t);
-        std::memcpy(dst_ptr + packet_size, packet.data(), packet.size());
-        packet_size += packet.size();
-    }
-
-    return packet_size;
+    _->arena.clear();
+    auto ok = EncodeSlices(slices, [this](const void* src, size_t src_size){
+        _->video_codec->EncodeFrameIntoArena(src, src_size, _->arena);
+    });
+    if(!ok) return 0;
+    return CopyPacketRecords(_->arena.data(), _->arena.size(), buf, size);
 }
 
 template<typename T>
 size_t CPUVolumeVideoCodec<T>::Encode(const GridDataView<T> &volume, SliceAxis axis, void *buf, size_t size) {
-    GridData<T> grid(volume.Width(), volume.Height(), volume.Depth());
-    if(axis == SliceAxis::AXIS_Z){
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(x, y, z) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_Y){
-        // x y z -> z x y
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(z, x, y) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_X){
-        // x y z - > y z x
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(y, z, x) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    Packets packets;
-    auto ret = Encode({grid.Width(), grid.Height(), grid.Depth()}, grid.GetRawPtr(), grid.Size() * sizeof(T), packets);
-    if(!ret) return 0;
+    const Extend3D src_extend = {volume.Width(), volume.Height(), volume.Depth()};
+    const Extend3D extend = GetPermutedExtend(src_extend, axis);
+    GridData<T> grid(extend.width, extend.height, extend.depth);
+    Permute3D(&volume(0, 0, 0), src_extend, sizeof(T), axis, grid.GetRawPtr(), _->thread_count);
+    _->arena.clear();
+    Encode({grid.Width(), grid.Height(), grid.Depth()}, grid.GetRawPtr(), grid.Size() * sizeof(T), _->arena);
     // buf must be cpu
-    (void)(*(uint8_t*)buf);
-    // packets to linear buf
-    size_t packet_size = 0;
-    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
-    for(auto& packet : packets){
-        if(packet_size >= size) break;
-        size_t s = packet.size();
-        std::memcpy(dst_ptr + packet_size, &s, sizeof(size_t));
-        packet_size += sizeof(size_t);
-        std::memcpy(dst_ptr + packet_size, packet.data(), packet.size());
-        packet_size += packet.size();
-    }
-
-    return packet_size;
+    return CopyPacketRecords(_->arena.data(), _->arena.size(), buf, size);
 }
 
 template<typename T>
-size_t CPUVolumeVideoCodec<T>::Encode(const std::vector<SliceDataView<T>> &slices, Packets &packets) {
+template<typename EncodeFrame>
+bool CPUVolumeVideoCodec<T>::EncodeSlices(const std::vector<SliceDataView<T>> &slices, EncodeFrame&& encode_frame) {
     // SliceDataView' storage maybe not linear because of map
     auto voxel_size = T::size();
     auto width = slices.front().Width();
@@ -1453,60 +2418,43 @@ size_t CPUVolumeVideoCodec<T>::Encode(const std::vector<SliceDataView<T>> &slice
             GetVoxelBits(T::type),
             _->thread_count
     };
+    params.encode_settings = _->encode_settings;
     if(!_->video_codec->ReSet(params)) return false;
     SliceData<T> slice_data(width, height);
     for(auto& slice : slices){
-        Packets tmp_packets;
         if(slice.IsLinear()){
-            _->video_codec->EncodeFrameIntoPackets(slice.GetRawPtr(), slice_size, tmp_packets);
+            encode_frame(slice.GetRawPtr(), slice_size);
         }
         else{
             for(int i = 0; i < height; i++)
                 for(int j = 0; j < width; j++)
                     slice_data(j, i) = slice(j, i);
-            _->video_codec->EncodeFrameIntoPackets(slice_data.GetRawPtr(), slice_size, tmp_packets);
+            encode_frame(slice_data.GetRawPtr(), slice_size);
         }
-        packets.insert(packets.end(), tmp_packets.begin(), tmp_packets.end());
     }
     //one more for end
-    Packets tmp_packets;
-    _->video_codec->EncodeFrameIntoPackets(nullptr, 0, tmp_packets);
-    packets.insert(packets.end(), tmp_packets.begin(), tmp_packets.end());
+    encode_frame(nullptr, 0);
     return true;
 }
 
+template<typename T>
+size_t CPUVolumeVideoCodec<T>::Encode(const std::vector<SliceDataView<T>> &slices, Packets &packets) {
+    size_t packed_size = 0;
+    auto ok = EncodeSlices(slices, [&](const void* src, size_t src_size){
+        Packets tmp_packets;
+        _->video_codec->EncodeFrameIntoPackets(src, src_size, tmp_packets);
+        packed_size += GetPacketRecordsSize(tmp_packets);
+        packets.insert(packets.end(), std::make_move_iterator(tmp_packets.begin()), std::make_move_iterator(tmp_packets.end()));
+    });
+    return ok ? packed_size : 0;
+}
+
 template<typename T>
 size_t CPUVolumeVideoCodec<T>::Encode(const GridDataView<T> &volume, SliceAxis axis, Packets &packets) {
-    GridData<T> grid(volume.Width(), volume.Height(), volume.Depth());
-    if(axis == SliceAxis::AXIS_Z){
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(x, y, z) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_Y){
-        // x y z -> z x y
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(z, x, y) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_X){
-        // x y z - > y z x
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(y, z, x) = volume(x, y, z);
-                }
-            }
-        }
-    }
+    const Extend3D src_extend = {volume.Width(), volume.Height(), volume.Depth()};
+    const Extend3D extend = GetPermutedExtend(src_extend, axis);
+    GridData<T> grid(extend.width, extend.height, extend.depth);
+    Permute3D(&volume(0, 0, 0), src_extend, sizeof(T), axis, grid.GetRawPtr(), _->thread_count);
     auto ret = Encode({grid.Width(), grid.Height(), grid.Depth()}, grid.GetRawPtr(), grid.Size() * sizeof(T), packets);
     return ret > 0;
 }
@@ -1600,71 +2548,21 @@ size_t GPUVolumeVideoCodec<T>::Encode(const std::vector<SliceDataView<T>> &slice
     if(!ret) return 0;
     // buf must be cpu
     (void)(*(uint8_t*)buf);
-    // packets to linear buf
-    size_t packet_size = 0;
-    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
-    for(auto& packet : packets){
-        if(packet_size >= size) break;
-        size_t s = packet.size();
-        std::memcpy(dst_ptr + packet_size, &s, sizeof(size_t));
-        packet_size += sizeof(size_t);
-        std::memcpy(dst_ptr + packet_size, packet.data(), packet.size());
-        packet_size += packet.size();
-    }
-
-    return packet_size;
+    return CopyPacketRecords(packets, buf, size);
 }
 
 template<typename T>
 size_t GPUVolumeVideoCodec<T>::Encode(const GridDataView<T> &volume, SliceAxis axis, void *buf, size_t size) {
-    GridData<T> grid(volume.Width(), volume.Height(), volume.Depth());
-    if(axis == SliceAxis::AXIS_Z){
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(x, y, z) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_Y){
-        // x y z -> z x y
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(z, x, y) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_X){
-        // x y z - > y z x
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(y, z, x) = volume(x, y, z);
-                }
-            }
-        }
-    }
+    const Extend3D src_extend = {volume.Width(), volume.Height(), volume.Depth()};
+    const Extend3D extend = GetPermutedExtend(src_extend, axis);
+    GridData<T> grid(extend.width, extend.height, extend.depth);
+    Permute3D(&volume(0, 0, 0), src_extend, sizeof(T), axis, grid.GetRawPtr());
     Packets packets;
     auto ret = Encode({grid.Width(), grid.Height(), grid.Depth()}, grid.GetRawPtr(), grid.Size() * sizeof(T), packets);
     if(!ret) return 0;
     // buf must be cpu
     (void)(*(uint8_t*)buf);
-    // packets to linear buf
-    size_t packet_size = 0;
-    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
-    for(auto& packet : packets){
-        if(packet_size >= size) break;
-        size_t s = packet.size();
-        std::memcpy(dst_ptr + packet_size, &s, sizeof(size_t));
-        packet_size += sizeof(size_t);
-        std::memcpy(dst_ptr + packet_size, packet.data(), packet.size());
-        packet_size += packet.size();
-    }
-
-    return packet_size;
+    return CopyPacketRecords(packets, buf, size);
 }
 
 template<typename T>
@@ -1706,36 +2604,10 @@ size_t GPUVolumeVideoCodec<T>::Encode(const std::vector<SliceDataView<T>> &slice
 
 template<typename T>
 size_t GPUVolumeVideoCodec<T>::Encode(const GridDataView<T> &volume, SliceAxis axis, Packets &packets) {
-    GridData<T> grid(volume.Width(), volume.Height(), volume.Depth());
-    if(axis == SliceAxis::AXIS_Z){
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(x, y, z) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_Y){
-        // x y z -> z x y
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(z, x, y) = volume(x, y, z);
-                }
-            }
-        }
-    }
-    else if(axis == SliceAxis::AXIS_X){
-        // x y z - > y z x
-        for(uint32_t z = 0; z < grid.Depth(); z++){
-            for(uint32_t y = 0; y < grid.Height(); y++){
-                for(uint32_t x = 0; x < grid.Width(); x++){
-                    grid(y, z, x) = volume(x, y, z);
-                }
-            }
-        }
-    }
+    const Extend3D src_extend = {volume.Width(), volume.Height(), volume.Depth()};
+    const Extend3D extend = GetPermutedExtend(src_extend, axis);
+    GridData<T> grid(extend.width, extend.height, extend.depth);
+    Permute3D(&volume(0, 0, 0), src_extend, sizeof(T), axis, grid.GetRawPtr());
     auto ret = Encode({grid.Width(), grid.Height(), grid.Depth()}, grid.GetRawPtr(), grid.Size() * sizeof(T), packets);
     return ret > 0;
 }
@@ -1745,14 +2617,148 @@ VOL_END
 // imply template class VolumeBitsCodec
 VOL_BEGIN
 
+/**
+ * @brief Lossless codec, each packet holds a few slices and can be decoded alone.
+ */
 class BitsCodec{
 public:
-    struct BitsCodecParams{
+    virtual ~BitsCodec() = default;
 
+    struct BitsCodecParams{
+        int width = 0;
+        int height = 0;
+        int depth = 0;
+        int samplers_per_pixel = 0;
+        // 8 or 16
+        int bits_per_sampler = 0;
+        int threads_count = 1;
     };
+
+    /**
+     * @return nullptr if device not supported.
+     */
     static std::unique_ptr<BitsCodec> Create(CodecDevice device);
 
+    /**
+     * @note throw VolumeCodecError on error
+     * @return encoded packets' packed size
+     */
+    virtual size_t Encode(const BitsCodecParams& params, const void* buf, size_t size, Packets& packets) = 0;
+
+    /**
+     * @note throw VolumeCodecError on error
+     * @return decoded bytes
+     */
+    virtual size_t Decode(const BitsCodecParams& params, const Packets& packets, void* buf, size_t size) = 0;
 };
 
+template<typename T, CodecDevice device>
+struct VoxelBitsCodec{
+    static constexpr bool Value = false;
+};
+
+#define Register_VoxelBitsCodec(VoxelT, device) \
+template<>                                      \
+struct VoxelBitsCodec<VoxelT,device>{           \
+    static constexpr bool Value = true;         \
+};
+
+template<typename T, CodecDevice device>
+inline constexpr bool VoxelBitsCodecV = VoxelBitsCodec<T,device>::Value;
+
+Register_VoxelBitsCodec(VoxelRU8,CodecDevice::CPU)
+Register_VoxelBitsCodec(VoxelRU16,CodecDevice::CPU)
+
+template<typename T,CodecDevice device,typename V = void>
+class VolumeBitsCodec;
+
+class CPUVolumeBitsCodecPrivate{
+public:
+    std::unique_ptr<BitsCodec> bits_codec;
+    int thread_count = 1;
+};
+
+template<typename T>
+class VolumeBitsCodec<T, CodecDevice::CPU, std::enable_if_t<VoxelBitsCodecV<T,CodecDevice::CPU>>>
+        : public VolumeBitsCodecInterface<T>{
+public:
+    explicit VolumeBitsCodec(int threadCount = 1){
+        _ = std::make_unique<CPUVolumeBitsCodecPrivate>();
+        _->bits_codec = BitsCodec::Create(CodecDevice::CPU);
+        _->thread_count = threadCount;
+        if(!_->bits_codec)
+            throw VolumeCodecError("CPU bits codec not available");
+    }
+
+    CodecDevice GetCodecDevice() const noexcept override{
+        return CodecDevice::CPU;
+    }
+
+    size_t Encode(const Extend3D& extend, const void* buf, size_t size, Packets& packets) override{
+        return _->bits_codec->Encode(GetParams(extend), buf, size, packets);
+    }
+
+    size_t Decode(const Extend3D &extend, const Packets &packets, void* buf, size_t size) override{
+        return _->bits_codec->Decode(GetParams(extend), packets, buf, size);
+    }
+
+public:
+    size_t Encode(const std::vector<SliceDataView<T>> &slices, void* buf, size_t size)  override{
+        Packets packets;
+        Encode(slices, packets);
+        return CopyPacketRecords(packets, buf, size);
+    }
+
+    size_t Encode(const GridDataView<T>& volume,SliceAxis axis, void* buf, size_t size) override{
+        Packets packets;
+        Encode(volume, axis, packets);
+        return CopyPacketRecords(packets, buf, size);
+    }
+
+    size_t Encode(const std::vector<SliceDataView<T>> &slices, Packets &packets)        override{
+        if(slices.empty()) return 0;
+        const uint32_t width = slices.front().Width();
+        const uint32_t height = slices.front().Height();
+        GridData<T> grid(width, height, (uint32_t)slices.size());
+        for(uint32_t z = 0; z < grid.Depth(); z++){
+            for(uint32_t y = 0; y < height; y++){
+                for(uint32_t x = 0; x < width; x++){
+                    grid(x, y, z) = slices[z](x, y);
+                }
+            }
+        }
+        return Encode({width, height, grid.Depth()}, grid.GetRawPtr(), grid.Size() * sizeof(T), packets);
+    }
+
+    /**
+     * @param axis slices are taken perpendicular to axis, so axis becomes the encoded depth.
+     */
+    size_t Encode(const GridDataView<T>& volume,SliceAxis axis, Packets &packets)       override{
+        const Extend3D src_extend = {volume.Width(), volume.Height(), volume.Depth()};
+        const Extend3D extend = GetPermutedExtend(src_extend, axis);
+        GridData<T> grid(extend.width, extend.height, extend.depth);
+        Permute3D(&volume(0, 0, 0), src_extend, sizeof(T), axis, grid.GetRawPtr(), _->thread_count);
+        return Encode(extend, grid.GetRawPtr(), grid.Size() * sizeof(T), packets);
+    }
+
+private:
+    BitsCodec::BitsCodecParams GetParams(const Extend3D& extend) const{
+        return {
+            .width = (int)extend.width,
+            .height = (int)extend.height,
+            .depth = (int)extend.depth,
+            .samplers_per_pixel = GetVoxelSampleCount(T::format),
+            .bits_per_sampler = GetVoxelBits(T::type),
+            .threads_count = _->thread_count
+        };
+    }
+
+protected:
+    std::unique_ptr<CPUVolumeBitsCodecPrivate> _;
+};
+
+template<typename T>
+using CPUVolumeBitsCodec = VolumeBitsCodec<T, CodecDevice::CPU, std::enable_if_t<VoxelBitsCodecV<T,CodecDevice::CPU>>>;
+
 
 VOL_END
\ No newline at end of file
@@ -6,6 +6,215 @@ class GridDataView;
 template<typename, bool>
 class SliceDataView;
 
+#if defined(VOL_SIMD_SSE2)
+inline void TransposeBlock8x8(const uint8_t* src, size_t srcPitch, uint8_t* dst, size_t dstPitch){
+    __m128i a0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+    __m128i a1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch));
+    __m128i a2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch * 2));
+    __m128i a3 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch * 3));
+    __m128i a4 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch * 4));
+    __m128i a5 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch * 5));
+    __m128i a6 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch * 6));
+    __m128i a7 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + srcPitch * 7));
+    // rows pair to 16-bit, 32-bit then 64-bit lanes, each 64-bit lane ends up to be one column
+    __m128i t0 = _mm_unpacklo_epi8(a0, a1);
+    __m128i t1 = _mm_unpacklo_epi8(a2, a3);
+    __m128i t2 = _mm_unpacklo_epi8(a4, a5);
+    __m128i t3 = _mm_unpacklo_epi8(a6, a7);
+    __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+    __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+    __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+    __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+    __m128i v0 = _mm_unpacklo_epi32(u0, u2);
+    __m128i v1 = _mm_unpackhi_epi32(u0, u2);
+    __m128i v2 = _mm_unpacklo_epi32(u1, u3);
+    __m128i v3 = _mm_unpackhi_epi32(u1, u3);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst),                _mm_unpacklo_epi64(v0, v0));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch),     _mm_unpackhi_epi64(v0, v0));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch * 2), _mm_unpacklo_epi64(v1, v1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch * 3), _mm_unpackhi_epi64(v1, v1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch * 4), _mm_unpacklo_epi64(v2, v2));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch * 5), _mm_unpackhi_epi64(v2, v2));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch * 6), _mm_unpacklo_epi64(v3, v3));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dstPitch * 7), _mm_unpackhi_epi64(v3, v3));
+}
+
+inline void TransposeBlock8x8(const uint16_t* src, size_t srcPitch, uint16_t* dst, size_t dstPitch){
+    __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch));
+    __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch * 2));
+    __m128i a3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch * 3));
+    __m128i a4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch * 4));
+    __m128i a5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch * 5));
+    __m128i a6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch * 6));
+    __m128i a7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + srcPitch * 7));
+    __m128i t0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i t1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i t2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i t3 = _mm_unpackhi_epi16(a2, a3);
+    __m128i t4 = _mm_unpacklo_epi16(a4, a5);
+    __m128i t5 = _mm_unpackhi_epi16(a4, a5);
+    __m128i t6 = _mm_unpacklo_epi16(a6, a7);
+    __m128i t7 = _mm_unpackhi_epi16(a6, a7);
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),                _mm_unpacklo_epi64(u0, u4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch),     _mm_unpackhi_epi64(u0, u4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch * 2), _mm_unpacklo_epi64(u1, u5));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch * 3), _mm_unpackhi_epi64(u1, u5));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch * 4), _mm_unpacklo_epi64(u2, u6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch * 5), _mm_unpackhi_epi64(u2, u6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch * 6), _mm_unpacklo_epi64(u3, u7));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstPitch * 7), _mm_unpackhi_epi64(u3, u7));
+}
+#endif
+
+/**
+ * @brief Transpose a rows x cols matrix into a cols x rows matrix, pitches are counted in elements.
+ * The plane is walked by cache sized tiles, 8-bit and 16-bit elements use 8x8 SIMD shuffles inside a tile.
+ */
+template<typename T>
+inline void TransposePlane(const T* src, size_t srcPitch, T* dst, size_t dstPitch, uint32_t rows, uint32_t cols){
+    constexpr uint32_t tile = sizeof(T) <= 2 ? 64 : (sizeof(T) <= 4 ? 32 : 16);
+    for(uint32_t tr = 0; tr < rows; tr += tile){
+        const uint32_t tr_end = std::min(rows, tr + tile);
+        for(uint32_t tc = 0; tc < cols; tc += tile){
+            const uint32_t tc_end = std::min(cols, tc + tile);
+            uint32_t r = tr;
+#if defined(VOL_SIMD_SSE2)
+            if constexpr(sizeof(T) == 1 || sizeof(T) == 2){
+                using U = std::conditional_t<sizeof(T) == 1, uint8_t, uint16_t>;
+                for(; r + 8 <= tr_end; r += 8){
+                    uint32_t c = tc;
+                    for(; c + 8 <= tc_end; c += 8){
+                        TransposeBlock8x8(reinterpret_cast<const U*>(src + r * srcPitch + c), srcPitch,
+                                          reinterpret_cast<U*>(dst + c * dstPitch + r), dstPitch);
+                    }
+                    for(; c < tc_end; c++){
+                        for(uint32_t k = r; k < r + 8; k++)
+                            dst[c * dstPitch + k] = src[k * srcPitch + c];
+                    }
+                }
+            }
+#endif
+            for(; r < tr_end; r++){
+                for(uint32_t c = tc; c < tc_end; c++)
+                    dst[c * dstPitch + r] = src[r * srcPitch + c];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Same as TransposePlane but for elements only known by byte size at runtime.
+ */
+inline void TransposePlaneBytes(const void* src, size_t srcPitch, void* dst, size_t dstPitch,
+                                uint32_t rows, uint32_t cols, size_t elementSize){
+    auto transpose = [&]<size_t N>(){
+        struct Element{ uint8_t bytes[N]; };
+        TransposePlane(reinterpret_cast<const Element*>(src), srcPitch,
+                       reinterpret_cast<Element*>(dst), dstPitch, rows, cols);
+    };
+    switch (elementSize) {
+        case 1: return TransposePlane(reinterpret_cast<const uint8_t*>(src), srcPitch, reinterpret_cast<uint8_t*>(dst), dstPitch, rows, cols);
+        case 2: return TransposePlane(reinterpret_cast<const uint16_t*>(src), srcPitch, reinterpret_cast<uint16_t*>(dst), dstPitch, rows, cols);
+        case 3: return transpose.template operator()<3>();
+        case 4: return TransposePlane(reinterpret_cast<const uint32_t*>(src), srcPitch, reinterpret_cast<uint32_t*>(dst), dstPitch, rows, cols);
+        case 6: return transpose.template operator()<6>();
+        case 8: return TransposePlane(reinterpret_cast<const uint64_t*>(src), srcPitch, reinterpret_cast<uint64_t*>(dst), dstPitch, rows, cols);
+        case 12: return transpose.template operator()<12>();
+        case 16: return transpose.template operator()<16>();
+        default: assert(false);
+    }
+}
+
+/**
+ * @brief Call func(thread_index, i) for each i in [beg, end) by parallel_forrange, keeps the thread helpers out of public headers.
+ * @param workerCount 0 for hardware concurrency.
+ */
+void ParallelForRange(int beg, int end, const std::function<void(int, int)>& func, int workerCount = 0);
+
+/**
+ * @brief Call func(x, y, z, row, count) for each x row of [src, dst) clipped to a dense width x height x depth grid,
+ * row points to the voxel at (x, y, z). With parallel the z range is split into one slab per hardware thread.
+ */
+template<typename T, typename F>
+inline void ForEachGridRow(T* base, int width, int height, int depth,
+                           int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, F&& func, bool parallel){
+    const int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, depth);
+    const int beg_y = std::max<int>(srcY, 0), end_y = std::min<int>(dstY, height);
+    const int beg_x = std::max<int>(srcX, 0), end_x = std::min<int>(dstX, width);
+    if(beg_x >= end_x || beg_y >= end_y || beg_z >= end_z) return;
+    const int count = end_x - beg_x;
+    auto run = [&](int z0, int z1){
+        for(int z = z0; z < z1; z++){
+            T* slice = base + (size_t)z * width * height;
+            for(int y = beg_y; y < end_y; y++){
+                func(beg_x, y, z, slice + (size_t)y * width + beg_x, count);
+            }
+        }
+    };
+    const int slabs = parallel ? std::min<int>(end_z - beg_z, std::max(1u, std::thread::hardware_concurrency())) : 1;
+    if(slabs <= 1){
+        run(beg_z, end_z);
+        return;
+    }
+    ParallelForRange(0, slabs, [&](int, int i){
+        run(beg_z + (int)((int64_t)(end_z - beg_z) * i / slabs), beg_z + (int)((int64_t)(end_z - beg_z) * (i + 1) / slabs));
+    }, slabs);
+}
+
+/**
+ * @brief Call func(x, y, z, row, count) for each brick row inside [src, dst) clipped to a bricked width x height x depth grid.
+ * Bricks hold (block_length + 2 * padding)^3 voxels, get_block(bx, by, bz) returns the brick storage and is called once per brick.
+ * @param with_padding also visit the padding copies held by neighbor bricks, used by writes.
+ */
+template<typename GetBlock, typename F>
+inline void ForEachBlockRow(int width, int height, int depth, int block_length, int padding, bool with_padding,
+                            int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, GetBlock&& get_block, F&& func){
+    const int beg_x = std::max<int>(srcX, 0), end_x = std::min<int>(dstX, width);
+    const int beg_y = std::max<int>(srcY, 0), end_y = std::min<int>(dstY, height);
+    const int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, depth);
+    if(beg_x >= end_x || beg_y >= end_y || beg_z >= end_z) return;
+    const int pad = with_padding ? padding : 0;
+    const int block_size = block_length + 2 * padding;
+    auto floor_div = [](int a, int b){ return a >= 0 ? a / b : -((-a + b - 1) / b); };
+    // voxel v is held by bricks [floor((v - pad) / L), floor((v + pad) / L)]
+    auto block_range = [&](int beg, int end, int len){
+        const int dim = (len + block_length - 1) / block_length;
+        return std::make_pair(std::max(0, floor_div(beg - pad, block_length)),
+                              std::min(dim, floor_div(end - 1 + pad, block_length) + 1));
+    };
+    auto [bx_beg, bx_end] = block_range(beg_x, end_x, width);
+    auto [by_beg, by_end] = block_range(beg_y, end_y, height);
+    auto [bz_beg, bz_end] = block_range(beg_z, end_z, depth);
+    for(int bz = bz_beg; bz < bz_end; bz++){
+        const int oz = bz * block_length - padding;
+        const int z0 = std::max(beg_z, bz * block_length - pad), z1 = std::min(end_z, (bz + 1) * block_length + pad);
+        for(int by = by_beg; by < by_end; by++){
+            const int oy = by * block_length - padding;
+            const int y0 = std::max(beg_y, by * block_length - pad), y1 = std::min(end_y, (by + 1) * block_length + pad);
+            for(int bx = bx_beg; bx < bx_end; bx++){
+                const int ox = bx * block_length - padding;
+                const int x0 = std::max(beg_x, bx * block_length - pad), x1 = std::min(end_x, (bx + 1) * block_length + pad);
+                auto brick = get_block(bx, by, bz);
+                for(int z = z0; z < z1; z++){
+                    for(int y = y0; y < y1; y++){
+                        auto row = brick + ((size_t)(z - oz) * block_size + (y - oy)) * block_size + (x0 - ox);
+                        func(x0, y, z, row, x1 - x0);
+                    }
+                }
+            }
+        }
+    }
+}
+
 template<typename T>
 class SliceData{
 public:
@@ -234,11 +443,8 @@ public:
 
     SliceData<T> GetSliceDataY(uint32_t y) const{
         SliceData<T> slice(sizeZ, sizeX);
-        for(uint32_t z = 0; z < sizeZ; z++){
-            for(uint32_t x = 0; x < sizeX; x++){
-                slice(z, x) = this->operator()(x, y, z);
-            }
-        }
+        // rows of the y plane are strided by a whole slice, transpose them by tiles
+        TransposePlane(data + (size_t)y * sizeX, (size_t)sizeX * sizeY, slice.GetRawPtr(), sizeZ, sizeZ, sizeX);
         return slice;
     }
 
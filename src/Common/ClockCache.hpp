@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Byte budgeted cache shared by many threads.
+ * Keys are spread over shards which each own a mutex, a fixed slot array allocated up front and a CLOCK hand,
+ * so a hit only takes one shard lock and never allocates.
+ * Entries referenced by a live handle_t are pinned and never evicted.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class clock_cache_t
+{
+    struct slot_t
+    {
+        Key key{};
+        Value value{};
+        size_t bytes = 0;
+        uint32_t pins = 0;
+        bool used = false;
+        bool referenced = false;
+    };
+
+    struct shard_t
+    {
+        std::mutex mtx;
+        std::unique_ptr<slot_t[]> slots;
+        uint32_t slot_count = 0;
+        uint32_t hand = 0;
+        std::vector<uint32_t> free_slots;
+        std::unordered_map<Key, uint32_t, Hash> pos;
+        size_t byte_budget = 0;
+        size_t bytes = 0;
+    };
+
+  public:
+    struct stats_t
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t bytes = 0;
+        size_t count = 0;
+    };
+
+    using evict_func_t = std::function<void(const Key &, Value &)>;
+
+    /**
+     * Keeps the entry pinned until destroyed or released.
+     */
+    class handle_t
+    {
+      public:
+        handle_t() = default;
+
+        handle_t(const handle_t &) = delete;
+        handle_t &operator=(const handle_t &) = delete;
+
+        handle_t(handle_t &&other) noexcept
+            : shard(std::exchange(other.shard, nullptr)), slot(other.slot)
+        {
+        }
+
+        handle_t &operator=(handle_t &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                shard = std::exchange(other.shard, nullptr);
+                slot = other.slot;
+            }
+            return *this;
+        }
+
+        ~handle_t()
+        {
+            release();
+        }
+
+        explicit operator bool() const
+        {
+            return shard != nullptr;
+        }
+
+        Value *get() const
+        {
+            return shard ? &shard->slots[slot].value : nullptr;
+        }
+
+        Value &operator*() const
+        {
+            return shard->slots[slot].value;
+        }
+
+        Value *operator->() const
+        {
+            return get();
+        }
+
+        void release()
+        {
+            if (!shard)
+                return;
+            std::lock_guard<std::mutex> lk(shard->mtx);
+            --shard->slots[slot].pins;
+            shard = nullptr;
+        }
+
+      private:
+        friend class clock_cache_t;
+        handle_t(shard_t *shard, uint32_t slot) : shard(shard), slot(slot)
+        {
+        }
+
+        shard_t *shard = nullptr;
+        uint32_t slot = 0;
+    };
+
+    /**
+     * @param byte_budget total bytes of all values, split evenly between shards.
+     * @param slot_count max entry count, slots are allocated here and reused.
+     * @param shard_count 0 to pick by slot_count and hardware concurrency.
+     */
+    clock_cache_t(size_t byte_budget, size_t slot_count, size_t shard_count = 0)
+    {
+        if (slot_count == 0)
+            slot_count = 1;
+        if (shard_count == 0)
+        {
+            size_t hc = std::max<size_t>(1, std::thread::hardware_concurrency());
+            // keep a few slots in each shard or CLOCK degenerates to FIFO
+            shard_count = std::clamp<size_t>(slot_count / 4, 1, hc);
+        }
+        shard_count = std::min(shard_count, slot_count);
+        shards = std::vector<shard_t>(shard_count);
+        for (size_t i = 0; i < shard_count; i++)
+        {
+            auto &shard = shards[i];
+            shard.slot_count = static_cast<uint32_t>(slot_count / shard_count + (i < slot_count % shard_count ? 1 : 0));
+            shard.slots = std::make_unique<slot_t[]>(shard.slot_count);
+            shard.free_slots.reserve(shard.slot_count);
+            for (uint32_t s = shard.slot_count; s > 0; s--)
+                shard.free_slots.push_back(s - 1);
+            shard.pos.reserve(shard.slot_count);
+            shard.byte_budget = byte_budget / shard_count;
+        }
+    }
+
+    clock_cache_t(const clock_cache_t &) = delete;
+    clock_cache_t &operator=(const clock_cache_t &) = delete;
+
+    /**
+     * Called under the shard lock before an entry is dropped, the value may be moved out to recycle its storage.
+     */
+    void set_evict_callback(evict_func_t func)
+    {
+        evict_callback = std::move(func);
+    }
+
+    /**
+     * @return pinned handle or an empty handle if miss.
+     */
+    handle_t get(const Key &key)
+    {
+        auto &shard = get_shard(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it = shard.pos.find(key);
+        if (it == shard.pos.end())
+        {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return handle_t{};
+        }
+        auto &slot = shard.slots[it->second];
+        slot.referenced = true;
+        ++slot.pins;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return handle_t(&shard, it->second);
+    }
+
+    bool exist_key(const Key &key)
+    {
+        auto &shard = get_shard(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        return shard.pos.count(key) != 0;
+    }
+
+    /**
+     * Insert value and return it pinned. If key already exists the cached value is kept and returned.
+     * Value is only moved from on success, an empty handle is returned if all evictable entries can not make room.
+     */
+    handle_t insert(const Key &key, Value &&value, size_t bytes)
+    {
+        auto &shard = get_shard(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it = shard.pos.find(key);
+        if (it != shard.pos.end())
+        {
+            auto &slot = shard.slots[it->second];
+            slot.referenced = true;
+            ++slot.pins;
+            return handle_t(&shard, it->second);
+        }
+        if (bytes > shard.byte_budget)
+            return handle_t{};
+        // at most two rounds : first clears reference bits, second evicts
+        for (uint32_t step = 0; step < shard.slot_count * 2 + 1; step++)
+        {
+            if (!shard.free_slots.empty() && shard.bytes + bytes <= shard.byte_budget)
+                break;
+            auto idx = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slot_count;
+            auto &slot = shard.slots[idx];
+            if (!slot.used || slot.pins)
+                continue;
+            if (slot.referenced)
+            {
+                slot.referenced = false;
+                continue;
+            }
+            evict(shard, idx);
+        }
+        if (shard.free_slots.empty() || shard.bytes + bytes > shard.byte_budget)
+            return handle_t{};
+
+        auto idx = shard.free_slots.back();
+        shard.free_slots.pop_back();
+        auto &slot = shard.slots[idx];
+        slot.key = key;
+        slot.value = std::move(value);
+        slot.bytes = bytes;
+        slot.pins = 1;
+        slot.used = true;
+        slot.referenced = true;
+        shard.bytes += bytes;
+        shard.pos.emplace(key, idx);
+        return handle_t(&shard, idx);
+    }
+
+    /**
+     * @return false if not exist or pinned.
+     */
+    bool erase(const Key &key)
+    {
+        auto &shard = get_shard(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it = shard.pos.find(key);
+        if (it == shard.pos.end() || shard.slots[it->second].pins)
+            return false;
+        drop(shard, it->second);
+        return true;
+    }
+
+    /**
+     * Drop all entries not pinned, evict callback is not invoked.
+     */
+    void clear()
+    {
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lk(shard.mtx);
+            for (uint32_t i = 0; i < shard.slot_count; i++)
+            {
+                if (shard.slots[i].used && !shard.slots[i].pins)
+                    drop(shard, i);
+            }
+        }
+    }
+
+    /**
+     * Invoke func(key, value) or func(key, value, pinned) for every entry under its shard lock,
+     * used to flush dirty values before destruction. pinned tells if a live handle may still write the value.
+     */
+    template <typename F>
+    void for_each(F &&func)
+    {
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lk(shard.mtx);
+            for (uint32_t i = 0; i < shard.slot_count; i++)
+            {
+                auto &slot = shard.slots[i];
+                if (!slot.used)
+                    continue;
+                if constexpr (std::is_invocable_v<F &, const Key &, Value &, bool>)
+                    func(slot.key, slot.value, slot.pins != 0);
+                else
+                    func(slot.key, slot.value);
+            }
+        }
+    }
+
+    /**
+     * Invoke func(value, pinned) on the entry of key under its shard lock, the entry is not referenced by this.
+     * @return false if not exist.
+     */
+    template <typename F>
+    bool visit(const Key &key, F &&func)
+    {
+        auto &shard = get_shard(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it = shard.pos.find(key);
+        if (it == shard.pos.end())
+            return false;
+        auto &slot = shard.slots[it->second];
+        func(slot.value, slot.pins != 0);
+        return true;
+    }
+
+    stats_t get_stats()
+    {
+        stats_t stats;
+        stats.hits = hits.load(std::memory_order_relaxed);
+        stats.misses = misses.load(std::memory_order_relaxed);
+        stats.evictions = evictions.load(std::memory_order_relaxed);
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lk(shard.mtx);
+            stats.bytes += shard.bytes;
+            stats.count += shard.pos.size();
+        }
+        return stats;
+    }
+
+  private:
+    shard_t &get_shard(const Key &key)
+    {
+        // spread a bit more for identity hashes of sequential indices
+        size_t h = hasher(key);
+        h ^= h >> 16;
+        return shards[h % shards.size()];
+    }
+
+    void evict(shard_t &shard, uint32_t idx)
+    {
+        auto &slot = shard.slots[idx];
+        if (evict_callback)
+            evict_callback(slot.key, slot.value);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        drop(shard, idx);
+    }
+
+    void drop(shard_t &shard, uint32_t idx)
+    {
+        auto &slot = shard.slots[idx];
+        shard.pos.erase(slot.key);
+        shard.bytes -= slot.bytes;
+        slot.value = Value{};
+        slot.bytes = 0;
+        slot.used = false;
+        slot.referenced = false;
+        shard.free_slots.push_back(idx);
+    }
+
+  private:
+    std::vector<shard_t> shards;
+    Hash hasher;
+    evict_func_t evict_callback;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> evictions{0};
+};
@@ -23,6 +23,7 @@ inline GridVolumeCodec StrToGridVolumeDataCodec(std::string_view str) noexcept {
     auto s = ConvertStrToLower(str);
     if(s == "video") return GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO;
     if(s == "bits")  return GridVolumeCodec::GRID_VOLUME_CODEC_BITS;
+    if(s == "video_hilo") return GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO;
     return GridVolumeCodec::GRID_VOLUME_CODEC_NONE;
 }
 
@@ -57,6 +58,7 @@ inline constexpr const char* VoxelFormatToStr(VoxelFormat format) noexcept {
 inline constexpr const char* VolumeCodecToStr(GridVolumeCodec codec) noexcept {
     switch (codec) {
         case GridVolumeCodec::GRID_VOLUME_CODEC_BITS :  return "bits";
+        case GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO : return "video_hilo";
         case GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO : return "video";
         default : return "none";
     }
@@ -116,21 +118,67 @@ inline void PrintVolumeDesc(const EncodedBlockedGridVolumeDesc& desc, bool print
     }
     PrintVolumeDesc(static_cast<const BlockedGridVolumeDesc&>(desc), false);
     std::cerr << "\tcodec : " << VolumeCodecToStr(desc.codec) << std::endl;
+    if(desc.voxel_info.type == VoxelType::float32)
+        std::cerr << "\tquantized type : " << VoxelTypeToStr(desc.quantized_type) << std::endl;
+    if(desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO || desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO){
+        auto& settings = desc.encode_settings;
+        std::cerr << "\tencode preset : " << settings.preset << std::endl;
+        std::cerr << "\tencode tune : " << settings.tune << std::endl;
+        std::cerr << "\tencode crf : " << settings.crf << std::endl;
+        std::cerr << "\tencode qp : " << settings.qp << std::endl;
+        std::cerr << "\tencode gop_size : " << settings.gop_size << std::endl;
+        std::cerr << "\tencode keyframe_interval : " << settings.keyframe_interval << std::endl;
+        std::cerr << "\tencode threads : " << settings.threads << std::endl;
+    }
 }
 
-inline auto CreateCPUVolumeVideoCodecByVoxel(const VoxelInfo& voxel_info)->std::unique_ptr<CVolumeCodecInterface>{
-    auto [type, format] = voxel_info;
-    if(type == VoxelType::uint8){
-        if(format == VoxelFormat::R){
-            return std::make_unique<VolumeVideoCodec<VoxelRU8,CodecDevice::CPU>>(std::thread::hardware_concurrency());
-        }
-    }
-    else if(type == VoxelType::uint16){
-        if(format == VoxelFormat::R){
-            return std::make_unique<VolumeVideoCodec<VoxelRU16,CodecDevice::CPU>>(std::thread::hardware_concurrency());
-        }
-    }
-    return nullptr;
+/**
+ * @param thread_count codec internal threads, 0 for hardware concurrency.
+ * @param settings only affect encode.
+ */
+inline auto CreateCPUVolumeVideoCodecByVoxel(const VoxelInfo& voxel_info, int thread_count = 0,
+                                             const VideoEncodeSettings& settings = {})->std::unique_ptr<CVolumeCodecInterface>{
+    return VolumeCodecRegistry::GetInstance().Create({
+        .codec = GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO,
+        .voxel_info = voxel_info,
+        .device = CodecDevice::CPU,
+        .thread_count = thread_count,
+        .encode_settings = settings
+    });
+}
+
+/**
+ * @brief Voxel actually passed to the codec, float32 volume is encoded as its quantized type.
+ */
+inline VoxelInfo GetCodecVoxelInfo(const EncodedBlockedGridVolumeDesc& desc) noexcept {
+    if(desc.voxel_info.type == VoxelType::float32)
+        return {desc.quantized_type, desc.voxel_info.format};
+    return desc.voxel_info;
+}
+
+/**
+ * @brief Largest quantized value of a float32 volume that the codec keeps, cpu video codec stores 16 bit samples as 12 bit.
+ */
+inline uint32_t GetQuantizedMaxValue(const EncodedBlockedGridVolumeDesc& desc) noexcept {
+    if(desc.quantized_type == VoxelType::uint8)
+        return 0xff;
+    if(desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO)
+        return 0xfff;
+    return 0xffff;
+}
+
+/**
+ * @brief Create cpu codec by the codec id in desc, desc without codec id is treated as video encoded.
+ */
+inline auto CreateCPUVolumeCodecByDesc(const EncodedBlockedGridVolumeDesc& desc, int thread_count = 0)->std::unique_ptr<CVolumeCodecInterface>{
+    auto codec = desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_NONE ? GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO : desc.codec;
+    return VolumeCodecRegistry::GetInstance().Create({
+        .codec = codec,
+        .voxel_info = GetCodecVoxelInfo(desc),
+        .device = CodecDevice::CPU,
+        .thread_count = thread_count,
+        .encode_settings = desc.encode_settings
+    });
 }
 namespace detail{
     inline const char* raw          = "raw";
@@ -150,7 +198,43 @@ namespace detail{
     inline const char* prefix       = "prefix";
     inline const char* postfix      = "postfix";
     inline const char* setw         = "setw";
+    inline const char* encode_preset   = "encode_preset";
+    inline const char* encode_tune     = "encode_tune";
+    inline const char* encode_crf      = "encode_crf";
+    inline const char* encode_qp       = "encode_qp";
+    inline const char* encode_gop_size = "encode_gop_size";
+    inline const char* encode_keyframe_interval = "encode_keyframe_interval";
+    inline const char* encode_threads  = "encode_threads";
+    inline const char* quantized_type  = "quantized_type";
 }
+
+/**
+ * @brief Missing keys keep the default settings.
+ */
+template<typename Json>
+void ReadEncodeSettingsFromJson(VideoEncodeSettings& settings, Json& j){
+    using namespace detail;
+    if(j.count(encode_preset) != 0) settings.preset = std::string(j.at(encode_preset));
+    if(j.count(encode_tune) != 0) settings.tune = std::string(j.at(encode_tune));
+    if(j.count(encode_crf) != 0) settings.crf = (int)j.at(encode_crf);
+    if(j.count(encode_qp) != 0) settings.qp = (int)j.at(encode_qp);
+    if(j.count(encode_gop_size) != 0) settings.gop_size = (int)j.at(encode_gop_size);
+    if(j.count(encode_keyframe_interval) != 0) settings.keyframe_interval = (int)j.at(encode_keyframe_interval);
+    if(j.count(encode_threads) != 0) settings.threads = (int)j.at(encode_threads);
+}
+
+template<typename Json>
+void WriteEncodeSettingsToJson(const VideoEncodeSettings& settings, Json& j){
+    using namespace detail;
+    j[encode_preset] = settings.preset;
+    j[encode_tune] = settings.tune;
+    j[encode_crf] = settings.crf;
+    j[encode_qp] = settings.qp;
+    j[encode_gop_size] = settings.gop_size;
+    j[encode_keyframe_interval] = settings.keyframe_interval;
+    j[encode_threads] = settings.threads;
+}
+
 template<typename Json>
 void ReadDescFromJson(EncodedBlockedGridVolumeDesc& desc, Json& encoded_block){
     using namespace detail;
@@ -170,6 +254,9 @@ void ReadDescFromJson(EncodedBlockedGridVolumeDesc& desc, Json& encoded_block){
     desc.codec = StrToGridVolumeDataCodec(encoded_block.count(volume_codec) == 0 ? "none" : encoded_block.at(volume_codec));
 
     desc.data_path = encoded_block.count(data_path) == 0 ? "none" : std::string(encoded_block.at(data_path));
+    ReadEncodeSettingsFromJson(desc.encode_settings, encoded_block);
+    if(encoded_block.count(quantized_type) != 0)
+        desc.quantized_type = StrToVoxelType(std::string(encoded_block.at(quantized_type)));
 
 }
 
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <VolumeUtils/Volume.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Linear quantization between float and unsigned integer : v = q * scale + offset.
+ */
+
+/**
+ * @return {min, max} of finite values, {0, 0} if none.
+ */
+inline std::pair<float, float> find_finite_min_max(const float* src, size_t count)
+{
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    size_t i = 0;
+#if defined(VOL_SIMD_AVX2)
+    {
+        const __m256 lowest = _mm256_set1_ps(hi);
+        const __m256 highest = _mm256_set1_ps(lo);
+        __m256 vlo = highest, vhi = lowest;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 v = _mm256_loadu_ps(src + i);
+            // ordered compares are false for NaN, inf is out of range
+            const __m256 finite = _mm256_and_ps(_mm256_cmp_ps(v, lowest, _CMP_GE_OQ), _mm256_cmp_ps(v, highest, _CMP_LE_OQ));
+            vlo = _mm256_min_ps(vlo, _mm256_blendv_ps(highest, v, finite));
+            vhi = _mm256_max_ps(vhi, _mm256_blendv_ps(lowest, v, finite));
+        }
+        alignas(32) float l[8], h[8];
+        _mm256_store_ps(l, vlo);
+        _mm256_store_ps(h, vhi);
+        for (int k = 0; k < 8; k++)
+        {
+            lo = l[k] < lo ? l[k] : lo;
+            hi = h[k] > hi ? h[k] : hi;
+        }
+    }
+#elif defined(VOL_SIMD_SSE2)
+    {
+        const __m128 lowest = _mm_set1_ps(hi);
+        const __m128 highest = _mm_set1_ps(lo);
+        __m128 vlo = highest, vhi = lowest;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 v = _mm_loadu_ps(src + i);
+            const __m128 finite = _mm_and_ps(_mm_cmpge_ps(v, lowest), _mm_cmple_ps(v, highest));
+            vlo = _mm_min_ps(vlo, _mm_or_ps(_mm_and_ps(finite, v), _mm_andnot_ps(finite, highest)));
+            vhi = _mm_max_ps(vhi, _mm_or_ps(_mm_and_ps(finite, v), _mm_andnot_ps(finite, lowest)));
+        }
+        alignas(16) float l[4], h[4];
+        _mm_store_ps(l, vlo);
+        _mm_store_ps(h, vhi);
+        for (int k = 0; k < 4; k++)
+        {
+            lo = l[k] < lo ? l[k] : lo;
+            hi = h[k] > hi ? h[k] : hi;
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float v = src[i];
+        // NaN and inf fail both tests
+        if (v >= std::numeric_limits<float>::lowest() && v <= std::numeric_limits<float>::max())
+        {
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+    }
+    if (lo > hi)
+        return {0.f, 0.f};
+    return {lo, hi};
+}
+
+/**
+ * @brief Round to nearest step and clamp to the range of T, NaN goes to 0.
+ */
+template <typename T>
+void quantize_from_float(const float* src, size_t count, T* dst, float scale, float offset)
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    constexpr float max_q = static_cast<float>(std::numeric_limits<T>::max());
+    const float inv_scale = scale != 0.f ? 1.f / scale : 0.f;
+    for (size_t i = 0; i < count; i++)
+    {
+        float q = (src[i] - offset) * inv_scale + 0.5f;
+        q = q > 0.f ? q : 0.f; // also NaN
+        q = q < max_q ? q : max_q;
+        dst[i] = static_cast<T>(q);
+    }
+}
+
+template <typename T>
+void dequantize_to_float(const T* src, size_t count, float* dst, float scale, float offset)
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    size_t i = 0;
+#if defined(VOL_SIMD_AVX2)
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 o = _mm256_set1_ps(offset);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i q;
+        if constexpr (sizeof(T) == 1)
+            q = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        else
+            q = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(q), s), o));
+    }
+#elif defined(VOL_SIMD_SSE2)
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 o = _mm_set1_ps(offset);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i q16;
+        if constexpr (sizeof(T) == 1)
+            q16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), zero);
+        else
+            q16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(q16, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(q16, zero));
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(lo, s), o));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(hi, s), o));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = static_cast<float>(src[i]) * scale + offset;
+}
+
+/**
+ * Channel interleave between packed voxels and planar channels, planar dst/src is [channels][count].
+ */
+
+#if defined(VOL_SIMD_SSE2)
+namespace simd_detail
+{
+// even and odd lanes of two vectors, T is the lane type
+template <typename T>
+inline void deinterleave2(__m128i a, __m128i b, __m128i& even, __m128i& odd)
+{
+    if constexpr (sizeof(T) == 1)
+    {
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        even = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    }
+    else
+    {
+        // bias to signed so the saturated pack of int32 is exact
+        const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+        a = _mm_xor_si128(a, bias);
+        b = _mm_xor_si128(b, bias);
+        even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+        even = _mm_xor_si128(even, bias);
+        odd = _mm_xor_si128(odd, bias);
+    }
+}
+
+template <typename T>
+inline void interleave2(__m128i a, __m128i b, __m128i& lo, __m128i& hi)
+{
+    if constexpr (sizeof(T) == 1)
+    {
+        lo = _mm_unpacklo_epi8(a, b);
+        hi = _mm_unpackhi_epi8(a, b);
+    }
+    else
+    {
+        lo = _mm_unpacklo_epi16(a, b);
+        hi = _mm_unpackhi_epi16(a, b);
+    }
+}
+
+template <typename T>
+inline __m128i load(const T* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+template <typename T>
+inline void store(T* p, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+} // namespace simd_detail
+#endif
+
+template <typename T>
+void deinterleave_channels(const T* src, size_t count, int channels, T* dst)
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    size_t i = 0;
+#if defined(VOL_SIMD_SSE2)
+    using namespace simd_detail;
+    constexpr size_t lanes = 16 / sizeof(T);
+    if (channels == 2)
+    {
+        for (; i + lanes <= count; i += lanes)
+        {
+            __m128i c0, c1;
+            deinterleave2<T>(load(src + i * 2), load(src + i * 2 + lanes), c0, c1);
+            store(dst + i, c0);
+            store(dst + count + i, c1);
+        }
+    }
+    else if (channels == 4)
+    {
+        for (; i + lanes <= count; i += lanes)
+        {
+            const T* s = src + i * 4;
+            __m128i e01, o01, e23, o23, c0, c1, c2, c3;
+            // c0c2 / c1c3 pairs first, then split the pairs
+            deinterleave2<T>(load(s), load(s + lanes), e01, o01);
+            deinterleave2<T>(load(s + lanes * 2), load(s + lanes * 3), e23, o23);
+            deinterleave2<T>(e01, e23, c0, c2);
+            deinterleave2<T>(o01, o23, c1, c3);
+            store(dst + i, c0);
+            store(dst + count + i, c1);
+            store(dst + count * 2 + i, c2);
+            store(dst + count * 3 + i, c3);
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        for (int c = 0; c < channels; c++)
+            dst[c * count + i] = src[i * channels + c];
+    }
+}
+
+template <typename T>
+void interleave_channels(const T* src, size_t count, int channels, T* dst)
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    size_t i = 0;
+#if defined(VOL_SIMD_SSE2)
+    using namespace simd_detail;
+    constexpr size_t lanes = 16 / sizeof(T);
+    if (channels == 2)
+    {
+        for (; i + lanes <= count; i += lanes)
+        {
+            __m128i lo, hi;
+            interleave2<T>(load(src + i), load(src + count + i), lo, hi);
+            store(dst + i * 2, lo);
+            store(dst + i * 2 + lanes, hi);
+        }
+    }
+    else if (channels == 4)
+    {
+        for (; i + lanes <= count; i += lanes)
+        {
+            __m128i c01_lo, c01_hi, c23_lo, c23_hi;
+            interleave2<T>(load(src + i), load(src + count + i), c01_lo, c01_hi);
+            interleave2<T>(load(src + count * 2 + i), load(src + count * 3 + i), c23_lo, c23_hi);
+            // pairs are interleaved as one lane of twice the width
+            __m128i v0, v1, v2, v3;
+            if constexpr (sizeof(T) == 1)
+            {
+                v0 = _mm_unpacklo_epi16(c01_lo, c23_lo);
+                v1 = _mm_unpackhi_epi16(c01_lo, c23_lo);
+                v2 = _mm_unpacklo_epi16(c01_hi, c23_hi);
+                v3 = _mm_unpackhi_epi16(c01_hi, c23_hi);
+            }
+            else
+            {
+                v0 = _mm_unpacklo_epi32(c01_lo, c23_lo);
+                v1 = _mm_unpackhi_epi32(c01_lo, c23_lo);
+                v2 = _mm_unpacklo_epi32(c01_hi, c23_hi);
+                v3 = _mm_unpackhi_epi32(c01_hi, c23_hi);
+            }
+            T* d = dst + i * 4;
+            store(d, v0);
+            store(d + lanes, v1);
+            store(d + lanes * 2, v2);
+            store(d + lanes * 3, v3);
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        for (int c = 0; c < channels; c++)
+            dst[i * channels + c] = src[c * count + i];
+    }
+}
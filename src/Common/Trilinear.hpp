@@ -0,0 +1,299 @@
+#pragma once
+
+#include <VolumeUtils/Volume.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+/**
+ * Trilinear interpolation over uint8 / uint16 grids at voxel space points, voxel (x, y, z) sits at its integer coordinate.
+ * Points are clamped to the volume, the lower corner is clamped to extent - 2 so the upper corner always exists.
+ * Points are packed xyz floats.
+ */
+
+/**
+ * Storage of the voxels to fetch corners from.
+ * Linear layout : voxel (x, y, z) is at data[(z - oz) * pitch_z + (y - oy) * pitch_y + x - ox].
+ * Brick layout if block_slot is set : voxel is at block_slot[brick] * block_voxels + ((lz * block_size + ly) * block_size + lx),
+ * l = x - b * block_length + padding, padding must not be 0 so all corners of a cell lie in the brick of its lower corner.
+ */
+struct trilinear_grid_t
+{
+    const uint8_t* data = nullptr;
+    // readable bytes from data
+    size_t bytes = 0;
+    uint32_t width = 0, height = 0, depth = 0;
+
+    int32_t ox = 0, oy = 0, oz = 0;
+    uint32_t pitch_y = 0, pitch_z = 0;
+
+    const uint32_t* block_slot = nullptr;
+    uint32_t block_length = 0, padding = 0, block_size = 0;
+    uint32_t block_dim_x = 0, block_dim_y = 0;
+    uint32_t block_voxels = 0;
+};
+
+/**
+ * @brief Lower corner and fraction along one axis, NaN goes to 0.
+ */
+inline void trilinear_axis(float v, uint32_t extent, int& i0, float& f)
+{
+    const float hi = static_cast<float>(extent - 1);
+    const float hi0 = static_cast<float>(extent > 1 ? extent - 2 : 0);
+    v = v > 0.f ? v : 0.f;
+    v = v < hi ? v : hi;
+    float fl = std::floor(v);
+    fl = fl < hi0 ? fl : hi0;
+    f = v - fl;
+    i0 = static_cast<int>(fl);
+}
+
+inline size_t trilinear_offset(const trilinear_grid_t& g, int x, int y, int z)
+{
+    if (!g.block_slot)
+        return (size_t)(z - g.oz) * g.pitch_z + (size_t)(y - g.oy) * g.pitch_y + (x - g.ox);
+    const uint32_t bx = x / g.block_length, by = y / g.block_length, bz = z / g.block_length;
+    const size_t lx = x - bx * g.block_length + g.padding;
+    const size_t ly = y - by * g.block_length + g.padding;
+    const size_t lz = z - bz * g.block_length + g.padding;
+    const size_t brick = ((size_t)bz * g.block_dim_y + by) * g.block_dim_x + bx;
+    return (size_t)g.block_slot[brick] * g.block_voxels + (lz * g.block_size + ly) * g.block_size + lx;
+}
+
+/**
+ * @brief Scalar sample through fetch(x, y, z), for layouts the grid can not describe.
+ */
+template <typename F>
+float trilinear_sample_with(uint32_t width, uint32_t height, uint32_t depth, float x, float y, float z, F&& fetch)
+{
+    int x0, y0, z0;
+    float fx, fy, fz;
+    trilinear_axis(x, width, x0, fx);
+    trilinear_axis(y, height, y0, fy);
+    trilinear_axis(z, depth, z0, fz);
+    const int x1 = x0 + (width > 1), y1 = y0 + (height > 1), z1 = z0 + (depth > 1);
+    auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
+    const float c00 = lerp(fetch(x0, y0, z0), fetch(x1, y0, z0), fx);
+    const float c10 = lerp(fetch(x0, y1, z0), fetch(x1, y1, z0), fx);
+    const float c01 = lerp(fetch(x0, y0, z1), fetch(x1, y0, z1), fx);
+    const float c11 = lerp(fetch(x0, y1, z1), fetch(x1, y1, z1), fx);
+    return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+}
+
+/**
+ * @brief Central difference of the trilinear field one voxel apart, one sided at the border.
+ */
+template <typename S>
+void trilinear_gradient_with(uint32_t width, uint32_t height, uint32_t depth, float x, float y, float z, float* grad,
+                             S&& sample)
+{
+    auto clamp = [](float v, uint32_t extent) {
+        const float hi = static_cast<float>(extent - 1);
+        v = v > 0.f ? v : 0.f;
+        return v < hi ? v : hi;
+    };
+    auto diff = [&](float lo, float hi, float vlo, float vhi) {
+        const float den = hi - lo;
+        return den > 0.f ? (vhi - vlo) / den : 0.f;
+    };
+    const float xl = clamp(x - 1.f, width), xh = clamp(x + 1.f, width);
+    const float yl = clamp(y - 1.f, height), yh = clamp(y + 1.f, height);
+    const float zl = clamp(z - 1.f, depth), zh = clamp(z + 1.f, depth);
+    grad[0] = diff(xl, xh, sample(xl, y, z), sample(xh, y, z));
+    grad[1] = diff(yl, yh, sample(x, yl, z), sample(x, yh, z));
+    grad[2] = diff(zl, zh, sample(x, y, zl), sample(x, y, zh));
+}
+
+template <typename T>
+float trilinear_sample_scalar(const trilinear_grid_t& g, float x, float y, float z)
+{
+    auto data = reinterpret_cast<const T*>(g.data);
+    return trilinear_sample_with(g.width, g.height, g.depth, x, y, z, [&](int vx, int vy, int vz) {
+        return static_cast<float>(data[trilinear_offset(g, vx, vy, vz)]);
+    });
+}
+
+#if defined(VOL_SIMD_AVX2)
+namespace trilinear_detail
+{
+inline void axis8(__m256 v, uint32_t extent, __m256& fl, __m256& f)
+{
+    // max/min return the second operand for NaN, same as the scalar path
+    v = _mm256_max_ps(v, _mm256_setzero_ps());
+    v = _mm256_min_ps(v, _mm256_set1_ps(static_cast<float>(extent - 1)));
+    fl = _mm256_min_ps(_mm256_floor_ps(v), _mm256_set1_ps(static_cast<float>(extent - 2)));
+    f = _mm256_sub_ps(v, fl);
+}
+
+inline __m256i brick_local8(__m256 fl, __m256i i0, const trilinear_grid_t& g, __m256i& b)
+{
+    // exact for coordinates far below 2^22
+    b = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_add_ps(fl, _mm256_set1_ps(0.5f)),
+                                          _mm256_set1_ps(1.f / static_cast<float>(g.block_length))));
+    return _mm256_add_epi32(_mm256_sub_epi32(i0, _mm256_mullo_epi32(b, _mm256_set1_epi32((int)g.block_length))),
+                            _mm256_set1_epi32((int)g.padding));
+}
+
+/**
+ * @return voxel offset of the lower corner.
+ */
+inline __m256i offset8(const trilinear_grid_t& g, __m256 flx, __m256 fly, __m256 flz)
+{
+    const __m256i x0 = _mm256_cvttps_epi32(flx), y0 = _mm256_cvttps_epi32(fly), z0 = _mm256_cvttps_epi32(flz);
+    if (!g.block_slot)
+    {
+        __m256i off = _mm256_mullo_epi32(_mm256_sub_epi32(z0, _mm256_set1_epi32(g.oz)), _mm256_set1_epi32((int)g.pitch_z));
+        off = _mm256_add_epi32(off, _mm256_mullo_epi32(_mm256_sub_epi32(y0, _mm256_set1_epi32(g.oy)),
+                                                       _mm256_set1_epi32((int)g.pitch_y)));
+        return _mm256_add_epi32(off, _mm256_sub_epi32(x0, _mm256_set1_epi32(g.ox)));
+    }
+    __m256i bx, by, bz;
+    const __m256i lx = brick_local8(flx, x0, g, bx);
+    const __m256i ly = brick_local8(fly, y0, g, by);
+    const __m256i lz = brick_local8(flz, z0, g, bz);
+    const __m256i bs = _mm256_set1_epi32((int)g.block_size);
+    __m256i brick = _mm256_add_epi32(_mm256_mullo_epi32(bz, _mm256_set1_epi32((int)g.block_dim_y)), by);
+    brick = _mm256_add_epi32(_mm256_mullo_epi32(brick, _mm256_set1_epi32((int)g.block_dim_x)), bx);
+    const __m256i slot = _mm256_i32gather_epi32(reinterpret_cast<const int*>(g.block_slot), brick, 4);
+    __m256i local = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(lz, bs), ly), bs), lx);
+    return _mm256_add_epi32(_mm256_mullo_epi32(slot, _mm256_set1_epi32((int)g.block_voxels)), local);
+}
+
+/**
+ * @brief Voxels at offset and offset + 1 with one dword gather.
+ */
+template <typename T>
+inline void fetch_pair8(const uint8_t* data, __m256i off, __m256& v0, __m256& v1)
+{
+    if constexpr (sizeof(T) == 2)
+    {
+        const __m256i d = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), _mm256_slli_epi32(off, 1), 1);
+        v0 = _mm256_cvtepi32_ps(_mm256_and_si256(d, _mm256_set1_epi32(0xffff)));
+        v1 = _mm256_cvtepi32_ps(_mm256_srli_epi32(d, 16));
+    }
+    else
+    {
+        // dword ending right after the pair so the last voxel never reads past the storage, clamped at its start
+        const __m256i start = _mm256_max_epi32(_mm256_sub_epi32(off, _mm256_set1_epi32(2)), _mm256_setzero_si256());
+        const __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(off, start), 3);
+        const __m256i d = _mm256_srlv_epi32(_mm256_i32gather_epi32(reinterpret_cast<const int*>(data), start, 1), shift);
+        v0 = _mm256_cvtepi32_ps(_mm256_and_si256(d, _mm256_set1_epi32(0xff)));
+        v1 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(d, 8), _mm256_set1_epi32(0xff)));
+    }
+}
+
+template <typename T>
+inline __m256 sample8(const trilinear_grid_t& g, __m256 x, __m256 y, __m256 z)
+{
+    __m256 flx, fly, flz, fx, fy, fz;
+    axis8(x, g.width, flx, fx);
+    axis8(y, g.height, fly, fy);
+    axis8(z, g.depth, flz, fz);
+    const __m256i off = offset8(g, flx, fly, flz);
+    const int pitch_y = g.block_slot ? (int)g.block_size : (int)g.pitch_y;
+    const int pitch_z = g.block_slot ? (int)(g.block_size * g.block_size) : (int)g.pitch_z;
+    __m256 v0, v1;
+    auto lerp = [](__m256 a, __m256 b, __m256 t) { return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a))); };
+    fetch_pair8<T>(g.data, off, v0, v1);
+    const __m256 c00 = lerp(v0, v1, fx);
+    fetch_pair8<T>(g.data, _mm256_add_epi32(off, _mm256_set1_epi32(pitch_y)), v0, v1);
+    const __m256 c10 = lerp(v0, v1, fx);
+    fetch_pair8<T>(g.data, _mm256_add_epi32(off, _mm256_set1_epi32(pitch_z)), v0, v1);
+    const __m256 c01 = lerp(v0, v1, fx);
+    fetch_pair8<T>(g.data, _mm256_add_epi32(off, _mm256_set1_epi32(pitch_y + pitch_z)), v0, v1);
+    const __m256 c11 = lerp(v0, v1, fx);
+    return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+}
+
+inline void load_points8(const float* pts, __m256& x, __m256& y, __m256& z)
+{
+    const __m256i idx = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    x = _mm256_i32gather_ps(pts, idx, 4);
+    y = _mm256_i32gather_ps(pts + 1, idx, 4);
+    z = _mm256_i32gather_ps(pts + 2, idx, 4);
+}
+
+inline bool can_gather(const trilinear_grid_t& g)
+{
+    // 32 bit byte offsets, pair fetch needs a second voxel on each axis
+    return g.bytes >= 4 && g.bytes <= (size_t)std::numeric_limits<int32_t>::max() && g.width > 1 && g.height > 1 &&
+           g.depth > 1;
+}
+} // namespace trilinear_detail
+#endif
+
+/**
+ * @brief out[i] = trilinear sample at pts[i], eight points per iteration with AVX2 gathers.
+ */
+template <typename T>
+void trilinear_sample(const trilinear_grid_t& g, const float* pts, size_t count, float* out)
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    assert(!g.block_slot || g.padding > 0);
+    size_t i = 0;
+#if defined(VOL_SIMD_AVX2)
+    using namespace trilinear_detail;
+    if (can_gather(g))
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x, y, z;
+            load_points8(pts + i * 3, x, y, z);
+            _mm256_storeu_ps(out + i, sample8<T>(g, x, y, z));
+        }
+    }
+#endif
+    for (; i < count; i++)
+        out[i] = trilinear_sample_scalar<T>(g, pts[i * 3], pts[i * 3 + 1], pts[i * 3 + 2]);
+}
+
+/**
+ * @brief grads[i * 3 + axis] = central difference gradient at pts[i].
+ */
+template <typename T>
+void trilinear_gradient(const trilinear_grid_t& g, const float* pts, size_t count, float* grads)
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    assert(!g.block_slot || g.padding > 0);
+    size_t i = 0;
+#if defined(VOL_SIMD_AVX2)
+    using namespace trilinear_detail;
+    if (can_gather(g))
+    {
+        const __m256 one = _mm256_set1_ps(1.f);
+        auto clamp = [](__m256 v, uint32_t extent) {
+            v = _mm256_max_ps(v, _mm256_setzero_ps());
+            return _mm256_min_ps(v, _mm256_set1_ps(static_cast<float>(extent - 1)));
+        };
+        auto diff = [](__m256 lo, __m256 hi, __m256 vlo, __m256 vhi) {
+            const __m256 den = _mm256_sub_ps(hi, lo);
+            const __m256 valid = _mm256_cmp_ps(den, _mm256_setzero_ps(), _CMP_GT_OQ);
+            return _mm256_and_ps(_mm256_div_ps(_mm256_sub_ps(vhi, vlo), den), valid);
+        };
+        alignas(32) float gx[8], gy[8], gz[8];
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x, y, z;
+            load_points8(pts + i * 3, x, y, z);
+            const __m256 xl = clamp(_mm256_sub_ps(x, one), g.width), xh = clamp(_mm256_add_ps(x, one), g.width);
+            const __m256 yl = clamp(_mm256_sub_ps(y, one), g.height), yh = clamp(_mm256_add_ps(y, one), g.height);
+            const __m256 zl = clamp(_mm256_sub_ps(z, one), g.depth), zh = clamp(_mm256_add_ps(z, one), g.depth);
+            _mm256_store_ps(gx, diff(xl, xh, sample8<T>(g, xl, y, z), sample8<T>(g, xh, y, z)));
+            _mm256_store_ps(gy, diff(yl, yh, sample8<T>(g, x, yl, z), sample8<T>(g, x, yh, z)));
+            _mm256_store_ps(gz, diff(zl, zh, sample8<T>(g, x, y, zl), sample8<T>(g, x, y, zh)));
+            for (int k = 0; k < 8; k++)
+            {
+                grads[(i + k) * 3] = gx[k];
+                grads[(i + k) * 3 + 1] = gy[k];
+                grads[(i + k) * 3 + 2] = gz[k];
+            }
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        trilinear_gradient_with(g.width, g.height, g.depth, pts[i * 3], pts[i * 3 + 1], pts[i * 3 + 2], grads + i * 3,
+                                [&](float x, float y, float z) { return trilinear_sample_scalar<T>(g, x, y, z); });
+    }
+}
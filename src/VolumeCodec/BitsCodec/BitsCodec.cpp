@@ -4,9 +4,10 @@
 VOL_BEGIN
 
 std::unique_ptr<BitsCodec> BitsCodec::Create(CodecDevice device) {
-
+    if(device == CodecDevice::CPU)
+        return std::make_unique<CPUBitsCodec>();
     return nullptr;
 }
 
 
-VOL_END
\ No newline at end of file
+VOL_END
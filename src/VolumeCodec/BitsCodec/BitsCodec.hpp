@@ -3,10 +3,16 @@
 
 VOL_BEGIN
 
-class BitsCodecImpl : public BitsCodec{
-public:
+/**
+ * @brief Stream layout shared by bits codec implementations.
+ * Volume is cut into chunks of BitsCodecChunkDepth slices along z, one packet per chunk:
+ * [(uint32 z_beg)(uint32 slice_count)][group]...
+ * Samples are predicted by 3D lorenzo inside the chunk(neighbors out of chunk are 0), residuals are zigzag coded
+ * and cut into groups of BitsCodecGroupSize in storage order, each group is :
+ * [(uint8 bit_width)(bit_width planes of BitsCodecGroupSize / 8 bytes)]
+ */
+inline constexpr int BitsCodecChunkDepth = 16;
+inline constexpr int BitsCodecGroupSize = 128;
+inline constexpr size_t BitsCodecPacketHeaderSize = 8;
 
-};
-
-
-VOL_END
\ No newline at end of file
+VOL_END
@@ -1,8 +1,355 @@
 #include "CPUBitsCodec.hpp"
+#include "Common/Utils.hpp"
+#include <bit>
+#include <type_traits>
 
 VOL_BEGIN
 
+namespace{
+    constexpr int GroupSize = BitsCodecGroupSize;
+    constexpr int PlaneBytes = BitsCodecGroupSize / 8;
 
+    template<typename T>
+    inline T ZigZag(T r){
+        using S = std::make_signed_t<T>;
+        int s = static_cast<S>(r);
+        return static_cast<T>((static_cast<unsigned>(s) << 1) ^ static_cast<unsigned>(s >> 31));
+    }
 
+    template<typename T>
+    inline T UnZigZag(T z){
+        return static_cast<T>((z >> 1) ^ static_cast<T>(0u - (z & 1u)));
+    }
 
-VOL_END
\ No newline at end of file
+#ifdef VOL_SIMD_SSE2
+    /**
+     * @brief 16 bits mask to 16 bytes of 0xff or 0.
+     */
+    inline __m128i ExpandBits16(int mask){
+        const __m128i sel = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128);
+        __m128i x = _mm_set1_epi16(static_cast<short>(mask));
+        x = _mm_unpacklo_epi8(x, x);
+        x = _mm_unpacklo_epi16(x, x);
+        x = _mm_unpacklo_epi32(x, x);
+        return _mm_cmpeq_epi8(_mm_and_si128(x, sel), sel);
+    }
+
+    inline int MoveMaskBit(__m128i x, int bit){
+        // bit b of every byte to its top bit, bits shifted in from the lower byte never reach the top
+        return _mm_movemask_epi8(_mm_sll_epi64(x, _mm_cvtsi32_si128(7 - bit)));
+    }
+#endif
+
+    /**
+     * @brief Store bit plane b of 128 values as 16 bytes, bit i of a plane is value i.
+     */
+    template<typename T>
+    void PackGroup(const T* v, int bit_width, uint8_t* dst){
+#ifdef VOL_SIMD_SSE2
+        for(int k = 0; k < GroupSize / 16; k++){
+            __m128i lo, hi;
+            if constexpr(sizeof(T) == 1){
+                lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + k * 16));
+                hi = _mm_setzero_si128();
+            }
+            else{
+                const __m128i low_byte = _mm_set1_epi16(0xff);
+                __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + k * 16));
+                __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + k * 16 + 8));
+                lo = _mm_packus_epi16(_mm_and_si128(x0, low_byte), _mm_and_si128(x1, low_byte));
+                hi = _mm_packus_epi16(_mm_srli_epi16(x0, 8), _mm_srli_epi16(x1, 8));
+            }
+            for(int b = 0; b < bit_width; b++){
+                auto mask = static_cast<uint16_t>(MoveMaskBit(b < 8 ? lo : hi, b & 7));
+                std::memcpy(dst + b * PlaneBytes + k * 2, &mask, 2);
+            }
+        }
+#else
+        std::memset(dst, 0, (size_t)bit_width * PlaneBytes);
+        for(int b = 0; b < bit_width; b++){
+            uint8_t* plane = dst + b * PlaneBytes;
+            for(int i = 0; i < GroupSize; i++)
+                plane[i >> 3] |= static_cast<uint8_t>(((v[i] >> b) & 1) << (i & 7));
+        }
+#endif
+    }
+
+    template<typename T>
+    void UnpackGroup(const uint8_t* src, int bit_width, T* v){
+#ifdef VOL_SIMD_SSE2
+        for(int k = 0; k < GroupSize / 16; k++){
+            __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+            for(int b = 0; b < bit_width; b++){
+                uint16_t mask;
+                std::memcpy(&mask, src + b * PlaneBytes + k * 2, 2);
+                __m128i bits = _mm_and_si128(ExpandBits16(mask), _mm_set1_epi8(static_cast<char>(1 << (b & 7))));
+                if(b < 8) lo = _mm_or_si128(lo, bits);
+                else hi = _mm_or_si128(hi, bits);
+            }
+            if constexpr(sizeof(T) == 1){
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(v + k * 16), lo);
+            }
+            else{
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(v + k * 16), _mm_unpacklo_epi8(lo, hi));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(v + k * 16 + 8), _mm_unpackhi_epi8(lo, hi));
+            }
+        }
+#else
+        std::fill(v, v + GroupSize, T(0));
+        for(int b = 0; b < bit_width; b++){
+            const uint8_t* plane = src + b * PlaneBytes;
+            for(int i = 0; i < GroupSize; i++)
+                v[i] |= static_cast<T>(((plane[i >> 3] >> (i & 7)) & 1) << b);
+        }
+#endif
+    }
+
+    struct ChunkLayout{
+        size_t row;   // samples in a row
+        size_t slice; // samples in a slice
+        int stride;   // samples between two neighbor voxels
+        int height;
+    };
+
+    /**
+     * @brief Residuals of one row, rows out of the chunk are zeros.
+     * @param c samples between two neighbor voxels
+     */
+    template<typename T>
+    void PredictRow(const T* __restrict cur, const T* __restrict up, const T* __restrict back, const T* __restrict back_up,
+                    size_t row, size_t c, T* __restrict dst){
+        for(size_t i = 0; i < c; i++)
+            dst[i] = ZigZag(static_cast<T>(cur[i] - up[i] - back[i] + back_up[i]));
+        for(size_t i = c; i < row; i++){
+            T p = static_cast<T>(cur[i - c] + up[i] + back[i] - up[i - c] - back[i - c] - back_up[i] + back_up[i - c]);
+            dst[i] = ZigZag(static_cast<T>(cur[i] - p));
+        }
+    }
+
+    /**
+     * @brief Inverse of PredictRow, all but the x neighbor are known so add them first then prefix sum along x.
+     */
+    template<typename T>
+    void ReconstructRow(T* __restrict cur, const T* __restrict up, const T* __restrict back, const T* __restrict back_up,
+                        size_t row, size_t c, T* __restrict diff){
+        for(size_t i = 0; i < c; i++)
+            diff[i] = static_cast<T>(UnZigZag(cur[i]) + up[i] + back[i] - back_up[i]);
+        for(size_t i = c; i < row; i++)
+            diff[i] = static_cast<T>(UnZigZag(cur[i]) + up[i] + back[i] - up[i - c] - back[i - c] - back_up[i] + back_up[i - c]);
+        if(c == 1){
+            T sum = 0;
+            size_t i = 0;
+#ifdef VOL_SIMD_SSE2
+            // log step prefix sum in register, carry the last lane to next vector
+            __m128i carry = _mm_setzero_si128();
+            for(; i + 16 / sizeof(T) <= row; i += 16 / sizeof(T)){
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(diff + i));
+                if constexpr(sizeof(T) == 1){
+                    x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+                    x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+                    x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+                    x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+                    x = _mm_add_epi8(x, carry);
+                    carry = _mm_unpackhi_epi8(x, x);
+                    carry = _mm_shuffle_epi32(_mm_unpackhi_epi16(carry, carry), 0xff);
+                }
+                else{
+                    x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+                    x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+                    x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+                    x = _mm_add_epi16(x, carry);
+                    carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(x, 0xff), 0xff);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(cur + i), x);
+            }
+            if(i > 0)
+                sum = cur[i - 1];
+#endif
+            for(; i < row; i++){
+                sum = static_cast<T>(sum + diff[i]);
+                cur[i] = sum;
+            }
+        }
+        else{
+            for(size_t i = 0; i < c; i++)
+                cur[i] = diff[i];
+            for(size_t i = c; i < row; i++)
+                cur[i] = static_cast<T>(cur[i - c] + diff[i]);
+        }
+    }
+
+    /**
+     * @brief Lorenzo residuals of slices [z_beg, z_end) in zigzag code, data out of the chunk counts as 0.
+     */
+    template<typename T>
+    void Predict(const T* src, const ChunkLayout& layout, int z_beg, int z_end, T* res, const T* zeros){
+        const size_t row = layout.row;
+        for(int z = z_beg; z < z_end; z++){
+            for(int y = 0; y < layout.height; y++){
+                const T* cur = src + z * layout.slice + y * row;
+                const T* up = y > 0 ? cur - row : zeros;
+                const T* back = z > z_beg ? cur - layout.slice : zeros;
+                const T* back_up = y > 0 && z > z_beg ? cur - layout.slice - row : zeros;
+                PredictRow(cur, up, back, back_up, row, layout.stride, res + (z - z_beg) * layout.slice + y * row);
+            }
+        }
+    }
+
+    /**
+     * @brief Inverse of Predict in place, data holds zigzag residuals of the chunk.
+     */
+    template<typename T>
+    void Reconstruct(T* data, const ChunkLayout& layout, int depth, const T* zeros){
+        const size_t row = layout.row;
+        std::vector<T> diff(row);
+        for(int z = 0; z < depth; z++){
+            for(int y = 0; y < layout.height; y++){
+                T* cur = data + z * layout.slice + y * row;
+                const T* up = y > 0 ? cur - row : zeros;
+                const T* back = z > 0 ? cur - layout.slice : zeros;
+                const T* back_up = y > 0 && z > 0 ? cur - layout.slice - row : zeros;
+                ReconstructRow(cur, up, back, back_up, row, layout.stride, diff.data());
+            }
+        }
+    }
+
+    template<typename T>
+    void EncodeChunk(const T* src, const ChunkLayout& layout, int z_beg, int z_end, const T* zeros, Packet& packet){
+        const size_t count = layout.slice * (z_end - z_beg);
+        std::vector<T> res(count);
+        Predict(src, layout, z_beg, z_end, res.data(), zeros);
+
+        const size_t group_count = (count + GroupSize - 1) / GroupSize;
+        packet.resize(BitsCodecPacketHeaderSize + group_count * (1 + sizeof(T) * 8 * PlaneBytes));
+        uint32_t header[2] = {static_cast<uint32_t>(z_beg), static_cast<uint32_t>(z_end - z_beg)};
+        std::memcpy(packet.data(), header, sizeof(header));
+        size_t offset = BitsCodecPacketHeaderSize;
+        T tail[GroupSize];
+        for(size_t g = 0; g < group_count; g++){
+            const T* v = res.data() + g * GroupSize;
+            const size_t n = std::min<size_t>(GroupSize, count - g * GroupSize);
+            if(n < GroupSize){
+                std::fill(std::copy(v, v + n, tail), tail + GroupSize, T(0));
+                v = tail;
+            }
+            unsigned bits = 0;
+            for(int i = 0; i < GroupSize; i++)
+                bits |= v[i];
+            const int bit_width = std::bit_width(bits);
+            packet[offset++] = static_cast<uint8_t>(bit_width);
+            PackGroup(v, bit_width, packet.data() + offset);
+            offset += (size_t)bit_width * PlaneBytes;
+        }
+        packet.resize(offset);
+    }
+
+    template<typename T>
+    void DecodeChunk(const Packet& packet, const ChunkLayout& layout, int depth, T* dst, const T* zeros){
+        uint32_t header[2];
+        if(packet.size() < BitsCodecPacketHeaderSize)
+            throw VolumeCodecError("CPU bits decode error : packet too small");
+        std::memcpy(header, packet.data(), sizeof(header));
+        const auto z_beg = static_cast<int>(header[0]);
+        const auto slice_count = static_cast<int>(header[1]);
+        if(slice_count <= 0 || z_beg + slice_count > depth)
+            throw VolumeCodecError("CPU bits decode error : packet slice range out of volume");
+        T* data = dst + z_beg * layout.slice;
+        const size_t count = layout.slice * slice_count;
+        const size_t group_count = (count + GroupSize - 1) / GroupSize;
+        size_t offset = BitsCodecPacketHeaderSize;
+        T tail[GroupSize];
+        for(size_t g = 0; g < group_count; g++){
+            if(offset >= packet.size())
+                throw VolumeCodecError("CPU bits decode error : packet truncated");
+            const int bit_width = packet[offset++];
+            if(bit_width > (int)sizeof(T) * 8 || offset + (size_t)bit_width * PlaneBytes > packet.size())
+                throw VolumeCodecError("CPU bits decode error : invalid group");
+            const size_t n = std::min<size_t>(GroupSize, count - g * GroupSize);
+            if(n == GroupSize){
+                UnpackGroup(packet.data() + offset, bit_width, data + g * GroupSize);
+            }
+            else{
+                UnpackGroup(packet.data() + offset, bit_width, tail);
+                std::copy(tail, tail + n, data + g * GroupSize);
+            }
+            offset += (size_t)bit_width * PlaneBytes;
+        }
+        Reconstruct(data, layout, slice_count, zeros);
+    }
+
+    ChunkLayout GetLayout(const BitsCodec::BitsCodecParams& params){
+        ChunkLayout layout;
+        layout.stride = params.samplers_per_pixel;
+        layout.row = (size_t)params.width * params.samplers_per_pixel;
+        layout.slice = layout.row * params.height;
+        layout.height = params.height;
+        return layout;
+    }
+
+    size_t GetVolumeBytes(const BitsCodec::BitsCodecParams& params){
+        return (size_t)params.width * params.height * params.depth * params.samplers_per_pixel * (params.bits_per_sampler / 8);
+    }
+
+    void CheckParams(const BitsCodec::BitsCodecParams& params){
+        if(params.width <= 0 || params.height <= 0 || params.depth <= 0 || params.samplers_per_pixel <= 0)
+            throw VolumeCodecError("CPU bits codec error : invalid extend");
+        if(params.bits_per_sampler != 8 && params.bits_per_sampler != 16)
+            throw VolumeCodecError("CPU bits codec error : only support 8 or 16 bits per sampler");
+    }
+
+    template<typename T>
+    void EncodeImpl(const BitsCodec::BitsCodecParams& params, const T* src, Packets& packets){
+        const auto layout = GetLayout(params);
+        const std::vector<T> zeros(layout.row, T(0));
+        const int chunk_count = (params.depth + BitsCodecChunkDepth - 1) / BitsCodecChunkDepth;
+        Packets chunk_packets(chunk_count);
+        parallel_forrange(0, chunk_count, [&](int, int chunk){
+            const int z_beg = chunk * BitsCodecChunkDepth;
+            const int z_end = std::min(params.depth, z_beg + BitsCodecChunkDepth);
+            EncodeChunk(src, layout, z_beg, z_end, zeros.data(), chunk_packets[chunk]);
+        }, std::min(chunk_count, std::max(1, params.threads_count)));
+        for(auto& packet : chunk_packets)
+            packets.emplace_back(std::move(packet));
+    }
+
+    template<typename T>
+    void DecodeImpl(const BitsCodec::BitsCodecParams& params, const Packets& packets, T* dst){
+        const auto layout = GetLayout(params);
+        const std::vector<T> zeros(layout.row, T(0));
+        const int packet_count = static_cast<int>(packets.size());
+        parallel_forrange(0, packet_count, [&](int, int i){
+            DecodeChunk(packets[i], layout, params.depth, dst, zeros.data());
+        }, std::min(packet_count, std::max(1, params.threads_count)));
+    }
+}
+
+size_t CPUBitsCodec::Encode(const BitsCodecParams &params, const void *buf, size_t size, Packets &packets) {
+    CheckParams(params);
+    if(!buf || size < GetVolumeBytes(params))
+        throw VolumeCodecError("CPU bits encode error : source buffer size is not enough large");
+    const size_t first = packets.size();
+    if(params.bits_per_sampler == 8)
+        EncodeImpl(params, reinterpret_cast<const uint8_t*>(buf), packets);
+    else
+        EncodeImpl(params, reinterpret_cast<const uint16_t*>(buf), packets);
+    size_t packed_size = 0;
+    for(size_t i = first; i < packets.size(); i++)
+        packed_size += packets[i].size() + sizeof(size_t);
+    return packed_size;
+}
+
+size_t CPUBitsCodec::Decode(const BitsCodecParams &params, const Packets &packets, void *buf, size_t size) {
+    CheckParams(params);
+    const size_t bytes = GetVolumeBytes(params);
+    if(!buf || size < bytes)
+        throw VolumeCodecError("CPU bits decode error : target decode buffer size is not enough large!");
+    if(packets.size() != (size_t)(params.depth + BitsCodecChunkDepth - 1) / BitsCodecChunkDepth)
+        throw VolumeCodecError("CPU bits decode error : packet count not match extend");
+    if(params.bits_per_sampler == 8)
+        DecodeImpl(params, packets, reinterpret_cast<uint8_t*>(buf));
+    else
+        DecodeImpl(params, packets, reinterpret_cast<uint16_t*>(buf));
+    return bytes;
+}
+
+VOL_END
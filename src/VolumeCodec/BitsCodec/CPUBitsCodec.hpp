@@ -3,5 +3,11 @@
 
 VOL_BEGIN
 
+class CPUBitsCodec final : public BitsCodec{
+public:
+    size_t Encode(const BitsCodecParams& params, const void* buf, size_t size, Packets& packets) override;
 
-VOL_END
\ No newline at end of file
+    size_t Decode(const BitsCodecParams& params, const Packets& packets, void* buf, size_t size) override;
+};
+
+VOL_END
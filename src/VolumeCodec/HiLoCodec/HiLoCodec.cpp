@@ -0,0 +1,70 @@
+#include "HiLoCodec.hpp"
+
+VOL_BEGIN
+
+namespace{
+    constexpr size_t HiLoHeaderSize = 8;
+
+    void SplitHiLo(const uint16_t* src, size_t count, uint8_t* hi, uint8_t* lo){
+        for(size_t i = 0; i < count; i++){
+            hi[i] = static_cast<uint8_t>(src[i] >> 8);
+            lo[i] = static_cast<uint8_t>(src[i]);
+        }
+    }
+
+    void MergeHiLo(const uint8_t* hi, const uint8_t* lo, size_t count, uint16_t* dst){
+        for(size_t i = 0; i < count; i++)
+            dst[i] = static_cast<uint16_t>((hi[i] << 8) | lo[i]);
+    }
+}
+
+CPUVolumeHiLoCodec::CPUVolumeHiLoCodec(const VideoEncodeSettings &settings, int threadCount)
+    : hi_codec(threadCount), lo_codec(settings, threadCount) {
+
+}
+
+size_t CPUVolumeHiLoCodec::Encode(const Extend3D &extend, const void *buf, size_t size, Packets &packets) {
+    const size_t count = extend.size();
+    if(!buf || size < count * sizeof(uint16_t))
+        throw VolumeCodecError("CPU hilo encode error : source buffer size is not enough large");
+    hi_plane.resize(count);
+    lo_plane.resize(count);
+    SplitHiLo(reinterpret_cast<const uint16_t*>(buf), count, hi_plane.data(), lo_plane.data());
+
+    Packets hi_packets, lo_packets;
+    size_t packed_size = hi_codec.Encode(extend, hi_plane.data(), count, hi_packets);
+    packed_size += lo_codec.Encode(extend, lo_plane.data(), count, lo_packets);
+
+    uint32_t header[2] = {static_cast<uint32_t>(hi_packets.size()), static_cast<uint32_t>(lo_packets.size())};
+    auto& header_packet = packets.emplace_back(HiLoHeaderSize);
+    std::memcpy(header_packet.data(), header, HiLoHeaderSize);
+    packed_size += HiLoHeaderSize + sizeof(size_t);
+    for(auto& p : hi_packets)
+        packets.emplace_back(std::move(p));
+    for(auto& p : lo_packets)
+        packets.emplace_back(std::move(p));
+    return packed_size;
+}
+
+size_t CPUVolumeHiLoCodec::Decode(const Extend3D &extend, const Packets &packets, void *buf, size_t size) {
+    const size_t count = extend.size();
+    if(!buf || size < count * sizeof(uint16_t))
+        throw VolumeCodecError("CPU hilo decode error : target decode buffer size is not enough large!");
+    if(packets.empty() || packets.front().size() != HiLoHeaderSize)
+        throw VolumeCodecError("CPU hilo decode error : invalid header packet");
+    uint32_t header[2];
+    std::memcpy(header, packets.front().data(), HiLoHeaderSize);
+    if(1 + (size_t)header[0] + header[1] != packets.size())
+        throw VolumeCodecError("CPU hilo decode error : packet count not match header");
+
+    Packets hi_packets(packets.begin() + 1, packets.begin() + 1 + header[0]);
+    Packets lo_packets(packets.begin() + 1 + header[0], packets.end());
+    hi_plane.resize(count);
+    lo_plane.resize(count);
+    hi_codec.Decode(extend, hi_packets, hi_plane.data(), count);
+    lo_codec.Decode(extend, lo_packets, lo_plane.data(), count);
+    MergeHiLo(hi_plane.data(), lo_plane.data(), count, reinterpret_cast<uint16_t*>(buf));
+    return count * sizeof(uint16_t);
+}
+
+VOL_END
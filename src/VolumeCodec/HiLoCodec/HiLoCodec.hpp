@@ -0,0 +1,33 @@
+#pragma once
+#include <VolumeUtils/Volume.hpp>
+
+VOL_BEGIN
+
+/**
+ * @brief uint16 codec keeps the high byte exactly and the low byte lossy, so the error is at most one high byte step.
+ * Packets layout : [(uint32 hi_packet_count)(uint32 lo_packet_count)][hi packets...][lo packets...]
+ */
+class CPUVolumeHiLoCodec final : public CVolumeCodecInterface{
+public:
+    CPUVolumeHiLoCodec(const VideoEncodeSettings& settings, int threadCount);
+
+    GridVolumeCodec GetCodecType() const noexcept override{
+        return GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO;
+    }
+
+    CodecDevice GetCodecDevice() const noexcept override{
+        return CodecDevice::CPU;
+    }
+
+    size_t Encode(const Extend3D& extend, const void* buf, size_t size, Packets& packets) override;
+
+    size_t Decode(const Extend3D &extend, const Packets &packets, void* buf, size_t size) override;
+
+private:
+    CPUVolumeBitsCodec<VoxelRU8> hi_codec;
+    CPUVolumeVideoCodec<VoxelRU8> lo_codec;
+    std::vector<uint8_t> hi_plane;
+    std::vector<uint8_t> lo_plane;
+};
+
+VOL_END
@@ -35,6 +35,19 @@ void CPUVideoCodec::EncodeFrameIntoPackets(const void *buf, size_t size, Packets
     }
 }
 
+size_t CPUVideoCodec::EncodeFrameIntoArena(const void *buf, size_t size, PacketArena &arena) {
+    assert(_->codec.IsValid());
+    const size_t offset = arena.size();
+    try{
+        return _->codec.EncodeFrameIntoArena(buf, size, arena);
+    }
+    catch (const VideoCodecError& e) {
+        arena.resize(offset);
+        std::cerr << e.what() << std::endl;
+        return 0;
+    }
+}
+
 size_t CPUVideoCodec::DecodePacketIntoFrames(const Packet &packet, void *buf, size_t size) {
     assert(_->codec.IsValid());
     try {
@@ -16,6 +16,8 @@ public:
 
     void EncodeFrameIntoPackets(const void* buf, size_t size, Packets& packets) override;
 
+    size_t EncodeFrameIntoArena(const void* buf, size_t size, PacketArena& arena) override;
+
     size_t DecodePacketIntoFrames(const Packet& packet, void* buf, size_t size) override;
 
 private:
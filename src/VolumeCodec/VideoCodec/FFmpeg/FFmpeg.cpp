@@ -1,5 +1,7 @@
 #include "FFmpeg.hpp"
 #include "Common/Utils.hpp"
+#include <mutex>
+#include <unordered_map>
 
 using namespace vol;
 
@@ -8,10 +10,39 @@ extern "C"
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 }
 
 namespace{
-    size_t AV__DecodePacketIntoFrames(AVCodecContext* c, AVFrame* frame, AVPacket* pkt, uint8_t* buf){
+    size_t GetLumaSampleBytes(int format){
+        auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(format));
+        assert(desc);
+        return (desc->comp[0].depth + 7) / 8;
+    }
+
+    /**
+     * @brief Volume data only fill the Y plane, keep U/V constant so they cost almost nothing.
+     */
+    void FillNeutralChroma(AVFrame* frame){
+        auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+        int chroma_h = AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+        int chroma_w = AV_CEIL_RSHIFT(frame->width, desc->log2_chroma_w);
+        int depth = desc->comp[1].depth;
+        for(int plane = 1; plane <= 2; plane++){
+            for(int y = 0; y < chroma_h; y++){
+                uint8_t* row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+                if(depth > 8){
+                    auto row16 = reinterpret_cast<uint16_t*>(row);
+                    std::fill(row16, row16 + chroma_w, static_cast<uint16_t>(1 << (depth - 1)));
+                }
+                else{
+                    std::memset(row, 1 << (depth - 1), chroma_w);
+                }
+            }
+        }
+    }
+
+    size_t AV__DecodePacketIntoFrames(AVCodecContext* c, AVFrame* frame, AVPacket* pkt, uint8_t* buf, size_t capacity){
         int ret = avcodec_send_packet(c, pkt);
         if(ret < 0){
             throw VideoCodecError("AVDecode error: send packet failed with error " + std::to_string(ret));
@@ -25,14 +56,24 @@ namespace{
             else if(ret < 0)
                 throw VideoCodecError("AVDecode error: receive frame failed with error " + std::to_string(ret));
 
-            size_t frame_size = frame->linesize[0] * frame->height;
-            std::memcpy(buf + size, frame->data[0], frame_size);
+            // only the visible part of each row, linesize may be padded for alignment
+            size_t row_bytes = frame->width * GetLumaSampleBytes(frame->format);
+            size_t frame_size = row_bytes * frame->height;
+            if(size + frame_size > capacity)
+                throw VideoCodecError("AVDecode error: decoded frames exceed buffer size " + std::to_string(capacity));
+            if((size_t)frame->linesize[0] == row_bytes)
+                std::memcpy(buf + size, frame->data[0], frame_size);
+            else
+                av_image_copy_plane(buf + size, row_bytes, frame->data[0], frame->linesize[0], row_bytes, frame->height);
             size += frame_size;
+            av_frame_unref(frame);
         }
         return size;
     }
 
-    void AV__EncodeFrameIntoPackets(AVCodecContext* c, AVFrame* frame, AVPacket* pkt, Packets& packets){
+    // on_packet(data, size) for each packet received, the packet data is only valid in the call
+    template<typename OnPacket>
+    void AV__EncodeFrame(AVCodecContext* c, AVFrame* frame, AVPacket* pkt, OnPacket&& on_packet){
         int ret = avcodec_send_frame(c, frame);
         if(ret < 0){
             throw VideoCodecError("AVEncode error: send frame failed with error " + std::to_string(ret));
@@ -46,8 +87,7 @@ namespace{
                 throw VideoCodecError("AVEncode error: receive packet failed with error " + std::to_string(ret));
 
             // just copy one channel data for gray now
-            auto& packet = packets.emplace_back(pkt->size);
-            std::memcpy(packet.data(), pkt->data, pkt->size);
+            on_packet(pkt->data, static_cast<size_t>(pkt->size));
 
             av_packet_unref(pkt);
         }
@@ -64,6 +104,108 @@ namespace{
     }
 }
 
+namespace{
+    struct AVContextKey{
+        int width = 0;
+        int height = 0;
+        int bits_per_sampler = 0;
+        int threads_count = 0;
+        bool is_encode = false;
+        // encoder options fixed at open time
+        VideoEncodeSettings encode_settings;
+
+        bool operator==(const AVContextKey&) const = default;
+    };
+
+    struct AVContextKeyHash{
+        size_t operator()(const AVContextKey& key) const noexcept{
+            size_t h = std::hash<int>()(key.width);
+            h = h * 31 + std::hash<int>()(key.height);
+            h = h * 31 + std::hash<int>()(key.bits_per_sampler);
+            h = h * 31 + std::hash<int>()(key.threads_count);
+            h = h * 31 + std::hash<std::string>()(key.encode_settings.preset);
+            h = h * 31 + std::hash<int>()(key.encode_settings.crf);
+            h = h * 31 + std::hash<int>()(key.encode_settings.qp);
+            h = h * 31 + std::hash<int>()(key.encode_settings.gop_size);
+            h = h * 31 + std::hash<int>()(key.encode_settings.keyframe_interval);
+            return h * 2 + key.is_encode;
+        }
+    };
+
+    struct AVContextResource{
+        const AVCodec* codec = nullptr;
+        AVCodecContext* ctx = nullptr;
+        AVPacket* pkt = nullptr;
+        AVFrame* frame = nullptr;
+        // wraps caller memory as the luma plane for zero copy encode
+        AVFrame* input = nullptr;
+        // any frame or packet has been sent since the context was opened or flushed
+        bool dirty = false;
+
+        void Free(){
+            codec = nullptr;
+            if(ctx)
+                avcodec_free_context(&ctx);
+            if(frame)
+                av_frame_free(&frame);
+            if(input)
+                av_frame_free(&input);
+            if(pkt)
+                av_packet_free(&pkt);
+            dirty = false;
+        }
+    };
+
+    /**
+     * @brief Idle contexts kept by geometry, bit depth and direction, so one codec or many per-worker codecs
+     * reset for every block do not open a new context each time.
+     */
+    class AVContextPool{
+    public:
+        static AVContextPool& GetInstance(){
+            static AVContextPool pool;
+            return pool;
+        }
+
+        ~AVContextPool(){
+            for(auto& [key, resources] : idle){
+                for(auto& res : resources)
+                    res.Free();
+            }
+        }
+
+        bool Acquire(const AVContextKey& key, AVContextResource& res){
+            std::lock_guard<std::mutex> lk(mtx);
+            auto it = idle.find(key);
+            if(it == idle.end() || it->second.empty()) return false;
+            res = it->second.back();
+            it->second.pop_back();
+            return true;
+        }
+
+        void Release(const AVContextKey& key, AVContextResource& res){
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                auto& resources = idle[key];
+                if(resources.size() < MaxIdleCountPerKey()){
+                    resources.push_back(res);
+                    res = AVContextResource{};
+                    return;
+                }
+            }
+            res.Free();
+        }
+
+    private:
+        static size_t MaxIdleCountPerKey(){
+            return std::max<size_t>(4, std::thread::hardware_concurrency());
+        }
+
+        std::mutex mtx;
+        std::unordered_map<AVContextKey, std::vector<AVContextResource>, AVContextKeyHash> idle;
+    };
+}
+
 class FFmpegCodecPrivate{
 public:
     enum ContextState{
@@ -71,12 +213,10 @@ public:
         ENCODE,
         DECODE
     };
-    ContextState state;
+    ContextState state = INVALID;
 
-    const AVCodec* codec = nullptr;
-    AVCodecContext* ctx = nullptr;
-    AVPacket* pkt = nullptr;
-    AVFrame* frame = nullptr;
+    AVContextKey key;
+    AVContextResource res;
 
     int64_t pts = 0;
 
@@ -84,78 +224,154 @@ public:
         av_log_set_level(AV_LOG_ERROR);
     }
 
-    void FreeContext(){
+    /**
+     * @brief Give the context back to pool, it will be flushed or reopened before next use.
+     */
+    void ReleaseContext(){
+        if(state != INVALID)
+            AVContextPool::GetInstance().Release(key, res);
+        else
+            res.Free();
         state = INVALID;
-        codec = nullptr;
-        if(ctx)
-            avcodec_free_context(&ctx);
-        if(frame)
-            av_frame_free(&frame);
-        if(pkt)
-            av_packet_free(&pkt);
         pts = 0;
     }
 
-    bool InitEncodeContext(const SharedVideoCodecParams& params){
-        FreeContext();
+    void FreeContext(){
+        state = INVALID;
+        res.Free();
+        pts = 0;
+    }
 
-        if(params.fmt == vol::VideoCodecFormat::NONE){
-            std::cerr << "Invalid format NONE" << std::endl;
-            return false;
-        }
-        ScopeGuard guard([this]{
-            FreeContext();
-        });
-        codec = avcodec_find_encoder(AV_CODEC_ID_HEVC);
-        if(!codec){
-            std::cerr << "AVCodec error: not find codec hevc" << std::endl;
-            return false;
+    static AVContextKey MakeKey(const SharedVideoCodecParams& params){
+        AVContextKey key;
+        key.is_encode = params.is_encode;
+        key.threads_count = params.threads_count;
+        // decoder is configured by the stream itself
+        if(params.is_encode){
+            key.width = params.frame_width;
+            key.height = params.frame_height;
+            key.bits_per_sampler = params.bits_per_sampler;
+            key.encode_settings = params.encode_settings;
         }
+        return key;
+    }
 
-        ctx = avcodec_alloc_context3(codec);
-        if(!ctx){
+    bool OpenEncodeContext(const SharedVideoCodecParams& params){
+        res.ctx = avcodec_alloc_context3(res.codec);
+        if(!res.ctx){
             std::cerr << "AVCodec error: alloc context failed" << std::endl;
             return false;
         }
-
-        pkt = av_packet_alloc();
-        if(!pkt){
-            std::cerr << "AVCodec error: alloc packet failed" << std::endl;
-            return false;
-        }
-
-        frame = av_frame_alloc();
-        if(!frame){
-            std::cerr << "AVCodec error: alloc frame falied " << std::endl;
-            return false;
-        }
-
         // set avcodec context params
+        auto ctx = res.ctx;
         ctx->width = params.frame_width;
         ctx->height = params.frame_height;
         ctx->time_base = {1, 30};
         ctx->framerate = {30, 1};
         ctx->bits_per_raw_sample = params.bits_per_sampler;
         ctx->pix_fmt = TransformPixelFormat(params.fmt);
-        ctx->thread_count = std::thread::hardware_concurrency();
-        // because interfaces in Volume.hpp not consider of encode quality... just set medium
-        av_opt_set(ctx->priv_data, "preset", "medium", 0);
-        av_opt_set(ctx->priv_data, "tune", "fastdecode", 0);
-        av_opt_set(ctx->priv_data, "x265-params", "log-level=0", 0);
-        int ret = avcodec_open2(ctx, codec, nullptr);
+        auto& settings = params.encode_settings;
+        int threads = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+        ctx->thread_count = threads;
+        if(settings.keyframe_interval > 0)
+            ctx->gop_size = settings.keyframe_interval;
+        else if(settings.gop_size > 0)
+            ctx->gop_size = settings.gop_size;
+        if(!settings.preset.empty())
+            av_opt_set(ctx->priv_data, "preset", settings.preset.c_str(), 0);
+        if(!settings.tune.empty())
+            av_opt_set(ctx->priv_data, "tune", settings.tune.c_str(), 0);
+        if(settings.qp >= 0)
+            av_opt_set_int(ctx->priv_data, "qp", settings.qp, 0);
+        else if(settings.crf >= 0)
+            av_opt_set_double(ctx->priv_data, "crf", settings.crf, 0);
+        // libx265 sizes its own thread pool and ignores thread_count
+        std::string x265_params = "log-level=0";
+        if(settings.threads > 0)
+            x265_params += ":pools=" + std::to_string(threads);
+        if(settings.keyframe_interval > 0){
+            // every gop must decode alone : fixed closed gops, each idr carries its own parameter sets
+            auto interval = std::to_string(settings.keyframe_interval);
+            x265_params += ":keyint=" + interval + ":min-keyint=" + interval + ":scenecut=0:open-gop=0:repeat-headers=1";
+            av_opt_set_int(ctx->priv_data, "forced-idr", 1, 0);
+        }
+        av_opt_set(ctx->priv_data, "x265-params", x265_params.c_str(), 0);
+        int ret = avcodec_open2(ctx, res.codec, nullptr);
         if(ret < 0){
             std::cerr << "AVCodec error: open codec failed" << std::endl;
             return false;
         }
+        res.dirty = false;
+        return true;
+    }
 
-        frame->format = ctx->pix_fmt;
-        frame->width = ctx->width;
-        frame->height = ctx->height;
-        ret = av_frame_get_buffer(frame, 0);
-        if(ret < 0){
-            std::cerr << "AVCodec error: frame get buffer failed" << std::endl;
+    bool InitEncodeContext(const SharedVideoCodecParams& params){
+        ReleaseContext();
+
+        if(params.fmt == vol::VideoCodecFormat::NONE){
+            std::cerr << "Invalid format NONE" << std::endl;
             return false;
         }
+        key = MakeKey(params);
+        if(AVContextPool::GetInstance().Acquire(key, res)){
+            if(!res.dirty){
+                state = ENCODE;
+                return true;
+            }
+            if(res.codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH){
+                avcodec_flush_buffers(res.ctx);
+                res.dirty = false;
+                state = ENCODE;
+                return true;
+            }
+            // a drained encoder can not restart, reopen it but keep frame and packet
+            avcodec_free_context(&res.ctx);
+        }
+        ScopeGuard guard([this]{
+            FreeContext();
+        });
+        if(!res.codec){
+            res.codec = avcodec_find_encoder(AV_CODEC_ID_HEVC);
+            if(!res.codec){
+                std::cerr << "AVCodec error: not find codec hevc" << std::endl;
+                return false;
+            }
+        }
+
+        if(!OpenEncodeContext(params)) return false;
+
+        if(!res.pkt){
+            res.pkt = av_packet_alloc();
+            if(!res.pkt){
+                std::cerr << "AVCodec error: alloc packet failed" << std::endl;
+                return false;
+            }
+        }
+
+        if(!res.frame){
+            res.frame = av_frame_alloc();
+            if(!res.frame){
+                std::cerr << "AVCodec error: alloc frame falied " << std::endl;
+                return false;
+            }
+            res.frame->format = res.ctx->pix_fmt;
+            res.frame->width = res.ctx->width;
+            res.frame->height = res.ctx->height;
+            int ret = av_frame_get_buffer(res.frame, 0);
+            if(ret < 0){
+                std::cerr << "AVCodec error: frame get buffer failed" << std::endl;
+                return false;
+            }
+            FillNeutralChroma(res.frame);
+        }
+
+        if(!res.input){
+            res.input = av_frame_alloc();
+            if(!res.input){
+                std::cerr << "AVCodec error: alloc frame falied " << std::endl;
+                return false;
+            }
+        }
 
         state = ENCODE;
         guard.Dismiss();
@@ -163,42 +379,47 @@ public:
     }
 
     bool InitDecodeContext(const SharedVideoCodecParams& params){
-        FreeContext();
-        av_log_set_level(AV_LOG_ERROR);
-        if(params.fmt == vol::VideoCodecFormat::NONE){
-            std::cerr << "Invalid format NONE" << std::endl;
-            return false;
+        ReleaseContext();
+
+        key = MakeKey(params);
+        if(AVContextPool::GetInstance().Acquire(key, res)){
+            // reset decoder state, include the eof state after drained
+            if(res.dirty)
+                avcodec_flush_buffers(res.ctx);
+            res.dirty = false;
+            state = DECODE;
+            return true;
         }
         ScopeGuard guard([this]{
             FreeContext();
         });
-        codec = avcodec_find_decoder(AV_CODEC_ID_HEVC);
-        if(!codec){
+        res.codec = avcodec_find_decoder(AV_CODEC_ID_HEVC);
+        if(!res.codec){
             std::cerr << "AVCodec error: not find codec hevc" << std::endl;
             return false;
         }
 
-        ctx = avcodec_alloc_context3(codec);
-        if(!ctx){
+        res.ctx = avcodec_alloc_context3(res.codec);
+        if(!res.ctx){
             std::cerr << "AVCodec error: alloc context failed" << std::endl;
             return false;
         }
 
-        pkt = av_packet_alloc();
-        if(!pkt){
+        res.pkt = av_packet_alloc();
+        if(!res.pkt){
             std::cerr << "AVCodec error: alloc packet failed" << std::endl;
             return false;
         }
 
-        frame = av_frame_alloc();
-        if(!frame){
+        res.frame = av_frame_alloc();
+        if(!res.frame){
             std::cerr << "AVCodec error: alloc frame falied " << std::endl;
             return false;
         }
 
-        ctx->delay = 0;
-        ctx->thread_count = params.threads_count;
-        int ret = avcodec_open2(ctx, codec, nullptr);
+        res.ctx->delay = 0;
+        res.ctx->thread_count = params.threads_count;
+        int ret = avcodec_open2(res.ctx, res.codec, nullptr);
         if(ret < 0){
             std::cerr << "AVCodec error: open codec failed" << std::endl;
             return false;
@@ -220,7 +441,7 @@ FFmpegCodec::FFmpegCodec() {
 }
 
 FFmpegCodec::~FFmpegCodec() {
-    _->FreeContext();
+    _->ReleaseContext();
 }
 
 bool FFmpegCodec::Reset(const SharedVideoCodecParams &params) {
@@ -230,38 +451,95 @@ bool FFmpegCodec::Reset(const SharedVideoCodecParams &params) {
         return _->InitDecodeContext(params);
 }
 
-void FFmpegCodec::EncodeFrameIntoPackets(const void *buf, size_t size, Packets &packets) {
+template<typename OnPacket>
+void FFmpegCodec::EncodeFrame(const void *buf, size_t size, OnPacket &&on_packet) {
     // check context
     assert(_->state == FFmpegCodecPrivate::ENCODE);
 //    assert(buf && size);// nullptr for end
 
-    // copy buf to frame
-    int ret = av_frame_make_writable(_->frame);
-    if(ret < 0)
-        throw VideoCodecError("AVEncode error: frame make writable failed with error " + std::to_string(ret));
-
-    // only copy buf to data 0 which represents one channel for gray/Y(YUV)
-    if(buf){
-        //_->frame->data[0] = reinterpret_cast<uint8_t*>(const_cast<void*>(buf));// not ok because of other channel data
-        std::memcpy(_->frame->data[0], buf, size);
-        _->frame->pts = _->pts++;
+    if(!buf){
+        _->res.dirty = true;
+        AV__EncodeFrame(_->res.ctx, nullptr, _->res.pkt, on_packet);
+        return;
+    }
+    auto frame = _->res.frame;
+    const size_t row_bytes = frame->width * GetLumaSampleBytes(frame->format);
+    if(size < row_bytes * frame->height)
+        throw VideoCodecError("AVEncode error: frame buffer size " + std::to_string(size) + " is less than " + std::to_string(row_bytes * frame->height));
+
+    AVFrame* submit = frame;
+    if((size_t)frame->linesize[0] == row_bytes){
+        // caller rows are laid out as the encoder expects, reference them and only share chroma planes.
+        // encoder copies the picture before avcodec_send_frame returns, so caller memory is not kept after this call
+        auto input = _->res.input;
+        av_frame_unref(input);
+        input->format = frame->format;
+        input->width = frame->width;
+        input->height = frame->height;
+        input->buf[0] = av_buffer_create(reinterpret_cast<uint8_t*>(const_cast<void*>(buf)), row_bytes * frame->height,
+                                         [](void*, uint8_t*){}, nullptr, AV_BUFFER_FLAG_READONLY);
+        input->buf[1] = av_buffer_ref(frame->buf[0]);
+        if(!input->buf[0] || !input->buf[1])
+            throw VideoCodecError("AVEncode error: wrap frame buffer failed");
+        input->data[0] = reinterpret_cast<uint8_t*>(const_cast<void*>(buf));
+        input->linesize[0] = static_cast<int>(row_bytes);
+        for(int plane = 1; plane <= 2; plane++){
+            input->data[plane] = frame->data[plane];
+            input->linesize[plane] = frame->linesize[plane];
+        }
+        submit = input;
+    }
+    else{
+        int ret = av_frame_make_writable(frame);
+        if(ret < 0)
+            throw VideoCodecError("AVEncode error: frame make writable failed with error " + std::to_string(ret));
+        // only copy buf to data 0 which represents one channel for gray/Y(YUV)
+        av_image_copy_plane(frame->data[0], frame->linesize[0], reinterpret_cast<const uint8_t*>(buf), row_bytes,
+                            row_bytes, frame->height);
     }
-    // encode into packets
-    AV__EncodeFrameIntoPackets(_->ctx, (buf ? _->frame : nullptr), _->pkt, packets);
+    const int keyframe_interval = _->key.encode_settings.keyframe_interval;
+    submit->pict_type = keyframe_interval > 0 && _->pts % keyframe_interval == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    submit->pts = _->pts++;
+    _->res.dirty = true;
+    AV__EncodeFrame(_->res.ctx, submit, _->res.pkt, on_packet);
+    if(submit == _->res.input)
+        av_frame_unref(submit);
+}
+
+void FFmpegCodec::EncodeFrameIntoPackets(const void *buf, size_t size, Packets &packets) {
+    EncodeFrame(buf, size, [&packets](const uint8_t* data, size_t packet_size){
+        auto& packet = packets.emplace_back(packet_size);
+        std::memcpy(packet.data(), data, packet_size);
+    });
+}
+
+size_t FFmpegCodec::EncodeFrameIntoArena(const void *buf, size_t size, PacketArena &arena) {
+    size_t packet_count = 0;
+    EncodeFrame(buf, size, [&](const uint8_t* data, size_t packet_size){
+        AppendPacketRecord(arena, data, packet_size);
+        packet_count++;
+    });
+    return packet_count;
 }
 
 size_t FFmpegCodec::DecodePacketIntoFrames(const Packet &packet, void *buf, size_t size) {
     assert(_->state == FFmpegCodecPrivate::DECODE);
     assert(buf && size);
 
-    int ret = av_packet_make_writable(_->pkt);
+    int ret = av_packet_make_writable(_->res.pkt);
     if(ret < 0)
         throw VideoCodecError("AVDecode error: packet make writable failed with error " + std::to_string(ret));
 
-    _->pkt->data = const_cast<uint8_t*>(packet.data());
-    _->pkt->size = packet.size();
+    _->res.pkt->data = const_cast<uint8_t*>(packet.data());
+    _->res.pkt->size = packet.size();
+    _->res.dirty = true;
+    // packet memory is borrowed, do not leave it in a pooled packet
+    ScopeGuard guard([pkt = _->res.pkt]{
+        pkt->data = nullptr;
+        pkt->size = 0;
+    });
 
-    return AV__DecodePacketIntoFrames(_->ctx, _->frame, _->pkt, reinterpret_cast<uint8_t*>(buf));
+    return AV__DecodePacketIntoFrames(_->res.ctx, _->res.frame, _->res.pkt, reinterpret_cast<uint8_t*>(buf), size);
 }
 
 bool FFmpegCodec::IsValid() const {
@@ -1,8 +1,9 @@
 #pragma once
 #include "../VideoCodec.hpp"
 /**
- * @note for encode, data must copy to ffmpeg's owner buffer, so interface may use a lambda to get value...
- * for decode, just provide ptr and size is ok.
+ * @note for encode, packed rows (width * sample bytes) are referenced without copy and other rows are copied into
+ * ffmpeg's owner buffer, buf only need to be valid during the call.
+ * for decode, just provide ptr and size is ok, only visible width of each row is copied.
  */
 using namespace vol;
 class FFmpegCodecPrivate;
@@ -18,7 +19,15 @@ public:
 
     void EncodeFrameIntoPackets(const void *buf, size_t size, Packets &packets);
 
+    /**
+     * @return appended packet count
+     */
+    size_t EncodeFrameIntoArena(const void *buf, size_t size, PacketArena &arena);
+
     size_t DecodePacketIntoFrames(const Packet &packet, void *buf, size_t size);
 private:
+    template<typename OnPacket>
+    void EncodeFrame(const void *buf, size_t size, OnPacket &&on_packet);
+
     std::unique_ptr<FFmpegCodecPrivate> _;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "CPUVideoCodec.hpp"
 #include "GPUVideoCodec.hpp"
+#include "../../Common/SIMD.hpp"
 
 VOL_BEGIN
 
@@ -12,4 +13,22 @@ std::unique_ptr<VideoCodec> VideoCodec::Create(CodecDevice device) {
     return nullptr;
 }
 
+void DeinterleaveVoxelChannels(const void* src, size_t count, int channels, int sample_size, void* dst) {
+    if(sample_size == 1)
+        deinterleave_channels(reinterpret_cast<const uint8_t*>(src), count, channels, reinterpret_cast<uint8_t*>(dst));
+    else if(sample_size == 2)
+        deinterleave_channels(reinterpret_cast<const uint16_t*>(src), count, channels, reinterpret_cast<uint16_t*>(dst));
+    else
+        throw VolumeCodecError("Unsupported sample size for channel deinterleave : " + std::to_string(sample_size));
+}
+
+void InterleaveVoxelChannels(const void* src, size_t count, int channels, int sample_size, void* dst) {
+    if(sample_size == 1)
+        interleave_channels(reinterpret_cast<const uint8_t*>(src), count, channels, reinterpret_cast<uint8_t*>(dst));
+    else if(sample_size == 2)
+        interleave_channels(reinterpret_cast<const uint16_t*>(src), count, channels, reinterpret_cast<uint16_t*>(dst));
+    else
+        throw VolumeCodecError("Unsupported sample size for channel interleave : " + std::to_string(sample_size));
+}
+
 VOL_END
\ No newline at end of file
@@ -27,6 +27,8 @@ struct HevcVideoCodecParams{
 
     int bits_per_sampler;
     int threads_count;
+
+    VideoEncodeSettings encode_settings;
 };
 
 /**
@@ -37,8 +39,9 @@ using SharedVideoCodecParams = HevcVideoCodecParams;
 
 /**
  * @note current only support gray 8 and 16.
- * RGB and RGBA format is also ok but should handle rgb -> yuv and yuv -> rgb,
- * this may be added in later...
+ * 16 bits sampler is coded as 12 bits on cpu and 10 bits on gpu, higher bits are not kept,
+ * use GRID_VOLUME_CODEC_VIDEO_HILO for full range uint16 data.
+ * Multi-channel voxels are split into gray planes by CPUVolumeVideoCodec before reaching here.
  */
 inline bool TransformToShared(const VideoCodec::CodecParams& params, CodecDevice device, SharedVideoCodecParams* ret){
     if(params.encode){
@@ -55,6 +58,10 @@ inline bool TransformToShared(const VideoCodec::CodecParams& params, CodecDevice
             std::cerr << "Error: Only support 8 or 16 bits per raw sampler" << std::endl;
             return false;
         }
+        if (params.encode_settings.crf > 51 || params.encode_settings.qp > 51) {
+            std::cerr << "Error: crf and qp should be in [0, 51]" << std::endl;
+            return false;
+        }
     }
     if(ret){
         ret->frame_width = params.frame_w;
@@ -63,6 +70,7 @@ inline bool TransformToShared(const VideoCodec::CodecParams& params, CodecDevice
         ret->threads_count = params.threads_count;
         ret->bits_per_sampler = params.bits_per_sampler;
         ret->is_encode = params.encode;
+        ret->encode_settings = params.encode_settings;
         if(params.bits_per_sampler == 8){
             ret->fmt = VideoCodecFormat::YUV420_8BIT;
         }
@@ -0,0 +1,115 @@
+#include <VolumeUtils/Volume.hpp>
+#include "HiLoCodec/HiLoCodec.hpp"
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+VOL_BEGIN
+
+namespace{
+    struct CodecKey{
+        GridVolumeCodec codec;
+        VoxelType type;
+        VoxelFormat format;
+        CodecDevice device;
+
+        bool operator==(const CodecKey&) const = default;
+    };
+
+    struct CodecKeyHash{
+        size_t operator()(const CodecKey& key) const noexcept{
+            size_t h = static_cast<size_t>(key.codec);
+            h = h * 31 + static_cast<size_t>(key.type);
+            h = h * 31 + static_cast<size_t>(key.format);
+            return h * 31 + static_cast<size_t>(key.device);
+        }
+    };
+
+    CodecKey MakeCodecKey(GridVolumeCodec codec, const VoxelInfo& voxel_info, CodecDevice device){
+        return {codec, voxel_info.type, voxel_info.format, device};
+    }
+
+    int GetThreadCount(const VolumeCodecCreateInfo& info){
+        return info.thread_count > 0 ? info.thread_count : (int)std::thread::hardware_concurrency();
+    }
+
+    template<typename Voxel>
+    std::unique_ptr<CVolumeCodecInterface> CreateCPUVideoCodec(const VolumeCodecCreateInfo& info){
+        return std::make_unique<CPUVolumeVideoCodec<Voxel>>(info.encode_settings, GetThreadCount(info));
+    }
+
+    template<typename Voxel>
+    std::unique_ptr<CVolumeCodecInterface> CreateCPUBitsCodec(const VolumeCodecCreateInfo& info){
+        return std::make_unique<CPUVolumeBitsCodec<Voxel>>(GetThreadCount(info));
+    }
+}
+
+class VolumeCodecRegistryPrivate{
+public:
+    mutable std::shared_mutex mtx;
+    std::unordered_map<CodecKey, VolumeCodecFactory, CodecKeyHash> factories;
+};
+
+VolumeCodecRegistry& VolumeCodecRegistry::GetInstance() {
+    static VolumeCodecRegistry registry;
+    return registry;
+}
+
+VolumeCodecRegistry::VolumeCodecRegistry() {
+    _ = std::make_unique<VolumeCodecRegistryPrivate>();
+
+    // built-in cpu codecs, gpu video codec is not finished so it is left to user registering
+    constexpr auto video = GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO;
+    Register(video, {VoxelRU8::type, VoxelRU8::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRU8>);
+    Register(video, {VoxelRU16::type, VoxelRU16::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRU16>);
+    Register(video, {VoxelRGU8::type, VoxelRGU8::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRGU8>);
+    Register(video, {VoxelRGBU8::type, VoxelRGBU8::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRGBU8>);
+    Register(video, {VoxelRGBAU8::type, VoxelRGBAU8::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRGBAU8>);
+    Register(video, {VoxelRGU16::type, VoxelRGU16::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRGU16>);
+    Register(video, {VoxelRGBU16::type, VoxelRGBU16::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRGBU16>);
+    Register(video, {VoxelRGBAU16::type, VoxelRGBAU16::format}, CodecDevice::CPU, CreateCPUVideoCodec<VoxelRGBAU16>);
+
+    constexpr auto bits = GridVolumeCodec::GRID_VOLUME_CODEC_BITS;
+    Register(bits, {VoxelRU8::type, VoxelRU8::format}, CodecDevice::CPU, CreateCPUBitsCodec<VoxelRU8>);
+    Register(bits, {VoxelRU16::type, VoxelRU16::format}, CodecDevice::CPU, CreateCPUBitsCodec<VoxelRU16>);
+
+    Register(GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO, {VoxelRU16::type, VoxelRU16::format}, CodecDevice::CPU,
+             [](const VolumeCodecCreateInfo& info)->std::unique_ptr<CVolumeCodecInterface>{
+        return std::make_unique<CPUVolumeHiLoCodec>(info.encode_settings, GetThreadCount(info));
+    });
+}
+
+VolumeCodecRegistry::~VolumeCodecRegistry() {
+
+}
+
+void VolumeCodecRegistry::Register(GridVolumeCodec codec, const VoxelInfo &voxel_info, CodecDevice device, VolumeCodecFactory factory) {
+    assert(factory);
+    std::unique_lock<std::shared_mutex> lk(_->mtx);
+    _->factories[MakeCodecKey(codec, voxel_info, device)] = std::move(factory);
+}
+
+bool VolumeCodecRegistry::Unregister(GridVolumeCodec codec, const VoxelInfo &voxel_info, CodecDevice device) {
+    std::unique_lock<std::shared_mutex> lk(_->mtx);
+    return _->factories.erase(MakeCodecKey(codec, voxel_info, device)) != 0;
+}
+
+bool VolumeCodecRegistry::IsRegistered(GridVolumeCodec codec, const VoxelInfo &voxel_info, CodecDevice device) const {
+    std::shared_lock<std::shared_mutex> lk(_->mtx);
+    return _->factories.count(MakeCodecKey(codec, voxel_info, device)) != 0;
+}
+
+std::unique_ptr<CVolumeCodecInterface> VolumeCodecRegistry::Create(const VolumeCodecCreateInfo &info) const {
+    VolumeCodecFactory factory;
+    {
+        std::shared_lock<std::shared_mutex> lk(_->mtx);
+        auto it = _->factories.find(MakeCodecKey(info.codec, info.voxel_info, info.device));
+        if(it == _->factories.end()) return nullptr;
+        // copy out so a slow factory does not block registering
+        factory = it->second;
+    }
+    return factory(info);
+}
+
+VOL_END
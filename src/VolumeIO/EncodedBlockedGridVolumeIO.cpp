@@ -1,9 +1,11 @@
 #include <VolumeUtils/Volume.hpp>
 #include "../Common/Common.hpp"
+#include "../Common/SIMD.hpp"
 #include "../Common/Utils.hpp"
 #include <json.hpp>
 #include <algorithm>
 #include <fstream>
+#include <mutex>
 #include <source_location>
 
 VOL_BEGIN
@@ -12,9 +14,46 @@ namespace{
 
 #define ENCODED_BLOCKED_GRID_VOLUME_FILE_ID 0x7ffffebfLL
 #define MAKE_VERSION(x,y,z) ((x << 32) | (y << 16) | z)
-#define ENCODED_BLOCKED_GRID_VOLUME_FILE_VERSION MAKE_VERSION(1uLL,0uLL,0uLL)
+// 1.1.0 : keyframe offset table after block data
+// 1.2.0 : per block quantization of float32 volume in BlockInfo
+#define ENCODED_BLOCKED_GRID_VOLUME_FILE_VERSION MAKE_VERSION(1uLL,2uLL,0uLL)
 #define INVALID_BLOCK_INDEX 0x7f7f7f7f
 #define META_FILE_HEADER_SIZE 128ull
+    /**
+     * @brief Whether the first picture nal in an annex b hevc packet is an IRAP(types 16 to 21) one.
+     */
+    bool IsHevcKeyframePacket(const uint8_t* ptr, size_t size){
+        for(size_t i = 0; i + 3 < size; i++){
+            if(ptr[i] != 0 || ptr[i + 1] != 0 || ptr[i + 2] != 1) continue;
+            int nal_type = (ptr[i + 3] >> 1) & 0x3f;
+            // skip parameter sets and sei before the first picture
+            if(nal_type >= 32) continue;
+            return nal_type >= 16 && nal_type <= 21;
+        }
+        return false;
+    }
+
+    /**
+     * @param ptr packet records : [(packet_size)(packet_data)]...
+     * @return packet count
+     */
+    size_t ScanPacketRecords(const uint8_t* ptr, size_t size, std::vector<size_t>* keyframe_offsets){
+        size_t offset = 0, count = 0;
+        while(offset + sizeof(size_t) <= size){
+            size_t packet_size = *reinterpret_cast<const size_t*>(ptr + offset);
+            if(keyframe_offsets && IsHevcKeyframePacket(ptr + offset + sizeof(size_t), std::min(packet_size, size - offset - sizeof(size_t))))
+                keyframe_offsets->push_back(offset);
+            offset += sizeof(size_t) + packet_size;
+            count++;
+        }
+        return count;
+    }
+
+    struct BlockQuantization{
+        float scale = 0; // 0 if the block is not quantized
+        float offset = 0;
+    };
+
     // store according to space, use xierbote curve?
     class EncodedBlockedGridVolumeFile{
         struct Header{
@@ -34,7 +73,14 @@ namespace{
             size_t offset = 0; // offset to file beg
             size_t size = 0; // total write file size for this block data, this is larger than encode size
             size_t packet_count = 0; // option for video codec
-            char preserve[24];
+            // option for video codec, keyframe_count offsets(size_t) to block offset are stored after block data,
+            // each one is the start of the packet record of a keyframe
+            uint32_t keyframe_count = 0;
+            uint32_t keyframe_interval = 0;
+            // option for float32 volume, block is stored quantized as v = q * quant_scale + quant_offset
+            float quant_scale = 0;
+            float quant_offset = 0;
+            char preserve[8];
         };
         static constexpr size_t BlockInfoSize = 64;
         static_assert(sizeof(BlockInfo) == BlockInfoSize, "");
@@ -126,6 +172,10 @@ namespace{
             encoded_block[padding] = desc.padding;
             encoded_block[volume_codec] = VolumeCodecToStr(desc.codec);
             encoded_block[data_path] = desc.data_path;
+            if(desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO || desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO)
+                WriteEncodeSettingsToJson(desc.encode_settings, encoded_block);
+            if(desc.voxel_info.type == VoxelType::float32)
+                encoded_block[quantized_type] = VoxelTypeToStr(desc.quantized_type);
 
             header.block_length = desc.block_length;
             header.padding = desc.padding;
@@ -152,12 +202,47 @@ namespace{
             return read_size;
         }
 
+        /**
+         * @param beg offset to block beg.
+         */
+        size_t ReadBlockRange(const BlockIndex& blockIndex, size_t beg, void* buf, size_t size){
+            if(mp.count(blockIndex) == 0) return 0;
+            auto& block = mp.at(blockIndex);
+            if(beg >= block.size) return 0;
+            auto read_size = std::min(size, block.size - beg);
+            fs.seekg(block.offset + beg, std::ios::beg);
+            fs.read(reinterpret_cast<char*>(buf), read_size);
+            return read_size;
+        }
+
         size_t GetBlockSize(const BlockIndex& blockIndex) const{
             if(mp.count(blockIndex) == 0) return 0;
             return mp.at(blockIndex).size;
         }
 
-        void WriteBlock(const BlockIndex& blockIndex, const void* buf, size_t size, size_t packet_count = 0){
+        BlockQuantization GetBlockQuantization(const BlockIndex& blockIndex) const{
+            if(mp.count(blockIndex) == 0) return {};
+            auto& block = mp.at(blockIndex);
+            return {block.quant_scale, block.quant_offset};
+        }
+
+        /**
+         * @return keyframe interval, 0 if the block has no keyframe table.
+         */
+        uint32_t ReadKeyframeTable(const BlockIndex& blockIndex, std::vector<size_t>& keyframe_offsets){
+            keyframe_offsets.clear();
+            if(mp.count(blockIndex) == 0) return 0;
+            auto& block = mp.at(blockIndex);
+            if(block.keyframe_count == 0 || block.keyframe_interval == 0) return 0;
+            keyframe_offsets.resize(block.keyframe_count);
+            fs.seekg(block.offset + block.size, std::ios::beg);
+            fs.read(reinterpret_cast<char*>(keyframe_offsets.data()), block.keyframe_count * sizeof(size_t));
+            return block.keyframe_interval;
+        }
+
+        void WriteBlock(const BlockIndex& blockIndex, const void* buf, size_t size, size_t packet_count = 0,
+                        const std::vector<size_t>& keyframe_offsets = {}, uint32_t keyframe_interval = 0,
+                        const BlockQuantization& quant = {}){
             if(!fs.is_open()) return;
             if(mp.count(blockIndex) != 0) return;
             fs.seekp(0, std::ios::end);
@@ -167,7 +252,14 @@ namespace{
             block.offset = offset;
             block.size = size;
             block.packet_count = packet_count;
+            block.quant_scale = quant.scale;
+            block.quant_offset = quant.offset;
             fs.write(reinterpret_cast<const char*>(buf), size);
+            if(!keyframe_offsets.empty() && keyframe_interval > 0){
+                block.keyframe_count = keyframe_offsets.size();
+                block.keyframe_interval = keyframe_interval;
+                fs.write(reinterpret_cast<const char*>(keyframe_offsets.data()), keyframe_offsets.size() * sizeof(size_t));
+            }
         }
         void Close(){
             if(fs.is_open())
@@ -188,12 +280,78 @@ namespace{
 class EncodedBlockedGridVolumeReaderPrivate{
 public:
     EncodedBlockedGridVolumeDesc desc;
-    std::unique_ptr<CVolumeCodecInterface> video_codec;
+    std::unique_ptr<CVolumeCodecInterface> codec;
     EncodedBlockedGridVolumeFile file;
+    // file stream is shared by decode workers
+    std::mutex file_mtx;
 
     size_t block_bytes;
     // used for cache read buffer by ReadVolumeData, ReadBlockData will not use it.
     std::vector<uint8_t> block_data;
+    // decoded integer block of float32 volume before dequantize
+    std::vector<uint8_t> quant_data;
+
+    // each worker owns a codec and scratch buffers, kept between ReadVolumeData calls
+    struct DecodeWorker{
+        std::unique_ptr<CVolumeCodecInterface> codec;
+        std::vector<uint8_t> encoded_data;
+        std::vector<uint8_t> block_data;
+        std::vector<uint8_t> quant_data;
+        Packets packets;
+    };
+    std::vector<DecodeWorker> decode_workers;
+
+    void PrepareDecodeWorkers(int worker_count){
+        if(worker_count <= 0 || decode_workers.size() >= (size_t)worker_count) return;
+        // split cores between workers instead of giving every codec all of them
+        const int codec_threads = std::max<int>(1, std::thread::hardware_concurrency() / worker_count);
+        decode_workers.resize(worker_count);
+        for(auto& worker : decode_workers){
+            if(worker.codec) continue;
+            worker.codec = CreateCPUVolumeCodecByDesc(desc, codec_threads);
+            if(!worker.codec){
+                throw VolumeFileContextError("Failed to create volume codec : " + std::string(VolumeCodecToStr(desc.codec)));
+            }
+            worker.block_data.resize(block_bytes, 0);
+        }
+    }
+
+    bool IsQuantized() const{
+        return desc.voxel_info.type == VoxelType::float32;
+    }
+
+    /**
+     * @brief Decode packets of a block, float32 block is decoded to quant_scratch first then dequantized into buf.
+     * @param extend may be part of the block for slice decode.
+     */
+    void DecodeBlock(CVolumeCodecInterface& block_codec, const Extend3D& extend, const Packets& packets,
+                     const BlockIndex& blockIndex, std::vector<uint8_t>& quant_scratch, void* buf, size_t size){
+        if(!IsQuantized()){
+            block_codec.Decode(extend, packets, buf, size);
+            return;
+        }
+        const size_t count = size / sizeof(float);
+        const size_t quant_size = count * GetVoxelSize(GetCodecVoxelInfo(desc));
+        quant_scratch.resize(quant_size);
+        block_codec.Decode(extend, packets, quant_scratch.data(), quant_size);
+        BlockQuantization quant;
+        {
+            std::lock_guard<std::mutex> lk(file_mtx);
+            quant = file.GetBlockQuantization(blockIndex);
+        }
+        auto dst = reinterpret_cast<float*>(buf);
+        if(desc.quantized_type == VoxelType::uint8)
+            dequantize_to_float(quant_scratch.data(), count, dst, quant.scale, quant.offset);
+        else
+            dequantize_to_float(reinterpret_cast<const uint16_t*>(quant_scratch.data()), count, dst, quant.scale, quant.offset);
+    }
+
+    size_t ReadEncodedBlock(const BlockIndex& blockIndex, std::vector<uint8_t>& encoded){
+        std::lock_guard<std::mutex> lk(file_mtx);
+        auto size = file.GetBlockSize(blockIndex);
+        encoded.resize(size);
+        return file.ReadBlock(blockIndex, encoded.data(), size);
+    }
 
     bool CheckValidation(const BlockIndex& blockIndex) const{
         const auto block_length = desc.block_length;
@@ -218,9 +376,9 @@ EncodedBlockedGridVolumeReader::EncodedBlockedGridVolumeReader(const std::string
     _->block_bytes = buffer_length * buffer_length * buffer_length * GetVoxelSize(_->desc.voxel_info);
     _->block_data.resize(_->block_bytes, 0);
 
-    _->video_codec = CreateCPUVolumeVideoCodecByVoxel(_->desc.voxel_info);
-    if(!_->video_codec){
-        throw VolumeFileContextError("Failed to create volume video codec");
+    _->codec = CreateCPUVolumeCodecByDesc(_->desc);
+    if(!_->codec){
+        throw VolumeFileContextError("Failed to create volume codec : " + std::string(VolumeCodecToStr(_->desc.codec)));
     }
 }
 
@@ -248,52 +406,78 @@ void EncodedBlockedGridVolumeReader::ReadVolumeData(int srcX, int srcY, int srcZ
     const int block_length = _->desc.block_length;
     const int padding = _->desc.padding;
     const int buffer_length = block_length + padding * 2;
+    const int block_count_x = (_->desc.extend.width + block_length - 1) / block_length;
+    const int block_count_y = (_->desc.extend.height + block_length - 1) / block_length;
+    const int block_count_z = (_->desc.extend.depth + block_length - 1) / block_length;
     auto get_index = [block_length](int x){
-        return x / block_length;
+        return x >= 0 ? x / block_length : (x - block_length + 1) / block_length;
+    };
+    // every voxel is copied from the block owns it, padding of a block is only used outside the volume,
+    // so blocks decoded by different workers never write the same voxel
+    auto get_owned_range = [block_length, padding](int block, int block_count){
+        int beg = block == 0 ? -padding : block * block_length;
+        int end = block == block_count - 1 ? (block + 1) * block_length + padding : (block + 1) * block_length;
+        return std::make_pair(beg, end);
     };
     //[src, dst)
     //[beg, end)
-    const int width = _->desc.extend.width;
-    const int height = _->desc.extend.height;
-    const int depth = _->desc.extend.depth;
-    const int beg_block_x = get_index(std::max<int>(0, srcX + padding));
-    const int end_block_x = get_index(std::min<int>(width, dstX - padding) + block_length - 1);
-    const int beg_block_y = get_index(std::max<int>(0, srcY + padding));
-    const int end_block_y = get_index(std::min<int>(height, dstY - padding) + block_length - 1);
-    const int beg_block_z = get_index(std::max<int>(0, srcZ + padding));
-    const int end_block_z = get_index(std::min<int>(depth, dstZ - padding) + block_length - 1 );
+    const int beg_block_x = std::clamp(get_index(srcX), 0, block_count_x - 1);
+    const int end_block_x = std::clamp(get_index(dstX - 1), 0, block_count_x - 1) + 1;
+    const int beg_block_y = std::clamp(get_index(srcY), 0, block_count_y - 1);
+    const int end_block_y = std::clamp(get_index(dstY - 1), 0, block_count_y - 1) + 1;
+    const int beg_block_z = std::clamp(get_index(srcZ), 0, block_count_z - 1);
+    const int end_block_z = std::clamp(get_index(dstZ - 1), 0, block_count_z - 1) + 1;
 
     size_t voxel_size = GetVoxelSize(_->desc.voxel_info);
-    const auto src_ptr = _->block_data.data();
-    auto fill_reader = [&, block_size = buffer_length](const BlockIndex& block_idx){
+    auto fill_reader = [&, block_size = buffer_length](const BlockIndex& block_idx, const uint8_t* src_ptr){
         assert(_->CheckValidation(block_idx));
-        const int beg_x = std::max<int>(block_idx.x * block_length - padding, srcX);
-        const int end_x = std::min<int>((block_idx.x + 1) * block_length + padding, dstX);
-        const int beg_y = std::max<int>(block_idx.y * block_length - padding, srcY);
-        const int end_y = std::min<int>((block_idx.y + 1) * block_length + padding, dstY);
-        const int beg_z = std::max<int>(block_idx.z * block_length - padding, srcZ);
-        const int end_z = std::min<int>((block_idx.z + 1) * block_length + padding, dstZ);
-        const int block_size2 = block_size * block_size;
+        auto [own_beg_x, own_end_x] = get_owned_range(block_idx.x, block_count_x);
+        auto [own_beg_y, own_end_y] = get_owned_range(block_idx.y, block_count_y);
+        auto [own_beg_z, own_end_z] = get_owned_range(block_idx.z, block_count_z);
+        const int beg_x = std::max<int>(own_beg_x, srcX);
+        const int end_x = std::min<int>(own_end_x, dstX);
+        const int beg_y = std::max<int>(own_beg_y, srcY);
+        const int end_y = std::min<int>(own_end_y, dstY);
+        const int beg_z = std::max<int>(own_beg_z, srcZ);
+        const int end_z = std::min<int>(own_end_z, dstZ);
+        if(beg_x >= end_x || beg_y >= end_y || beg_z >= end_z) return;
+        // origin of the block buffer in volume space
+        const int ori_x = block_idx.x * block_length - padding;
+        const int ori_y = block_idx.y * block_length - padding;
+        const int ori_z = block_idx.z * block_length - padding;
+        const size_t block_size2 = (size_t)block_size * block_size;
         size_t x_voxel_size = (end_x - beg_x) * voxel_size;
         for(int z = beg_z; z < end_z; z++){
             for(int y = beg_y; y < end_y; y++){
-                size_t src_offset = ((size_t)block_size2 * (z - beg_z ) + block_size * (y - beg_y ) ) * voxel_size;
+                size_t src_offset = (block_size2 * (z - ori_z) + (size_t)block_size * (y - ori_y) + (beg_x - ori_x)) * voxel_size;
                 size_t dst_offset =  ((size_t)(z - srcZ) * (dstX - srcX) * (dstY - srcY) + (size_t)(y - srcY) * (dstX - srcX) + beg_x - srcX) * voxel_size;
                 std::memcpy(reinterpret_cast<uint8_t*>(buf) + dst_offset, src_ptr + src_offset, x_voxel_size);
             }
         }
     };
-    VOL_WHEN_DEBUG(std::cout << "start read volume data" << std::endl)
+    std::vector<BlockIndex> blocks;
     for(int block_z = beg_block_z; block_z < end_block_z; block_z++){
         for(int block_y = beg_block_y; block_y < end_block_y; block_y++){
             for(int block_x = beg_block_x; block_x < end_block_x; block_x++){
-                const BlockIndex block_idx = {block_x, block_y, block_z};
-                ReadBlockData(block_idx, _->block_data.data());
-                fill_reader(block_idx);
-                VOL_WHEN_DEBUG(std::cout << "read block : " << block_idx << std::endl)
+                blocks.push_back({block_x, block_y, block_z});
             }
         }
     }
+    VOL_WHEN_DEBUG(std::cout << "start read volume data, block count : " << blocks.size() << std::endl)
+    const int worker_count = std::min<int>(actual_worker_count(0), blocks.size());
+    // region outside of the volume
+    if(worker_count == 0) return;
+    _->PrepareDecodeWorkers(worker_count);
+    const Extend3D block_extend = {(uint32_t)buffer_length, (uint32_t)buffer_length, (uint32_t)buffer_length};
+    parallel_foreach(blocks, [&](int thread_index, const BlockIndex& block_idx){
+        auto& worker = _->decode_workers[thread_index];
+        _->ReadEncodedBlock(block_idx, worker.encoded_data);
+        worker.packets.clear();
+        ParsePacketRecords(worker.encoded_data.data(), worker.encoded_data.size(), worker.packets);
+        _->DecodeBlock(*worker.codec, block_extend, worker.packets, block_idx, worker.quant_data, worker.block_data.data(), _->block_bytes);
+        fill_reader(block_idx, worker.block_data.data());
+        VOL_WHEN_DEBUG(std::cout << "read block : " << block_idx << std::endl)
+    }, worker_count);
     VOL_WHEN_DEBUG(std::cout << "finish read volume data" << std::endl;)
 #endif
 }
@@ -360,8 +544,7 @@ void EncodedBlockedGridVolumeReader::ReadBlockData(const BlockIndex &blockIndex,
     Packets packets;
     ReadEncodedBlockData(blockIndex, packets);
     // invoke ReadBlockData next is ok but may loss efficient
-    const uint32_t bl = _->desc.block_length + 2 * _->desc.padding;
-    _->video_codec->Decode({bl, bl, bl}, packets, buf, _->block_bytes);
+    DecodeBlockData(blockIndex, packets, buf);
 //    if(blockIndex == BlockIndex{1, 2, 1}){
 //        std::ofstream out("H:/Volume/test_decoding#block1#2#1#_256_256_256_uint8.raw", std::ios::binary);
 //        out.write(reinterpret_cast<const char*>(_->block_data.data()), _->block_bytes);
@@ -370,6 +553,12 @@ void EncodedBlockedGridVolumeReader::ReadBlockData(const BlockIndex &blockIndex,
 //    }
 }
 
+void EncodedBlockedGridVolumeReader::DecodeBlockData(const BlockIndex &blockIndex, const Packets &packets, void *buf) {
+    assert(_->CheckValidation(blockIndex) && buf);
+    const uint32_t bl = _->desc.block_length + 2 * _->desc.padding;
+    _->DecodeBlock(*_->codec, {bl, bl, bl}, packets, blockIndex, _->quant_data, buf, _->block_bytes);
+}
+
 void EncodedBlockedGridVolumeReader::ReadBlockData(const BlockIndex &blockIndex, VolumeReadFunc reader) {
     assert(_->CheckValidation(blockIndex) && reader);
 
@@ -390,44 +579,79 @@ void EncodedBlockedGridVolumeReader::ReadBlockData(const BlockIndex &blockIndex,
     }
 }
 
+void EncodedBlockedGridVolumeReader::ReadBlockSlices(const BlockIndex &blockIndex, int z0, int z1, void *buf) {
+    const int bl = _->desc.block_length + 2 * _->desc.padding;
+    assert(_->CheckValidation(blockIndex) && 0 <= z0 && z0 < z1 && z1 <= bl && buf);
+
+    const size_t slice_bytes = (size_t)bl * bl * GetVoxelSize(_->desc.voxel_info);
+    std::vector<size_t> keyframe_offsets;
+    uint32_t keyframe_interval = 0;
+    size_t block_size = 0;
+    {
+        std::lock_guard<std::mutex> lk(_->file_mtx);
+        keyframe_interval = _->file.ReadKeyframeTable(blockIndex, keyframe_offsets);
+        block_size = _->file.GetBlockSize(blockIndex);
+    }
+    if(keyframe_interval == 0){
+        ReadBlockData(blockIndex, _->block_data.data());
+        std::memcpy(buf, _->block_data.data() + z0 * slice_bytes, (z1 - z0) * slice_bytes);
+        return;
+    }
+    // decode from the keyframe before z0 and stop at the one after z1
+    const int key_beg = z0 / keyframe_interval;
+    const int key_end = std::min<int>(keyframe_offsets.size(), (z1 - 1) / keyframe_interval + 1);
+    const size_t beg = keyframe_offsets[key_beg];
+    const size_t end = (size_t)key_end < keyframe_offsets.size() ? keyframe_offsets[key_end] : block_size;
+    const int frame_beg = key_beg * keyframe_interval;
+    const int frame_end = std::min<int>(bl, key_end * keyframe_interval);
+
+    std::vector<uint8_t> encoded(end - beg);
+    {
+        std::lock_guard<std::mutex> lk(_->file_mtx);
+        _->file.ReadBlockRange(blockIndex, beg, encoded.data(), encoded.size());
+    }
+    Packets packets;
+    ParsePacketRecords(encoded.data(), encoded.size(), packets);
+    const Extend3D extend = {(uint32_t)bl, (uint32_t)bl, (uint32_t)(frame_end - frame_beg)};
+    _->DecodeBlock(*_->codec, extend, packets, blockIndex, _->quant_data, _->block_data.data(), (frame_end - frame_beg) * slice_bytes);
+    std::memcpy(buf, _->block_data.data() + (z0 - frame_beg) * slice_bytes, (z1 - z0) * slice_bytes);
+}
+
 size_t EncodedBlockedGridVolumeReader::ReadEncodedBlockData(const BlockIndex &blockIndex, Packets &packets) {
     assert(_->CheckValidation(blockIndex));
 
-    auto size = _->file.GetBlockSize(blockIndex);
-    uint8_t* ptr;
     std::vector<uint8_t> tmp;
-    if(size <= _->block_bytes) ptr = _->block_data.data();
-    else {
-        tmp.resize(size, 0);
-        ptr = tmp.data();
-    }
-    auto ret = _->file.ReadBlock(blockIndex, ptr, size);
-    size_t offset = 0;
-    while(offset < size){
-        size_t packet_size = *reinterpret_cast<size_t*>(ptr + offset);
-        auto& packet_buffer = packets.emplace_back();
-        packet_buffer.resize(packet_size, 0);
-        offset += 8;
-        std::memcpy(packet_buffer.data(), ptr + offset , packet_size);
-        offset += packet_size;
-    }
+    auto ret = _->ReadEncodedBlock(blockIndex, tmp);
+    auto offset = ParsePacketRecords(tmp.data(), ret, packets);
     assert(ret == offset);
     return ret;
 }
 
 size_t EncodedBlockedGridVolumeReader::ReadEncodedBlockData(const BlockIndex &blockIndex, void *buf, size_t size) {
     assert(_->CheckValidation(blockIndex));
+    std::lock_guard<std::mutex> lk(_->file_mtx);
     return _->file.ReadBlock(blockIndex, buf, size);
 }
 
+std::pair<float, float> EncodedBlockedGridVolumeReader::GetBlockQuantization(const BlockIndex &blockIndex) const {
+    assert(_->CheckValidation(blockIndex));
+    std::lock_guard<std::mutex> lk(_->file_mtx);
+    auto quant = _->file.GetBlockQuantization(blockIndex);
+    return {quant.scale, quant.offset};
+}
+
 class EncodedBlockedGridVolumeWriterPrivate{
 public:
     EncodedBlockedGridVolumeDesc desc;
-    std::unique_ptr<CVolumeCodecInterface> video_codec;
+    std::unique_ptr<CVolumeCodecInterface> codec;
     EncodedBlockedGridVolumeFile file;
 
     size_t block_bytes;
     std::vector<uint8_t> block_data;
+    // quantized block of float32 volume
+    std::vector<uint8_t> quant_data;
+    // encoded records of the block being written
+    PacketArena arena;
 
     bool CheckValidation(const BlockIndex& blockIndex) const{
         const auto block_length = desc.block_length;
@@ -454,9 +678,9 @@ EncodedBlockedGridVolumeWriter::EncodedBlockedGridVolumeWriter(const std::string
     _->block_bytes = buffer_length * buffer_length * buffer_length * GetVoxelSize(_->desc.voxel_info);
     _->block_data.resize(_->block_bytes, 0);
 
-    _->video_codec = CreateCPUVolumeVideoCodecByVoxel(_->desc.voxel_info);
-    if(!_->video_codec){
-        throw VolumeFileContextError("Failed to create volume video codec");
+    _->codec = CreateCPUVolumeCodecByDesc(_->desc);
+    if(!_->codec){
+        throw VolumeFileContextError("Failed to create volume codec : " + std::string(VolumeCodecToStr(_->desc.codec)));
     }
 }
 
@@ -638,9 +862,30 @@ void EncodedBlockedGridVolumeWriter::WriteBlockData(const BlockIndex &blockIndex
 
     assert(_->CheckValidation(blockIndex) && buf);    
 
-    Packets packets;
+    // records are appended straight into the arena and written as is
+    _->arena.clear();
     const uint32_t bl = _->desc.block_length + 2 * _->desc.padding;
-    _->video_codec->Encode({bl, bl, bl}, buf, _->block_bytes, packets);
+    if(_->desc.voxel_info.type == VoxelType::float32){
+        // map [min, max] of the block to the full range of the quantized type
+        const size_t count = _->block_bytes / sizeof(float);
+        auto src = reinterpret_cast<const float*>(buf);
+        auto [lo, hi] = find_finite_min_max(src, count);
+        const bool is_uint8 = _->desc.quantized_type == VoxelType::uint8;
+        const float max_q = static_cast<float>(GetQuantizedMaxValue(_->desc));
+        const float scale = hi > lo ? (hi - lo) / max_q : 1.f;
+        const size_t quant_size = count * (is_uint8 ? 1 : 2);
+        _->quant_data.resize(quant_size);
+        if(is_uint8)
+            quantize_from_float(src, count, _->quant_data.data(), scale, lo);
+        else
+            quantize_from_float(src, count, reinterpret_cast<uint16_t*>(_->quant_data.data()), scale, lo);
+        _->codec->Encode({bl, bl, bl}, _->quant_data.data(), quant_size, _->arena);
+        WriteEncodedBlockData(blockIndex, _->arena.data(), _->arena.size(), scale, lo);
+    }
+    else{
+        _->codec->Encode({bl, bl, bl}, buf, _->block_bytes, _->arena);
+        WriteEncodedBlockData(blockIndex, _->arena.data(), _->arena.size());
+    }
 //    VOL_WHEN_DEBUG({
 //        auto p = reinterpret_cast<const uint8_t*>(buf);
 //                       std::vector<uint8_t> table(256, 0);
@@ -656,11 +901,10 @@ void EncodedBlockedGridVolumeWriter::WriteBlockData(const BlockIndex &blockIndex
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
     std::cout << std::format("{} takes {}.\n", std::source_location::current().function_name(), duration);
 #endif // VOL_DUBUG
-
-    WriteEncodedBlockData(blockIndex, packets);
 }
 
-void EncodedBlockedGridVolumeWriter::WriteEncodedBlockData(const BlockIndex &blockIndex, const Packets &packets) {
+void EncodedBlockedGridVolumeWriter::WriteEncodedBlockData(const BlockIndex &blockIndex, const Packets &packets,
+                                                           float quantScale, float quantOffset) {
 #ifdef VOL_DEBUG
     auto startTime = std::chrono::system_clock::now();
 #endif // VOL_DEBUG
@@ -694,17 +938,38 @@ void EncodedBlockedGridVolumeWriter::WriteEncodedBlockData(const BlockIndex &blo
     std::cout << std::format("{} takes {}.\n", std::source_location::current().function_name(), duration);
 #endif // VOL_DUBUG
 
-    WriteEncodedBlockData(blockIndex, buf, buf_size);
+    WriteEncodedBlockData(blockIndex, buf, buf_size, quantScale, quantOffset);
 }
 
-void EncodedBlockedGridVolumeWriter::WriteEncodedBlockData(const BlockIndex &blockIndex, const void *buf, size_t size) {
+void EncodedBlockedGridVolumeWriter::WriteEncodedBlockData(const BlockIndex &blockIndex, const void *buf, size_t size,
+                                                           float quantScale, float quantOffset) {
 #ifdef VOL_DEBUG
     auto startTime = std::chrono::system_clock::now();
 #endif // VOL_DEBUG
 
     assert(_->CheckValidation(blockIndex) && buf && size);
+    const bool is_quantized = _->desc.voxel_info.type == VoxelType::float32;
+    if(is_quantized && !(quantScale > 0.f)){
+        throw VolumeFileContextError("WriteEncodedBlockData of float32 volume needs a positive quantization scale");
+    }
 
-    _->file.WriteBlock(blockIndex, buf, size);
+    auto ptr = reinterpret_cast<const uint8_t*>(buf);
+    // multi-channel blocks hold one stream per channel, slices can not be located by a single keyframe table
+    const uint32_t keyframe_interval = _->desc.codec == GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO
+            && GetVoxelSampleCount(_->desc.voxel_info.format) == 1
+            ? std::max(0, _->desc.encode_settings.keyframe_interval) : 0;
+    std::vector<size_t> keyframe_offsets;
+    auto packet_count = ScanPacketRecords(ptr, size, keyframe_interval ? &keyframe_offsets : nullptr);
+    if(keyframe_interval){
+        const uint32_t frame_count = _->desc.block_length + 2 * _->desc.padding;
+        if(keyframe_offsets.size() != (frame_count + keyframe_interval - 1) / keyframe_interval){
+            // encoder did not follow the interval, keep the block decodable as a whole only
+            VOL_WHEN_DEBUG(std::cout << "unexpected keyframe count " << keyframe_offsets.size() << " for block " << blockIndex << std::endl)
+            keyframe_offsets.clear();
+        }
+    }
+    _->file.WriteBlock(blockIndex, buf, size, packet_count, keyframe_offsets, keyframe_interval,
+                       is_quantized ? BlockQuantization{quantScale, quantOffset} : BlockQuantization{});
 
 #ifdef VOL_DEBUG
     auto endTime = std::chrono::system_clock::now();
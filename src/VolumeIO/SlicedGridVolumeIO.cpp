@@ -1,5 +1,5 @@
 #include <VolumeUtils/Volume.hpp>
-#include "../Common/LRU.hpp"
+#include "../Common/ClockCache.hpp"
 #include "../Common/Utils.hpp"
 #include "../Common/Common.hpp"
 #include <fstream>
@@ -238,16 +238,57 @@ public:
     SlicedGridVolumeDesc desc;
     std::unique_ptr<SliceIOWrapper> slice_io_wrapper;
 
+    using SliceCache = clock_cache_t<int, std::vector<uint8_t>>;
+
     bool use_cache = false;
     int max_cached_slice_num = 0;
-    std::vector<std::vector<uint8_t>> buffers;
-    std::unique_ptr<lru_cache_t<int,uint8_t*>> slice_cache;
+    std::unique_ptr<SliceCache> slice_cache;
+    // keep the slice last read from cache pinned while it is copied out
+    SliceCache::handle_t slice_handle;
+    // buffers of evicted slices, reused for next miss
+    std::vector<std::vector<uint8_t>> spare_buffers;
 
     size_t slice_bytes = 0;
     int slice_index = -1;
     std::vector<uint8_t> slice_data;
 
     SlicedGridVolumeFile file;
+
+    void ReadSliceFromFile(int sliceIndex, uint8_t* dst){
+        slice_io_wrapper->Open(desc.name_generator(sliceIndex) + file.GetSliceDataFormat(), "r");
+        auto ret = slice_io_wrapper->Read(dst, slice_bytes);
+        if(ret != slice_bytes){
+            throw VolumeFileIOError("ReadSliceData size is not right : " + std::to_string(ret) + " , expect size : " + std::to_string(slice_bytes));
+        }
+    }
+
+    /**
+     * @param dst caller owned slice sized buffer, filled instead when the cache can not hold the slice.
+     */
+    const uint8_t* GetCachedSlice(int sliceIndex, uint8_t* dst){
+        assert(slice_cache && dst);
+        slice_handle = slice_cache->get(sliceIndex);
+        if(slice_handle) return slice_handle->data();
+        // budget is smaller than one slice, every insert would be rejected
+        if(max_cached_slice_num == 0){
+            ReadSliceFromFile(sliceIndex, dst);
+            return dst;
+        }
+
+        std::vector<uint8_t> buffer;
+        if(!spare_buffers.empty()){
+            buffer = std::move(spare_buffers.back());
+            spare_buffers.pop_back();
+        }
+        buffer.resize(slice_bytes);
+        ReadSliceFromFile(sliceIndex, buffer.data());
+        slice_handle = slice_cache->insert(sliceIndex, std::move(buffer), slice_bytes);
+        if(slice_handle) return slice_handle->data();
+        // rejected value is not moved from, keep it for next miss
+        std::memcpy(dst, buffer.data(), slice_bytes);
+        spare_buffers.push_back(std::move(buffer));
+        return dst;
+    }
 };
 
 
@@ -272,7 +313,8 @@ SlicedGridVolumeReader::SlicedGridVolumeReader(const std::string &filename) {
     _->slice_bytes = (size_t)_->desc.extend.width * _->desc.extend.height * GetVoxelSize(_->desc.voxel_info);
     _->slice_data.resize(_->slice_bytes, 0);
 
-    _->max_cached_slice_num = VolumeMemorySettings::MaxSlicedGridMemoryUsageBytes / _->slice_bytes;
+    _->max_cached_slice_num = (int)std::min<size_t>(VolumeMemorySettings::MaxSlicedGridMemoryUsageBytes / _->slice_bytes,
+                                                    _->desc.extend.depth);
 }
 
 SlicedGridVolumeReader::~SlicedGridVolumeReader() {
@@ -330,38 +372,19 @@ void SlicedGridVolumeReader::ReadSliceData(int sliceIndex, void *buf) {
     auto size = _->slice_bytes;
     //maybe optimal...
     if(_->use_cache){
-        assert(_->slice_cache);
-        if(auto cached = _->slice_cache->get_value_optional(sliceIndex)){
-            // copy from cache to buf
-            std::copy(cached.value(), cached.value() + size, reinterpret_cast<uint8_t*>(buf));
-            return;
-        }
-        else{
-            _->slice_io_wrapper->Open(_->desc.name_generator(sliceIndex) + _->file.GetSliceDataFormat(), "r");
-            auto& updated = _->slice_cache->get_back();
-            updated.first = sliceIndex;
-            // check size
-            auto ret = _->slice_io_wrapper->Read(updated.second, _->slice_bytes);
-            if(ret != _->slice_bytes){
-                throw VolumeFileIOError("ReadSliceData size is not right : " + std::to_string(ret) + " , expect size : " + std::to_string(_->slice_bytes));
-            }
-            // copy to buf
-            std::copy(updated.second, updated.second + size, reinterpret_cast<uint8_t*>(buf));
-            _->slice_cache->get_value_ptr(sliceIndex);
-            return;
-        }
+        auto cached = _->GetCachedSlice(sliceIndex, reinterpret_cast<uint8_t*>(buf));
+        if(cached != buf)
+            std::memcpy(buf, cached, size);
+        return;
     }
     else{
         if(_->slice_index == sliceIndex){
-            std::memcpy(buf, _->slice_data.data(), size);
+            if(buf != _->slice_data.data())
+                std::memcpy(buf, _->slice_data.data(), size);
             return;
         }
         else{
-            _->slice_io_wrapper->Open(_->desc.name_generator(sliceIndex) + _->file.GetSliceDataFormat(), "r");
-            auto ret =  _->slice_io_wrapper->Read(_->slice_data.data(), _->slice_bytes);
-            if(ret != _->slice_bytes){
-                throw VolumeFileIOError("ReadSliceData size is not right : " + std::to_string(ret) + " , expect size : " + std::to_string(_->slice_bytes));
-            }
+            _->ReadSliceFromFile(sliceIndex, _->slice_data.data());
             _->slice_index = sliceIndex;
             if(buf != _->slice_data.data())
                 std::memcpy(buf, _->slice_data.data(), size);
@@ -379,33 +402,14 @@ void SlicedGridVolumeReader::ReadSliceData(int sliceIndex, SliceReadFunc reader)
     auto slice_w = _->desc.extend.width;
     auto slice_h = _->desc.extend.height;
     if(_->use_cache){
-        assert(_->slice_cache);
-        if(auto cached = _->slice_cache->get_value_optional(sliceIndex)){
-            src_ptr = cached.value();
-        }
-        else{
-            _->slice_io_wrapper->Open(_->desc.name_generator(sliceIndex) + _->file.GetSliceDataFormat(), "r");
-            auto& updated = _->slice_cache->get_back();
-            updated.first = sliceIndex;
-            src_ptr = updated.second;
-            auto ret = _->slice_io_wrapper->Read(updated.second, _->slice_bytes);
-            if(ret != _->slice_bytes){
-                throw VolumeFileIOError("ReadSliceData size is not right : " + std::to_string(ret) + " , expect size : " + std::to_string(_->slice_bytes));
-            }
-            // change priority
-            _->slice_cache->get_value_ptr(sliceIndex);
-        }
+        src_ptr = _->GetCachedSlice(sliceIndex, _->slice_data.data());
     }
     else{
         if(_->slice_index == sliceIndex){
             src_ptr = _->slice_data.data();
         }
         else{
-            _->slice_io_wrapper->Open(_->desc.name_generator(sliceIndex) + _->file.GetSliceDataFormat(), "r");
-            auto ret =  _->slice_io_wrapper->Read(_->slice_data.data(),_->slice_bytes);
-            if(ret != _->slice_bytes){
-                throw VolumeFileIOError("ReadSliceData size is not right : " + std::to_string(ret) + " , expect size : " + std::to_string(_->slice_bytes));
-            }
+            _->ReadSliceFromFile(sliceIndex, _->slice_data.data());
             src_ptr = _->slice_data.data();
             _->slice_index = sliceIndex;
         }
@@ -482,20 +486,73 @@ void SlicedGridVolumeReader::ReadSliceData(int sliceIndex, int srcX, int srcY, i
     }
 }
 
-void SlicedGridVolumeReader::SetUseCached(bool useCached) noexcept {
-    if(useCached && _->buffers.empty()){
-        //init cache buffers
-        _->buffers.resize(_->max_cached_slice_num);
-        for(auto& b : _->buffers){
-            b.resize(_->slice_bytes, 0);
+void SlicedGridVolumeReader::ReadResliceData(SliceAxis axis, int begSlice, int endSlice, void *buf) {
+    assert(begSlice < endSlice && buf);
+    const int slice_w = _->desc.extend.width;
+    const int slice_h = _->desc.extend.height;
+    const int slice_d = _->desc.extend.depth;
+    const size_t voxel_size = GetVoxelSize(_->desc.voxel_info);
+    auto dst_ptr = reinterpret_cast<uint8_t*>(buf);
+
+    if(axis == SliceAxis::AXIS_Z){
+        for(int z = begSlice; z < endSlice; z++){
+            ReadSliceData(z, dst_ptr + (size_t)(z - begSlice) * _->slice_bytes);
+        }
+        return;
+    }
+    const int slice_count = axis == SliceAxis::AXIS_X ? slice_w : slice_h;
+    if(begSlice < 0 || endSlice > slice_count){
+        std::cerr << "ReadResliceData with invalid slice range : " << begSlice << " - " << endSlice << std::endl;
+        return;
+    }
+    const uint32_t count = endSlice - begSlice;
+    const size_t row_bytes = (size_t)slice_w * voxel_size;
+
+    if(axis == SliceAxis::AXIS_X){
+        // columns [begSlice, endSlice) of each stored slice become row z of every output slice
+        for(int z = 0; z < slice_d; z++){
+            ReadSliceData(z, _->slice_data.data());
+            TransposePlaneBytes(_->slice_data.data() + (size_t)begSlice * voxel_size, slice_w,
+                                dst_ptr + (size_t)z * slice_h * voxel_size, (size_t)slice_h * slice_d,
+                                slice_h, count, voxel_size);
+        }
+        return;
+    }
+
+    // AXIS_Y : gather rows [begSlice, endSlice) of a slab of stored slices, then transpose (z, x) planes of the slab
+    constexpr size_t MaxSlabBytes = size_t(64) << 20;
+    const size_t slab_row_bytes = count * row_bytes;
+    const int slab_depth = (int)std::clamp<size_t>(MaxSlabBytes / slab_row_bytes, 1, 64);
+    std::vector<uint8_t> slab((size_t)slab_depth * slab_row_bytes);
+    for(int z0 = 0; z0 < slice_d; z0 += slab_depth){
+        const int z1 = std::min(slice_d, z0 + slab_depth);
+        for(int z = z0; z < z1; z++){
+            ReadSliceData(z, _->slice_data.data());
+            std::memcpy(slab.data() + (size_t)(z - z0) * slab_row_bytes,
+                        _->slice_data.data() + (size_t)begSlice * row_bytes, slab_row_bytes);
         }
-        assert(_->slice_cache == nullptr);
-        _->slice_cache = std::make_unique<lru_cache_t<int,uint8_t*>>(_->max_cached_slice_num);
-        // just add buffers with invalid slice index
-        for(int i = 0; i < _->max_cached_slice_num; i++){
-            _->slice_cache->emplace_back(-i, _->buffers[i].data());
+        for(uint32_t i = 0; i < count; i++){
+            TransposePlaneBytes(slab.data() + i * row_bytes, (size_t)count * slice_w,
+                                dst_ptr + ((size_t)i * slice_d * slice_w + z0) * voxel_size, slice_d,
+                                z1 - z0, slice_w, voxel_size);
         }
     }
+}
+
+void SlicedGridVolumeReader::SetUseCached(bool useCached) noexcept {
+    if(useCached && !_->slice_cache){
+        // buffers are allocated on miss and recycled from evicted slices
+        _->slice_cache = std::make_unique<SlicedGridVolumeReaderPrivate::SliceCache>(
+                (size_t)_->max_cached_slice_num * _->slice_bytes, std::max(1, _->max_cached_slice_num));
+        _->slice_cache->set_evict_callback([this](const int&, std::vector<uint8_t>& buffer){
+            _->spare_buffers.push_back(std::move(buffer));
+        });
+    }
+    if(!useCached){
+        _->slice_handle.release();
+        // slice_data is used as scratch while cached, it no longer holds slice_index
+        _->slice_index = -1;
+    }
     _->use_cache = useCached;
 }
 
@@ -503,6 +560,16 @@ bool SlicedGridVolumeReader::GetIfUseCached() const noexcept {
     return _->use_cache;
 }
 
+void SlicedGridVolumeReader::ClearCache() {
+    _->slice_handle.release();
+    if(_->slice_cache) _->slice_cache->clear();
+    _->slice_index = -1;
+}
+
+const std::string& SlicedGridVolumeReader::GetSliceDataFormat() const noexcept {
+    return _->file.GetSliceDataFormat();
+}
+
 class SlicedGridVolumeWriterPrivate{
 public:
     SlicedGridVolumeDesc desc;
@@ -520,7 +587,7 @@ public:
 
 constexpr const char* DefaultSliceDataFormat = ".tif";
 
-SlicedGridVolumeWriter::SlicedGridVolumeWriter(const std::string &filename, const SlicedGridVolumeDesc& desc) {
+SlicedGridVolumeWriter::SlicedGridVolumeWriter(const std::string &filename, const SlicedGridVolumeDesc& desc, bool saveDesc) {
     if(!CheckValidation(desc)){
         throw VolumeFileContextError("Invalid SlicedGridVolumeDesc");
     }
@@ -528,7 +595,7 @@ SlicedGridVolumeWriter::SlicedGridVolumeWriter(const std::string &filename, cons
     _->desc = desc;
     _->desc.Generate();
     _->file.SetSliceDataFormat(DefaultSliceDataFormat);
-    _->file.Save(filename, desc);
+    if(saveDesc) _->file.Save(filename, desc);
 
     _->slice_info = {.width = (int)desc.extend.width, .height = (int)desc.extend.height,
                      .samplers_per_pixel = GetVoxelSampleCount(desc.voxel_info.format),
@@ -748,6 +815,12 @@ void SlicedGridVolumeWriter::Flush() {
     std::memset(_->slice_data.data(), 0, _->slice_data.size());
 }
 
+void SlicedGridVolumeWriter::Close() {
+    Flush();
+    _->slice_io_wrapper->Close();
+    _->slice_index = -1;
+}
+
 
 
 
@@ -1,8 +1,270 @@
 #include <VolumeUtils/Volume.hpp>
 
+#include "../Common/Utils.hpp"
+#include "../Common/Common.hpp"
+#include "../Common/Trilinear.hpp"
+
 VOL_BEGIN
 
+namespace{
+    Extend3D GetBlockDim(const BlockedGridVolumeDesc& desc){
+        auto dim = [&](uint32_t len){ return (len + desc.block_length - 1) / desc.block_length; };
+        return {dim(desc.extend.width), dim(desc.extend.height), dim(desc.extend.depth)};
+    }
+
+    size_t GetBlockedStorageBytes(const BlockedGridVolumeDesc& desc){
+        if(!CheckValidation(desc)){
+            PrintVolumeDesc(desc);
+            throw VolumeFileContextError("BlockedGridVolumeDesc is invalid for create BlockedGridVolume");
+        }
+        const size_t block_size = desc.block_length + 2 * desc.padding;
+        return GetBlockDim(desc).size() * block_size * block_size * block_size * GetVoxelSize(desc.voxel_info);
+    }
+}
+
+class BlockedGridVolumePrivate{
+public:
+    BlockedGridVolumeDesc desc;
+
+    int block_length = 0;
+    int padding = 0;
+    // block_length + 2 * padding
+    int block_size = 0;
+    size_t block_voxels = 0;
+    Extend3D block_dim;
+
+    // linear block index to brick slot in storage, slots follow Morton order of block index
+    std::vector<uint32_t> block_slot;
+
+    void Init(){
+        block_length = desc.block_length;
+        padding = desc.padding;
+        block_size = block_length + 2 * padding;
+        block_voxels = (size_t)block_size * block_size * block_size;
+        block_dim = GetBlockDim(desc);
+
+        const size_t block_count = block_dim.size();
+        std::vector<std::pair<uint64_t, uint32_t>> codes(block_count);
+        for(uint32_t z = 0; z < block_dim.depth; z++){
+            for(uint32_t y = 0; y < block_dim.height; y++){
+                for(uint32_t x = 0; x < block_dim.width; x++){
+                    auto idx = GetBlockLinearIndex(x, y, z);
+                    codes[idx] = {MortonEncode3D(x, y, z), (uint32_t)idx};
+                }
+            }
+        }
+        // ranking by code keeps the curve order without holes for non power of two dims
+        std::sort(codes.begin(), codes.end());
+        block_slot.resize(block_count);
+        for(size_t i = 0; i < block_count; i++)
+            block_slot[codes[i].second] = (uint32_t)i;
+    }
+
+    size_t GetBlockLinearIndex(int x, int y, int z) const noexcept {
+        return ((size_t)z * block_dim.height + y) * block_dim.width + x;
+    }
+
+    size_t GetBlockOffset(int x, int y, int z) const noexcept {
+        return block_slot[GetBlockLinearIndex(x, y, z)] * block_voxels;
+    }
+
+    bool IsValidBlock(const BlockIndex& idx) const noexcept {
+        return idx.x >= 0 && idx.y >= 0 && idx.z >= 0
+        && idx.x < (int)block_dim.width && idx.y < (int)block_dim.height && idx.z < (int)block_dim.depth;
+    }
+
+    /**
+     * @brief Call func(x, y, z, row, count) for each brick row inside [src, dst) clipped to the volume.
+     */
+    template<typename T, typename F>
+    void ForEachBrickRow(T* storage, int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ,
+                         bool with_padding, F&& func) const {
+        ForEachBlockRow(desc.extend.width, desc.extend.height, desc.extend.depth, block_length, padding, with_padding,
+                        srcX, srcY, srcZ, dstX, dstY, dstZ,
+                        [&](int bx, int by, int bz){ return storage + GetBlockOffset(bx, by, bz); },
+                        std::forward<F>(func));
+    }
+
+    size_t GetVoxelOffset(int x, int y, int z) const noexcept {
+        const int bx = x / block_length, by = y / block_length, bz = z / block_length;
+        const size_t lx = x - bx * block_length + padding;
+        const size_t ly = y - by * block_length + padding;
+        const size_t lz = z - bz * block_length + padding;
+        return GetBlockOffset(bx, by, bz) + (lz * block_size + ly) * block_size + lx;
+    }
+
+    trilinear_grid_t GetSampleGrid(const void* storage, size_t voxel_size) const noexcept {
+        trilinear_grid_t grid;
+        grid.data = static_cast<const uint8_t*>(storage);
+        grid.bytes = block_dim.size() * block_voxels * voxel_size;
+        grid.width = desc.extend.width, grid.height = desc.extend.height, grid.depth = desc.extend.depth;
+        grid.block_slot = block_slot.data();
+        grid.block_length = block_length;
+        grid.padding = padding;
+        grid.block_size = block_size;
+        grid.block_dim_x = block_dim.width;
+        grid.block_dim_y = block_dim.height;
+        grid.block_voxels = (uint32_t)block_voxels;
+        return grid;
+    }
+};
+
+template<typename Voxel>
+BlockedGridVolume<Voxel>::BlockedGridVolume(const BlockedGridVolumeDesc& desc, const RawGridVolumeAllocInfo& alloc_info)
+: RawGridVolume<Voxel>(desc, GetBlockedStorageBytes(desc), alloc_info)
+{
+    _ = std::make_unique<BlockedGridVolumePrivate>();
+    _->desc = desc;
+    _->Init();
+}
+
+template<typename Voxel>
+BlockedGridVolume<Voxel>::BlockedGridVolume(const BlockedGridVolumeDesc& desc, size_t storage_bytes, const RawGridVolumeAllocInfo& alloc_info)
+: RawGridVolume<Voxel>(desc, storage_bytes, alloc_info)
+{
+    _ = std::make_unique<BlockedGridVolumePrivate>();
+    _->desc = desc;
+    _->Init();
+}
+
+template<typename Voxel>
+BlockedGridVolume<Voxel>::~BlockedGridVolume() {
+
+}
+
+template<typename Voxel>
+BlockedGridVolumeDesc BlockedGridVolume<Voxel>::GetVolumeDesc() const noexcept {
+    return _->desc;
+}
+
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, Voxel *buf) {
+    assert(buf && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    _->ForEachBrickRow(this->GetRawDataPtr(), srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                       [&](int x, int y, int z, const Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(buf + offset, row, sizeof(Voxel) * count);
+    });
+}
+
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeReadFunc<Voxel> reader) {
+    assert(reader && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    _->ForEachBrickRow(this->GetRawDataPtr(), srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                       [&](int x, int y, int z, const Voxel* row, int count){
+        for(int i = 0; i < count; i++)
+            reader(x + i - srcX, y - srcY, z - srcZ, row[i]);
+    });
+}
+
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, const Voxel *buf) {
+    assert(buf && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    // padding copies are written too so every brick stays self contained
+    _->ForEachBrickRow(this->GetRawDataPtr(), srcX, srcY, srcZ, dstX, dstY, dstZ, true,
+                       [&](int x, int y, int z, Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(row, buf + offset, sizeof(Voxel) * count);
+    });
+}
+
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeWriteFunc<Voxel> writer) {
+    assert(writer && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    // writer is called once per voxel, then the result goes to the owner brick and all padding copies
+    const size_t len_x = dstX - srcX, len_y = dstY - srcY, len_z = dstZ - srcZ;
+    std::vector<Voxel> region(len_x * len_y * len_z);
+    ReadVoxels(srcX, srcY, srcZ, dstX, dstY, dstZ, region.data());
+    _->ForEachBrickRow(this->GetRawDataPtr(), srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                       [&](int x, int y, int z, const Voxel*, int count){
+        Voxel* row = region.data() + (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        for(int i = 0; i < count; i++)
+            writer(x + i - srcX, y - srcY, z - srcZ, row[i]);
+    });
+    WriteVoxels(srcX, srcY, srcZ, dstX, dstY, dstZ, region.data());
+}
+
+template<typename Voxel>
+Voxel& BlockedGridVolume<Voxel>::operator()(int x, int y, int z) {
+    assert(x >= 0 && y >= 0 && z >= 0 && (uint32_t)x < _->desc.extend.width
+           && (uint32_t)y < _->desc.extend.height && (uint32_t)z < _->desc.extend.depth);
+    return this->GetRawDataPtr()[_->GetVoxelOffset(x, y, z)];
+}
+
+template<typename Voxel>
+const Voxel& BlockedGridVolume<Voxel>::operator()(int x, int y, int z) const {
+    assert(x >= 0 && y >= 0 && z >= 0 && (uint32_t)x < _->desc.extend.width
+           && (uint32_t)y < _->desc.extend.height && (uint32_t)z < _->desc.extend.depth);
+    return this->GetRawDataPtr()[_->GetVoxelOffset(x, y, z)];
+}
+
+template<typename Voxel>
+VolumeType BlockedGridVolume<Voxel>::GetVolumeType() const noexcept {
+    return VolumeType::Grid_BLOCKED;
+}
+
+template<typename Voxel>
+Extend3D BlockedGridVolume<Voxel>::GetBlockDim() const noexcept {
+    return _->block_dim;
+}
+
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::ReadBlockData(const BlockIndex& blockIndex, VoxelT* buf) {
+    assert(buf);
+    std::memcpy(buf, GetRawBlockData(blockIndex), _->block_voxels * sizeof(Voxel));
+}
+
+template<typename Voxel>
+Voxel* BlockedGridVolume<Voxel>::GetRawBlockData(const BlockIndex& blockIndex) {
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("BlockedGridVolume block index out of range");
+    return this->GetRawDataPtr() + _->GetBlockOffset(blockIndex.x, blockIndex.y, blockIndex.z);
+}
+
+template<typename Voxel>
+const Voxel* BlockedGridVolume<Voxel>::GetRawBlockData(const BlockIndex& blockIndex) const {
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("BlockedGridVolume block index out of range");
+    return this->GetRawDataPtr() + _->GetBlockOffset(blockIndex.x, blockIndex.y, blockIndex.z);
+}
+
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::SampleTrilinear(const Float3* pts, size_t count, float* out) const {
+    using T = typename Voxel::VoxelDataType;
+    if(_->padding > 0){
+        trilinear_sample<T>(_->GetSampleGrid(this->GetRawDataPtr(), sizeof(Voxel)), &pts->x, count, out);
+        return;
+    }
+    const auto& extend = _->desc.extend;
+    auto storage = reinterpret_cast<const T*>(this->GetRawDataPtr());
+    for(size_t i = 0; i < count; i++){
+        out[i] = trilinear_sample_with(extend.width, extend.height, extend.depth, pts[i].x, pts[i].y, pts[i].z,
+                                       [&](int x, int y, int z){ return static_cast<float>(storage[_->GetVoxelOffset(x, y, z)]); });
+    }
+}
 
+template<typename Voxel>
+void BlockedGridVolume<Voxel>::SampleTrilinearGradient(const Float3* pts, size_t count, Float3* out) const {
+    using T = typename Voxel::VoxelDataType;
+    if(_->padding > 0){
+        trilinear_gradient<T>(_->GetSampleGrid(this->GetRawDataPtr(), sizeof(Voxel)), &pts->x, count, &out->x);
+        return;
+    }
+    const auto& extend = _->desc.extend;
+    for(size_t i = 0; i < count; i++){
+        trilinear_gradient_with(extend.width, extend.height, extend.depth, pts[i].x, pts[i].y, pts[i].z, &out[i].x,
+                                [this](float x, float y, float z){
+            float value;
+            Float3 pt{x, y, z};
+            SampleTrilinear(&pt, 1, &value);
+            return value;
+        });
+    }
+}
 
+template class BlockedGridVolume<VoxelRU8>;
+template class BlockedGridVolume<VoxelRU16>;
 
-VOL_END
\ No newline at end of file
+VOL_END
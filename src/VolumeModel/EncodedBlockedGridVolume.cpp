@@ -1,8 +1,582 @@
 #include <VolumeUtils/Volume.hpp>
 
+#include "../Common/Utils.hpp"
+#include "../Common/Common.hpp"
+#include "../Common/ClockCache.hpp"
+#include "../Common/Trilinear.hpp"
+
+#include <array>
+
 VOL_BEGIN
 
+class EncodedBlockedGridVolumePrivate{
+public:
+    using DecodedBlock = std::vector<uint8_t>;
+    using DecodedCache = clock_cache_t<uint32_t, DecodedBlock>;
+
+    EncodedBlockedGridVolumeDesc desc;
+
+    int block_length = 0;
+    int padding = 0;
+    // block_length + 2 * padding
+    int block_size = 0;
+    size_t block_bytes = 0;
+    Extend3D block_dim;
+
+    // page table entry of one block, empty records for a block of all zero
+    struct Page{
+        PacketArena records;
+        // decoded copy in pool is newer than records
+        bool dirty = false;
+        // written block dropped from the pool and not encoded yet, newer than records
+        std::shared_ptr<const DecodedBlock> evicted;
+    };
+    std::vector<Page> pages;
+    // blocks with an evicted copy waiting for StoreEvicted
+    std::vector<uint32_t> evicted_blocks;
+    std::mutex page_mtx;
+
+    std::unique_ptr<DecodedCache> decoded;
+    // decode and insert of one block are serialized so a stale decode is never inserted
+    std::array<std::mutex, 64> load_mtx;
+
+    // codecs are not thread safe, each decode or encode takes one from here
+    std::mutex codec_mtx;
+    std::vector<std::unique_ptr<CVolumeCodecInterface>> codecs;
+
+    // block pinned for operator() and GetRawBlockData
+    DecodedCache::handle_t current;
+    uint32_t current_block = std::numeric_limits<uint32_t>::max();
+
+    void Init(size_t decoded_block_count){
+        block_length = desc.block_length;
+        padding = desc.padding;
+        block_size = block_length + 2 * padding;
+        block_bytes = (size_t)block_size * block_size * block_size * GetVoxelSize(desc.voxel_info);
+        auto dim = [&](uint32_t len){ return (len + desc.block_length - 1) / desc.block_length; };
+        block_dim = {dim(desc.extend.width), dim(desc.extend.height), dim(desc.extend.depth)};
+        pages.resize(block_dim.size());
+
+        decoded_block_count = std::max<size_t>(2, decoded_block_count);
+        // slot count is the real bound, byte budget leaves room for uneven split between shards
+        decoded = std::make_unique<DecodedCache>(block_bytes * decoded_block_count * 2, decoded_block_count);
+        decoded->set_evict_callback([this](const uint32_t& block, DecodedBlock& data){
+            EvictBlock(block, data);
+        });
+    }
+
+    ~EncodedBlockedGridVolumePrivate(){
+        current.release();
+    }
+
+    uint32_t GetBlockLinearIndex(int x, int y, int z) const noexcept {
+        return (uint32_t)(((size_t)z * block_dim.height + y) * block_dim.width + x);
+    }
+
+    bool IsValidBlock(const BlockIndex& idx) const noexcept {
+        return idx.x >= 0 && idx.y >= 0 && idx.z >= 0
+        && idx.x < (int)block_dim.width && idx.y < (int)block_dim.height && idx.z < (int)block_dim.depth;
+    }
+
+    std::unique_ptr<CVolumeCodecInterface> AcquireCodec(){
+        {
+            std::lock_guard<std::mutex> lk(codec_mtx);
+            if(!codecs.empty()){
+                auto codec = std::move(codecs.back());
+                codecs.pop_back();
+                return codec;
+            }
+        }
+        auto codec = CreateCPUVolumeCodecByDesc(desc);
+        if(!codec){
+            throw VolumeFileContextError("Failed to create volume codec : " + std::string(VolumeCodecToStr(desc.codec)));
+        }
+        return codec;
+    }
+
+    void ReleaseCodec(std::unique_ptr<CVolumeCodecInterface> codec){
+        std::lock_guard<std::mutex> lk(codec_mtx);
+        codecs.push_back(std::move(codec));
+    }
+
+    PacketArena EncodeBlock(const DecodedBlock& data){
+        PacketArena records;
+        const bool all_zero = std::all_of(data.begin(), data.end(), [](uint8_t v){ return v == 0; });
+        if(!all_zero){
+            auto codec = AcquireCodec();
+            const Extend3D extend = {(uint32_t)block_size, (uint32_t)block_size, (uint32_t)block_size};
+            codec->Encode(extend, data.data(), data.size(), records);
+            ReleaseCodec(std::move(codec));
+        }
+        return records;
+    }
+
+    /**
+     * @brief Encode a written block of the pool into its page.
+     * @param pinned the block may still be written through a live handle, so it stays dirty.
+     */
+    void StoreBlock(uint32_t block, const DecodedBlock& data, bool pinned){
+        {
+            std::lock_guard<std::mutex> lk(page_mtx);
+            if(!pages[block].dirty) return;
+        }
+        auto records = EncodeBlock(data);
+        std::lock_guard<std::mutex> lk(page_mtx);
+        auto& page = pages[block];
+        page.records = std::move(records);
+        // an older evicted copy must not overwrite these records later
+        page.evicted.reset();
+        page.dirty = pinned;
+    }
+
+    /**
+     * @brief Eviction callback, runs under the cache shard lock so it only moves a written block aside.
+     */
+    void EvictBlock(uint32_t block, DecodedBlock& data){
+        std::lock_guard<std::mutex> lk(page_mtx);
+        auto& page = pages[block];
+        if(!page.dirty) return;
+        page.evicted = std::make_shared<const DecodedBlock>(std::move(data));
+        page.dirty = false;
+        evicted_blocks.push_back(block);
+    }
+
+    /**
+     * @brief Encode blocks moved aside by eviction, called out of any cache lock.
+     */
+    void StoreEvicted(){
+        std::vector<uint32_t> blocks;
+        {
+            std::lock_guard<std::mutex> lk(page_mtx);
+            if(evicted_blocks.empty()) return;
+            blocks.swap(evicted_blocks);
+        }
+        for(size_t i = 0; i < blocks.size(); i++){
+            std::shared_ptr<const DecodedBlock> data;
+            {
+                std::lock_guard<std::mutex> lk(page_mtx);
+                data = pages[blocks[i]].evicted;
+            }
+            if(!data) continue;
+            PacketArena records;
+            try{
+                records = EncodeBlock(*data);
+            }
+            catch(...){
+                // keep the rest queued, the evicted copies are still in their pages
+                std::lock_guard<std::mutex> lk(page_mtx);
+                evicted_blocks.insert(evicted_blocks.end(), blocks.begin() + i, blocks.end());
+                throw;
+            }
+            std::lock_guard<std::mutex> lk(page_mtx);
+            auto& page = pages[blocks[i]];
+            // replaced by a newer copy while encoding, that one is queued again
+            if(page.evicted == data){
+                page.records = std::move(records);
+                page.evicted.reset();
+            }
+        }
+    }
+
+    /**
+     * @brief Decoded block pinned in the pool, or a private copy if every slot is pinned by others.
+     */
+    struct BlockRef{
+        DecodedCache::handle_t handle;
+        DecodedBlock local;
+        uint32_t block = 0;
+
+        uint8_t* data(){
+            return handle ? handle->data() : local.data();
+        }
+    };
+
+    DecodedBlock DecodeBlock(uint32_t block){
+        Packets packets;
+        {
+            std::lock_guard<std::mutex> lk(page_mtx);
+            auto& page = pages[block];
+            if(page.evicted) return *page.evicted;
+            ParsePacketRecords(page.records.data(), page.records.size(), packets);
+        }
+        DecodedBlock data(block_bytes, 0);
+        if(!packets.empty()){
+            auto codec = AcquireCodec();
+            const Extend3D extend = {(uint32_t)block_size, (uint32_t)block_size, (uint32_t)block_size};
+            codec->Decode(extend, packets, data.data(), data.size());
+            ReleaseCodec(std::move(codec));
+        }
+        return data;
+    }
+
+    std::mutex& GetLoadMutex(uint32_t block){
+        return load_mtx[block % load_mtx.size()];
+    }
+
+    /**
+     * @return pinned decoded block, decoded from its page on miss.
+     */
+    BlockRef GetBlock(uint32_t block){
+        BlockRef ref;
+        ref.block = block;
+        if((ref.handle = decoded->get(block))) return ref;
+        {
+            std::lock_guard<std::mutex> lk(GetLoadMutex(block));
+            if(!(ref.handle = decoded->get(block))){
+                auto data = DecodeBlock(block);
+                ref.handle = decoded->insert(block, std::move(data), block_bytes);
+                // value is only moved from on success
+                if(!ref.handle) ref.local = std::move(data);
+            }
+        }
+        StoreEvicted();
+        return ref;
+    }
+
+    /**
+     * @brief Private copy is not seen by the pool, written one goes to the pool copy loaded meanwhile or is encoded.
+     */
+    void ReleaseBlock(BlockRef& ref, bool write){
+        if(!ref.handle && write && !ref.local.empty()){
+            std::lock_guard<std::mutex> lk(GetLoadMutex(ref.block));
+            if(auto handle = decoded->get(ref.block)){
+                std::memcpy(handle->data(), ref.local.data(), block_bytes);
+                MarkDirty(ref.block);
+            }
+            else{
+                MarkDirty(ref.block);
+                StoreBlock(ref.block, ref.local, false);
+            }
+        }
+        ref = BlockRef{};
+    }
+
+    void MarkDirty(uint32_t block){
+        std::lock_guard<std::mutex> lk(page_mtx);
+        pages[block].dirty = true;
+    }
+
+    /**
+     * @brief Pin block as the current one for operator() and GetRawBlockData.
+     */
+    uint8_t* PinCurrent(uint32_t block){
+        if(block != current_block || !current){
+            current.release();
+            auto ref = GetBlock(block);
+            if(!ref.handle){
+                throw VolumeFileContextError("EncodedBlockedGridVolume decoded block pool is full, all blocks are pinned");
+            }
+            current = std::move(ref.handle);
+            current_block = block;
+        }
+        return current->data();
+    }
+
+    size_t GetVoxelOffset(int x, int y, int z, uint32_t& block) const noexcept {
+        const int bx = x / block_length, by = y / block_length, bz = z / block_length;
+        block = GetBlockLinearIndex(bx, by, bz);
+        const size_t lx = x - bx * block_length + padding;
+        const size_t ly = y - by * block_length + padding;
+        const size_t lz = z - bz * block_length + padding;
+        return (lz * block_size + ly) * block_size + lx;
+    }
+
+    /**
+     * @brief Call func(x, y, z, row, count) for each block row of [src, dst), blocks are pinned while visited.
+     */
+    template<typename Voxel, typename F>
+    void ForEachBlockRow(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, bool write, F&& func){
+        BlockRef pinned;
+        vol::ForEachBlockRow(desc.extend.width, desc.extend.height, desc.extend.depth, block_length, padding, write,
+                             srcX, srcY, srcZ, dstX, dstY, dstZ,
+                             [&](int bx, int by, int bz){
+                                 const uint32_t block = GetBlockLinearIndex(bx, by, bz);
+                                 ReleaseBlock(pinned, write);
+                                 pinned = GetBlock(block);
+                                 if(write) MarkDirty(block);
+                                 return reinterpret_cast<Voxel*>(pinned.data());
+                             },
+                             std::forward<F>(func));
+        ReleaseBlock(pinned, write);
+    }
+};
+
+template<typename Voxel>
+EncodedBlockedGridVolume<Voxel>::EncodedBlockedGridVolume(const EncodedBlockedGridVolumeDesc& desc, size_t decoded_block_count)
+: BlockedGridVolume<Voxel>(desc, 0, {})
+{
+    if(!CheckValidation(desc) || GetVoxelSize(desc.voxel_info) != sizeof(Voxel)){
+        PrintVolumeDesc(desc);
+        throw VolumeFileContextError("EncodedBlockedGridVolumeDesc is invalid for create EncodedBlockedGridVolume");
+    }
+    _ = std::make_unique<EncodedBlockedGridVolumePrivate>();
+    _->desc = desc;
+    _->Init(decoded_block_count);
+}
+
+template<typename Voxel>
+EncodedBlockedGridVolume<Voxel>::EncodedBlockedGridVolume(const std::string& filename, size_t decoded_block_count)
+: EncodedBlockedGridVolume(EncodedBlockedGridVolumeReader(filename), decoded_block_count)
+{
+
+}
+
+template<typename Voxel>
+EncodedBlockedGridVolume<Voxel>::EncodedBlockedGridVolume(EncodedBlockedGridVolumeReader&& reader, size_t decoded_block_count)
+: EncodedBlockedGridVolume(reader.GetVolumeDesc(), decoded_block_count)
+{
+    Packets packets;
+    for(uint32_t z = 0; z < _->block_dim.depth; z++){
+        for(uint32_t y = 0; y < _->block_dim.height; y++){
+            for(uint32_t x = 0; x < _->block_dim.width; x++){
+                packets.clear();
+                reader.ReadEncodedBlockData({(int)x, (int)y, (int)z}, packets);
+                auto& records = _->pages[_->GetBlockLinearIndex(x, y, z)].records;
+                records.reserve(GetPacketRecordsSize(packets));
+                for(auto& packet : packets)
+                    AppendPacketRecord(records, packet.data(), packet.size());
+            }
+        }
+    }
+}
+
+template<typename Voxel>
+EncodedBlockedGridVolume<Voxel>::~EncodedBlockedGridVolume() {
+
+}
+
+template<typename Voxel>
+EncodedBlockedGridVolumeDesc EncodedBlockedGridVolume<Voxel>::GetVolumeDesc() const noexcept {
+    return _->desc;
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, Voxel *buf) {
+    assert(buf && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    _->template ForEachBlockRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                                       [&](int x, int y, int z, const Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(buf + offset, row, sizeof(Voxel) * count);
+    });
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeReadFunc<Voxel> reader) {
+    assert(reader && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    _->template ForEachBlockRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                                       [&](int x, int y, int z, const Voxel* row, int count){
+        for(int i = 0; i < count; i++)
+            reader(x + i - srcX, y - srcY, z - srcZ, row[i]);
+    });
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, const Voxel *buf) {
+    assert(buf && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    // padding copies are written too so every block stays self contained
+    _->template ForEachBlockRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, true,
+                                       [&](int x, int y, int z, Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(row, buf + offset, sizeof(Voxel) * count);
+    });
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeWriteFunc<Voxel> writer) {
+    assert(writer && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    // writer is called once per voxel, then the result goes to the owner block and all padding copies
+    const size_t len_x = dstX - srcX, len_y = dstY - srcY, len_z = dstZ - srcZ;
+    std::vector<Voxel> region(len_x * len_y * len_z);
+    ReadVoxels(srcX, srcY, srcZ, dstX, dstY, dstZ, region.data());
+    const int beg_z = std::max(srcZ, 0), end_z = std::min<int>(dstZ, _->desc.extend.depth);
+    const int beg_y = std::max(srcY, 0), end_y = std::min<int>(dstY, _->desc.extend.height);
+    const int beg_x = std::max(srcX, 0), end_x = std::min<int>(dstX, _->desc.extend.width);
+    for(int z = beg_z; z < end_z; z++){
+        for(int y = beg_y; y < end_y; y++){
+            Voxel* row = region.data() + (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x;
+            for(int x = beg_x; x < end_x; x++)
+                writer(x - srcX, y - srcY, z - srcZ, row[x - srcX]);
+        }
+    }
+    WriteVoxels(srcX, srcY, srcZ, dstX, dstY, dstZ, region.data());
+}
+
+template<typename Voxel>
+Voxel& EncodedBlockedGridVolume<Voxel>::operator()(int x, int y, int z) {
+    assert(x >= 0 && y >= 0 && z >= 0 && (uint32_t)x < _->desc.extend.width
+           && (uint32_t)y < _->desc.extend.height && (uint32_t)z < _->desc.extend.depth);
+    uint32_t block;
+    size_t offset = _->GetVoxelOffset(x, y, z, block);
+    return reinterpret_cast<Voxel*>(_->PinCurrent(block))[offset];
+}
+
+template<typename Voxel>
+const Voxel& EncodedBlockedGridVolume<Voxel>::operator()(int x, int y, int z) const {
+    assert(x >= 0 && y >= 0 && z >= 0 && (uint32_t)x < _->desc.extend.width
+           && (uint32_t)y < _->desc.extend.height && (uint32_t)z < _->desc.extend.depth);
+    uint32_t block;
+    size_t offset = _->GetVoxelOffset(x, y, z, block);
+    return reinterpret_cast<const Voxel*>(_->PinCurrent(block))[offset];
+}
+
+template<typename Voxel>
+VolumeType EncodedBlockedGridVolume<Voxel>::GetVolumeType() const noexcept {
+    return VolumeType::Grid_BLOCKED_ENCODED;
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::ReadBlockData(const BlockIndex& blockIndex, Voxel* buf) {
+    assert(buf);
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("EncodedBlockedGridVolume block index out of range");
+    auto ref = _->GetBlock(_->GetBlockLinearIndex(blockIndex.x, blockIndex.y, blockIndex.z));
+    std::memcpy(buf, ref.data(), _->block_bytes);
+}
+
+template<typename Voxel>
+Voxel* EncodedBlockedGridVolume<Voxel>::GetRawBlockData(const BlockIndex& blockIndex) {
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("EncodedBlockedGridVolume block index out of range");
+    auto block = _->GetBlockLinearIndex(blockIndex.x, blockIndex.y, blockIndex.z);
+    return reinterpret_cast<Voxel*>(_->PinCurrent(block));
+}
+
+template<typename Voxel>
+const Voxel* EncodedBlockedGridVolume<Voxel>::GetRawBlockData(const BlockIndex& blockIndex) const {
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("EncodedBlockedGridVolume block index out of range");
+    auto block = _->GetBlockLinearIndex(blockIndex.x, blockIndex.y, blockIndex.z);
+    return reinterpret_cast<const Voxel*>(_->PinCurrent(block));
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::Flush() {
+    _->StoreEvicted();
+    _->decoded->for_each([this](const uint32_t& block, const EncodedBlockedGridVolumePrivate::DecodedBlock& data, bool pinned){
+        _->StoreBlock(block, data, pinned);
+    });
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::MarkBlockDirty(const BlockIndex& blockIndex) {
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("EncodedBlockedGridVolume block index out of range");
+    _->MarkDirty(_->GetBlockLinearIndex(blockIndex.x, blockIndex.y, blockIndex.z));
+}
+
+template<typename Voxel>
+size_t EncodedBlockedGridVolume<Voxel>::GetEncodedBytes() const {
+    _->StoreEvicted();
+    std::lock_guard<std::mutex> lk(_->page_mtx);
+    size_t bytes = 0;
+    for(auto& page : _->pages) bytes += page.records.size();
+    return bytes;
+}
+
+template<typename Voxel>
+size_t EncodedBlockedGridVolume<Voxel>::ReadEncodedBlockData(const BlockIndex& blockIndex, PacketArena& records) const {
+    if(!_->IsValidBlock(blockIndex))
+        throw std::out_of_range("EncodedBlockedGridVolume block index out of range");
+    const auto block = _->GetBlockLinearIndex(blockIndex.x, blockIndex.y, blockIndex.z);
+    // written block may be only in the decoded pool
+    _->StoreEvicted();
+    _->decoded->visit(block, [&](const EncodedBlockedGridVolumePrivate::DecodedBlock& data, bool pinned){
+        _->StoreBlock(block, data, pinned);
+    });
+    std::lock_guard<std::mutex> lk(_->page_mtx);
+    records = _->pages[block].records;
+    return records.size();
+}
+
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::SampleTrilinear(const Float3* pts, size_t count, float* out) const {
+    using T = typename Voxel::VoxelDataType;
+    const auto& extend = _->desc.extend;
+    const int block_length = _->block_length;
+    auto block_of = [&](const Float3& pt){
+        int x0, y0, z0;
+        float f;
+        trilinear_axis(pt.x, extend.width, x0, f);
+        trilinear_axis(pt.y, extend.height, y0, f);
+        trilinear_axis(pt.z, extend.depth, z0, f);
+        return BlockIndex{x0 / block_length, y0 / block_length, z0 / block_length};
+    };
+    if(_->padding == 0){
+        // corners of a cell may be in different blocks, keep the last one pinned
+        EncodedBlockedGridVolumePrivate::BlockRef pinned;
+        pinned.block = std::numeric_limits<uint32_t>::max();
+        auto fetch = [&](int x, int y, int z){
+            uint32_t block;
+            size_t offset = _->GetVoxelOffset(x, y, z, block);
+            if(block != pinned.block) pinned = _->GetBlock(block);
+            return static_cast<float>(reinterpret_cast<const T*>(pinned.data())[offset]);
+        };
+        for(size_t i = 0; i < count; i++)
+            out[i] = trilinear_sample_with(extend.width, extend.height, extend.depth, pts[i].x, pts[i].y, pts[i].z, fetch);
+        return;
+    }
+    trilinear_grid_t grid;
+    grid.bytes = _->block_bytes;
+    grid.width = extend.width, grid.height = extend.height, grid.depth = extend.depth;
+    grid.pitch_y = _->block_size;
+    grid.pitch_z = _->block_size * _->block_size;
+    for(size_t i = 0; i < count;){
+        const auto idx = block_of(pts[i]);
+        size_t end = i + 1;
+        while(end < count){
+            const auto next = block_of(pts[end]);
+            if(next.x != idx.x || next.y != idx.y || next.z != idx.z) break;
+            end++;
+        }
+        auto ref = _->GetBlock(_->GetBlockLinearIndex(idx.x, idx.y, idx.z));
+        grid.data = ref.data();
+        grid.ox = idx.x * block_length - _->padding;
+        grid.oy = idx.y * block_length - _->padding;
+        grid.oz = idx.z * block_length - _->padding;
+        trilinear_sample<T>(grid, &pts[i].x, end - i, out + i);
+        i = end;
+    }
+}
 
+template<typename Voxel>
+void EncodedBlockedGridVolume<Voxel>::SampleTrilinearGradient(const Float3* pts, size_t count, Float3* out) const {
+    const auto& extend = _->desc.extend;
+    auto clamp = [](float v, uint32_t len){
+        const float hi = static_cast<float>(len - 1);
+        v = v > 0.f ? v : 0.f;
+        return v < hi ? v : hi;
+    };
+    // lower and upper neighbors of a batch are sampled axis by axis so runs stay coherent
+    constexpr size_t Batch = 256;
+    std::vector<Float3> neighbors(Batch * 6);
+    std::vector<float> values(Batch * 6);
+    for(size_t i = 0; i < count; i += Batch){
+        const size_t n = std::min(Batch, count - i);
+        for(size_t j = 0; j < n; j++){
+            const auto& pt = pts[i + j];
+            neighbors[j]         = {clamp(pt.x - 1.f, extend.width), pt.y, pt.z};
+            neighbors[n + j]     = {clamp(pt.x + 1.f, extend.width), pt.y, pt.z};
+            neighbors[2 * n + j] = {pt.x, clamp(pt.y - 1.f, extend.height), pt.z};
+            neighbors[3 * n + j] = {pt.x, clamp(pt.y + 1.f, extend.height), pt.z};
+            neighbors[4 * n + j] = {pt.x, pt.y, clamp(pt.z - 1.f, extend.depth)};
+            neighbors[5 * n + j] = {pt.x, pt.y, clamp(pt.z + 1.f, extend.depth)};
+        }
+        SampleTrilinear(neighbors.data(), n * 6, values.data());
+        auto diff = [&](size_t lo, size_t hi, float plo, float phi){
+            const float den = phi - plo;
+            return den > 0.f ? (values[hi] - values[lo]) / den : 0.f;
+        };
+        for(size_t j = 0; j < n; j++){
+            out[i + j].x = diff(j, n + j, neighbors[j].x, neighbors[n + j].x);
+            out[i + j].y = diff(2 * n + j, 3 * n + j, neighbors[2 * n + j].y, neighbors[3 * n + j].y);
+            out[i + j].z = diff(4 * n + j, 5 * n + j, neighbors[4 * n + j].z, neighbors[5 * n + j].z);
+        }
+    }
+}
 
+template class EncodedBlockedGridVolume<VoxelRU8>;
+template class EncodedBlockedGridVolume<VoxelRU16>;
 
-VOL_END
\ No newline at end of file
+VOL_END
@@ -2,60 +2,173 @@
 
 #include "../Common/Utils.hpp"
 #include "../Common/Common.hpp"
+#include "../Common/Trilinear.hpp"
+
+#if defined(VOL_OS_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(VOL_OS_LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 VOL_BEGIN
 
 class RawGridVolumePrivate{
 public:
     void* ptr = nullptr;
-    std::vector<uint8_t> buffer;
     size_t size = 0;
+    // bytes actually reserved, rounded up to the page size
+    size_t alloc_size = 0;
+    size_t page_size = GetOSPageSize();
 
     uint32_t width = 0;
     uint32_t height = 0;
     uint32_t depth = 0;
 
     RawGridVolumeDesc desc;
+    RawGridVolumeAllocInfo alloc_info;
 
     ~RawGridVolumePrivate(){
-
+        Free();
     }
 
     void Init(){
+        Init(GetVoxelSize(desc.voxel_info) * desc.extend.size());
+    }
+
+    void Init(size_t storage_bytes){
         width = desc.extend.width;
         height = desc.extend.height;
         depth = desc.extend.depth;
 
-        size = GetVoxelSize(desc.voxel_info) * width * height * depth;
+        size = storage_bytes;
+        // derived volume keeps its data elsewhere
+        if(size == 0) return;
 
-        buffer.resize(size, 0);
-        ptr = buffer.data();
+        // os pages are zeroed lazily, so no single thread zero fill here
+        ptr = Alloc(size);
         if(ptr == nullptr){
             throw std::runtime_error("Alloc RawGridVolume failed with size : " + std::to_string(size));
         }
+        if(alloc_info.parallel_first_touch)
+            FirstTouch();
     }
 
     /**
      * @param offset count in byte
      */
     void* GetPtr(size_t offset = 0){
-        assert(offset < size);
+        assert(offset < size || offset == 0);
         return reinterpret_cast<uint8_t*>(ptr) + offset;
     }
 
+private:
+    static size_t GetOSPageSize(){
+#if defined(VOL_OS_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#elif defined(VOL_OS_LINUX)
+        long size = sysconf(_SC_PAGESIZE);
+        return size > 0 ? static_cast<size_t>(size) : 4096;
+#else
+        return 4096;
+#endif
+    }
+
+    static size_t RoundUp(size_t bytes, size_t align){
+        return (bytes + align - 1) / align * align;
+    }
+
+    void* Alloc(size_t bytes){
+#if defined(VOL_OS_WIN32)
+        if(alloc_info.huge_pages){
+            // needs SeLockMemoryPrivilege, large pages are committed and locked at once
+            if(size_t large = GetLargePageMinimum(); large > 0){
+                alloc_size = RoundUp(bytes, large);
+                if(void* p = VirtualAlloc(nullptr, alloc_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)){
+                    page_size = large;
+                    return p;
+                }
+            }
+        }
+        alloc_size = RoundUp(bytes, page_size);
+        return VirtualAlloc(nullptr, alloc_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(VOL_OS_LINUX)
+        constexpr size_t huge_page_size = 2ull << 20;
+        if(alloc_info.huge_pages){
+            alloc_size = RoundUp(bytes, huge_page_size);
+            void* p = mmap(nullptr, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if(p != MAP_FAILED){
+                page_size = huge_page_size;
+                return p;
+            }
+        }
+        alloc_size = RoundUp(bytes, alloc_info.huge_pages ? huge_page_size : page_size);
+        void* p = mmap(nullptr, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED)
+            return nullptr;
+        if(alloc_info.huge_pages)
+            madvise(p, alloc_size, MADV_HUGEPAGE);
+        return p;
+#else
+        alloc_size = bytes;
+        return std::calloc(bytes, 1);
+#endif
+    }
+
+    void Free(){
+        if(!ptr) return;
+#if defined(VOL_OS_WIN32)
+        VirtualFree(ptr, 0, MEM_RELEASE);
+#elif defined(VOL_OS_LINUX)
+        munmap(ptr, alloc_size);
+#else
+        std::free(ptr);
+#endif
+        ptr = nullptr;
+    }
+
+    /**
+     * One contiguous slab of pages per worker in z order, same split as parallel ForEachRow.
+     * Workers are not pinned to cores, so this only places pages on the nodes the workers happen to run on.
+     */
+    void FirstTouch(){
+        const size_t page_count = alloc_size / page_size;
+        const int worker_count = std::min<int>(actual_worker_count(alloc_info.thread_count), std::max<size_t>(1, page_count));
+        parallel_forrange(0, worker_count, [&](int, int slab){
+            const size_t beg = page_count * slab / worker_count;
+            const size_t end = page_count * (slab + 1) / worker_count;
+            auto p = reinterpret_cast<volatile uint8_t*>(ptr);
+            for(size_t page = beg; page < end; page++)
+                p[page * page_size] = 0;
+        }, worker_count);
+    }
 };
 
 template<typename Voxel>
-RawGridVolume<Voxel>::RawGridVolume(const RawGridVolumeDesc& desc){
+RawGridVolume<Voxel>::RawGridVolume(const RawGridVolumeDesc& desc, const RawGridVolumeAllocInfo& alloc_info){
     if(!CheckValidation(desc)){
         PrintVolumeDesc(desc);
         throw VolumeFileContextError("RawGridVolumeDesc is invalid for create RawGridVolume");
     }
     _ = std::make_unique<RawGridVolumePrivate>();
     _->desc = desc;
+    _->alloc_info = alloc_info;
     _->Init();
 }
 
+template<typename Voxel>
+RawGridVolume<Voxel>::RawGridVolume(const RawGridVolumeDesc& desc, size_t storage_bytes, const RawGridVolumeAllocInfo& alloc_info){
+    _ = std::make_unique<RawGridVolumePrivate>();
+    _->desc = desc;
+    _->alloc_info = alloc_info;
+    _->Init(storage_bytes);
+}
+
 template<typename Voxel>
 RawGridVolume<Voxel>::~RawGridVolume() {
 
@@ -73,34 +186,21 @@ void RawGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, in
         return 1;
     });
 #else
-    int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, _->depth);
-    int beg_y = std::max<int>(srcY, 0), end_y = std::min<int>(dstY, _->height);
-    int beg_x = std::max<int>(srcX, 0), end_x = std::min<int>(dstX, _->width);
-    int len_y = dstY - srcY, len_x = dstX - srcX;
-    for(int z = beg_z; z < end_z; z++){
-        for(int y = beg_y; y < end_y; y++){
-            for(int x = beg_x; x < end_x; x++){
-                size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
-                buf[offset] = this->operator()(x, y, z);
-            }
-        }
-    }
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    std::as_const(*this).ForEachRow(srcX, srcY, srcZ, dstX, dstY, dstZ,
+                                    [&](int x, int y, int z, const Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(buf + offset, row, sizeof(Voxel) * count);
+    });
 #endif
 }
 
 template<typename Voxel>
 void RawGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeReadFunc<Voxel> reader) {
     assert(reader && srcX < dstX && srcY < dstY && srcZ < dstZ);
-    int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, _->depth);
-    int beg_y = std::max<int>(srcY, 0), end_y = std::min<int>(dstY, _->height);
-    int beg_x = std::max<int>(srcX, 0), end_x = std::min<int>(dstX, _->width);
-    for(int z = beg_z; z < end_z; z++){
-        for(int y = beg_y; y < end_y; y++){
-            for(int x = beg_x; x < end_x; x++){
-                reader(x - srcX, y - srcY, z - srcZ, this->operator()(x, y, z));
-            }
-        }
-    }
+    std::as_const(*this).ForEachVoxel(srcX, srcY, srcZ, dstX, dstY, dstZ, [&](int x, int y, int z, const Voxel& voxel){
+        reader(x - srcX, y - srcY, z - srcZ, voxel);
+    });
 }
 
 template<typename Voxel>
@@ -114,34 +214,20 @@ void RawGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, i
         dst = buf[src_offset];
     });
 #else
-    int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, _->depth);
-    int beg_y = std::max<int>(srcY, 0), end_y = std::min<int>(dstY, _->height);
-    int beg_x = std::max<int>(srcX, 0), end_x = std::min<int>(dstX, _->width);
-    int len_y = dstY - srcY, len_x = dstX - srcX;
-    for(int z = beg_z; z < end_z; z++){
-        for(int y = beg_y; y < end_y; y++){
-            for(int x = beg_x; x < end_x; x++){
-                size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
-                this->operator()(x, y, z) = buf[offset];
-            }
-        }
-    }
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    ForEachRow(srcX, srcY, srcZ, dstX, dstY, dstZ, [&](int x, int y, int z, Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(row, buf + offset, sizeof(Voxel) * count);
+    });
 #endif
 }
 
 template<typename Voxel>
 void RawGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeWriteFunc<Voxel> writer) {
     assert(writer && srcX < dstX && srcY < dstY && srcZ < dstZ);
-    int beg_z = std::max<int>(srcZ, 0), end_z = std::min<int>(dstZ, _->depth);
-    int beg_y = std::max<int>(srcY, 0), end_y = std::min<int>(dstY, _->height);
-    int beg_x = std::max<int>(srcX, 0), end_x = std::min<int>(dstX, _->width);
-    for(int z = beg_z; z < end_z; z++){
-        for(int y = beg_y; y < end_y; y++){
-            for(int x = beg_x; x < end_x; x++){
-                writer(x - srcX, y - srcY, z - srcZ, this->operator()(x, y, z));
-            }
-        }
-    }
+    ForEachVoxel(srcX, srcY, srcZ, dstX, dstY, dstZ, [&](int x, int y, int z, Voxel& voxel){
+        writer(x - srcX, y - srcY, z - srcZ, voxel);
+    });
 }
 
 template<typename Voxel>
@@ -173,11 +259,89 @@ const Voxel* RawGridVolume<Voxel>::GetRawDataPtr() const noexcept {
     return static_cast<Voxel*>(_->GetPtr());
 }
 
+template<typename Voxel>
+Extend3D RawGridVolume<Voxel>::GetExtend() const noexcept {
+    return _->desc.extend;
+}
+
 template<typename Voxel>
 RawGridVolumeDesc RawGridVolume<Voxel>::GetVolumeDesc() const noexcept {
     return _->desc;
 }
 
+template<typename Voxel>
+void RawGridVolume<Voxel>::Sample(std::span<const Float3> pts, std::span<Voxel> out) const {
+    assert(out.size() >= pts.size());
+    using T = typename Voxel::VoxelDataType;
+    constexpr size_t Batch = 256;
+    float values[Batch];
+    for(size_t i = 0; i < pts.size(); i += Batch){
+        const size_t count = (std::min)(Batch, pts.size() - i);
+        SampleTrilinear(pts.data() + i, count, values);
+        // samples never leave the range of the voxel type
+        for(size_t j = 0; j < count; j++)
+            out[i + j].x = static_cast<T>(values[j] + 0.5f);
+    }
+}
+
+template<typename Voxel>
+void RawGridVolume<Voxel>::Sample(std::span<const Float3> pts, std::span<float> out) const {
+    assert(out.size() >= pts.size());
+    SampleTrilinear(pts.data(), pts.size(), out.data());
+}
+
+template<typename Voxel>
+void RawGridVolume<Voxel>::SampleGradient(std::span<const Float3> pts, std::span<Float3> out) const {
+    assert(out.size() >= pts.size());
+    SampleTrilinearGradient(pts.data(), pts.size(), out.data());
+}
+
+template<typename Voxel>
+void RawGridVolume<Voxel>::SampleTrilinear(const Float3* pts, size_t count, float* out) const {
+    using T = typename Voxel::VoxelDataType;
+    const auto& extend = _->desc.extend;
+    if(GetVolumeType() == VolumeType::Grid_RAW){
+        trilinear_grid_t grid;
+        grid.data = static_cast<const uint8_t*>(_->GetPtr());
+        grid.bytes = _->size;
+        grid.width = extend.width, grid.height = extend.height, grid.depth = extend.depth;
+        grid.pitch_y = extend.width;
+        grid.pitch_z = extend.width * extend.height;
+        trilinear_sample<T>(grid, &pts->x, count, out);
+        return;
+    }
+    // derived layout without its own kernel
+    for(size_t i = 0; i < count; i++){
+        out[i] = trilinear_sample_with(extend.width, extend.height, extend.depth, pts[i].x, pts[i].y, pts[i].z,
+                                       [this](int x, int y, int z){ return static_cast<float>((*this)(x, y, z).x); });
+    }
+}
+
+template<typename Voxel>
+void RawGridVolume<Voxel>::SampleTrilinearGradient(const Float3* pts, size_t count, Float3* out) const {
+    using T = typename Voxel::VoxelDataType;
+    const auto& extend = _->desc.extend;
+    if(GetVolumeType() == VolumeType::Grid_RAW){
+        trilinear_grid_t grid;
+        grid.data = static_cast<const uint8_t*>(_->GetPtr());
+        grid.bytes = _->size;
+        grid.width = extend.width, grid.height = extend.height, grid.depth = extend.depth;
+        grid.pitch_y = extend.width;
+        grid.pitch_z = extend.width * extend.height;
+        trilinear_gradient<T>(grid, &pts->x, count, &out->x);
+        return;
+    }
+    for(size_t i = 0; i < count; i++){
+        trilinear_gradient_with(extend.width, extend.height, extend.depth, pts[i].x, pts[i].y, pts[i].z, &out[i].x,
+                                [this](float x, float y, float z){
+            float value;
+            Float3 pt{x, y, z};
+            SampleTrilinear(&pt, 1, &value);
+            return value;
+        });
+    }
+}
+
 template class RawGridVolume<VoxelRU8>;
 template class RawGridVolume<VoxelRU16>;
 
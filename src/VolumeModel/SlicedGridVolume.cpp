@@ -1,8 +1,453 @@
 #include <VolumeUtils/Volume.hpp>
 
+#include "../Common/Utils.hpp"
+#include "../Common/Common.hpp"
+#include "../Common/ClockCache.hpp"
+
+#include <array>
+
 VOL_BEGIN
 
+class SlicedGridVolumePrivate{
+public:
+    using SliceData = std::vector<uint8_t>;
+    using SliceCache = clock_cache_t<int, SliceData>;
+
+    SlicedGridVolumeDesc desc;
+    std::string filename;
+
+    size_t slice_bytes = 0;
+    size_t row_bytes = 0;
+
+    // disk access through reader and writer is serialized by io_mtx, never held while touching the cache
+    std::mutex io_mtx;
+    std::unique_ptr<SlicedGridVolumeReader> reader;
+    std::unique_ptr<SlicedGridVolumeWriter> writer;
+
+    std::mutex flag_mtx;
+    // cached copy is newer than the slice file
+    std::vector<uint8_t> dirty;
+    // slice file exists, slices of a new stack are zero until stored
+    std::vector<uint8_t> on_disk;
+    // written slice dropped from the cache and not stored yet, newer than the slice file
+    std::vector<std::shared_ptr<const SliceData>> evicted;
+    // slices with an evicted copy waiting for StoreEvicted
+    std::vector<int> evicted_slices;
+    // only tif stacks can be written back
+    bool writable = true;
+
+    std::unique_ptr<SliceCache> slices;
+    // load and insert of one slice are serialized so a stale load is never inserted
+    std::array<std::mutex, 16> load_mtx;
+
+    // slice pinned for operator()
+    SliceCache::handle_t current;
+    int current_slice = -1;
+
+    void Init(size_t cache_bytes){
+        slice_bytes = (size_t)desc.extend.width * desc.extend.height * GetVoxelSize(desc.voxel_info);
+        row_bytes = (size_t)desc.extend.width * GetVoxelSize(desc.voxel_info);
+        dirty.assign(desc.extend.depth, 0);
+        on_disk.assign(desc.extend.depth, 0);
+        evicted.resize(desc.extend.depth);
+
+        const size_t slot_count = std::max<size_t>(1, std::min<size_t>(desc.extend.depth, cache_bytes / slice_bytes));
+        // slot count is the real bound, byte budget leaves room for uneven split between shards
+        slices = std::make_unique<SliceCache>(slice_bytes * slot_count * 2, slot_count);
+        slices->set_evict_callback([this](const int& slice, SliceData& data){
+            EvictSlice(slice, data);
+        });
+    }
+
+    ~SlicedGridVolumePrivate(){
+        current.release();
+    }
+
+    void CheckWritable() const{
+        if(!writable){
+            throw VolumeFileContextError("SlicedGridVolume can only write back tif slices : " + filename);
+        }
+    }
+
+    void CreateWriter(){
+        if(writer) return;
+        // existing stack, its descriptor file is kept as is
+        writer = std::make_unique<SlicedGridVolumeWriter>(filename, desc, false);
+    }
+
+    void MarkDirty(int slice){
+        std::lock_guard<std::mutex> lk(flag_mtx);
+        dirty[slice] = 1;
+    }
+
+    /**
+     * @brief Write one slice to its file and close it so the reader sees it at once.
+     */
+    void WriteSlice(int slice, const SliceData& data){
+        std::lock_guard<std::mutex> lk(io_mtx);
+        CreateWriter();
+        writer->WriteSliceData(slice, data.data());
+        writer->Close();
+        // reader may hold the old content of this slice
+        if(reader) reader->ClearCache();
+    }
+
+    /**
+     * @brief Store a dirty slice of the cache, dirty is cleared only after the write succeeds.
+     * @param pinned the slice may still be written through a live handle, so it stays dirty.
+     */
+    void StoreSlice(int slice, const SliceData& data, bool pinned){
+        {
+            std::lock_guard<std::mutex> lk(flag_mtx);
+            if(!dirty[slice]) return;
+        }
+        WriteSlice(slice, data);
+        std::lock_guard<std::mutex> lk(flag_mtx);
+        // an older evicted copy must not overwrite this file later
+        evicted[slice].reset();
+        on_disk[slice] = 1;
+        dirty[slice] = pinned;
+    }
+
+    /**
+     * @brief Eviction callback, runs under the cache shard lock so it only moves a written slice aside.
+     */
+    void EvictSlice(int slice, SliceData& data){
+        std::lock_guard<std::mutex> lk(flag_mtx);
+        if(!dirty[slice]) return;
+        evicted[slice] = std::make_shared<const SliceData>(std::move(data));
+        dirty[slice] = 0;
+        evicted_slices.push_back(slice);
+    }
+
+    /**
+     * @brief Store slices moved aside by eviction, called out of any cache lock.
+     */
+    void StoreEvicted(){
+        std::vector<int> pending;
+        {
+            std::lock_guard<std::mutex> lk(flag_mtx);
+            if(evicted_slices.empty()) return;
+            pending.swap(evicted_slices);
+        }
+        for(size_t i = 0; i < pending.size(); i++){
+            const int slice = pending[i];
+            std::shared_ptr<const SliceData> data;
+            {
+                std::lock_guard<std::mutex> lk(flag_mtx);
+                data = evicted[slice];
+            }
+            if(!data) continue;
+            try{
+                WriteSlice(slice, *data);
+            }
+            catch(...){
+                // keep the rest queued, the evicted copies are still readable
+                std::lock_guard<std::mutex> lk(flag_mtx);
+                evicted_slices.insert(evicted_slices.end(), pending.begin() + i, pending.end());
+                throw;
+            }
+            std::lock_guard<std::mutex> lk(flag_mtx);
+            on_disk[slice] = 1;
+            // replaced by a newer copy while storing, that one is queued again
+            if(evicted[slice] == data) evicted[slice].reset();
+        }
+    }
+
+    SliceData LoadSlice(int slice){
+        bool exist;
+        {
+            std::lock_guard<std::mutex> lk(flag_mtx);
+            if(evicted[slice]) return *evicted[slice];
+            exist = on_disk[slice];
+        }
+        SliceData data(slice_bytes, 0);
+        if(exist){
+            std::lock_guard<std::mutex> lk(io_mtx);
+            reader->ReadSliceData(slice, data.data());
+        }
+        return data;
+    }
+
+    /**
+     * @brief Cached slice pinned in the pool, or a private copy if every slot is pinned by others.
+     */
+    struct SliceRef{
+        SliceCache::handle_t handle;
+        SliceData local;
+        int slice = -1;
+
+        uint8_t* data(){
+            return handle ? handle->data() : local.data();
+        }
+    };
+
+    std::mutex& GetLoadMutex(int slice){
+        return load_mtx[slice % load_mtx.size()];
+    }
+
+    SliceRef GetSlice(int slice){
+        SliceRef ref;
+        ref.slice = slice;
+        if((ref.handle = slices->get(slice))) return ref;
+        {
+            std::lock_guard<std::mutex> lk(GetLoadMutex(slice));
+            if(!(ref.handle = slices->get(slice))){
+                auto data = LoadSlice(slice);
+                ref.handle = slices->insert(slice, std::move(data), slice_bytes);
+                // value is only moved from on success
+                if(!ref.handle) ref.local = std::move(data);
+            }
+        }
+        StoreEvicted();
+        return ref;
+    }
+
+    /**
+     * @brief Private copy is not seen by the pool, written one goes to the cached copy loaded meanwhile or is stored.
+     */
+    void ReleaseSlice(SliceRef& ref, bool write){
+        if(!ref.handle && write && !ref.local.empty()){
+            std::lock_guard<std::mutex> lk(GetLoadMutex(ref.slice));
+            if(auto handle = slices->get(ref.slice)){
+                std::memcpy(handle->data(), ref.local.data(), slice_bytes);
+                MarkDirty(ref.slice);
+            }
+            else{
+                MarkDirty(ref.slice);
+                StoreSlice(ref.slice, ref.local, false);
+            }
+        }
+        ref = SliceRef{};
+    }
+
+    uint8_t* PinCurrent(int slice){
+        if(slice != current_slice || !current){
+            current.release();
+            auto ref = GetSlice(slice);
+            if(!ref.handle){
+                throw VolumeFileContextError("SlicedGridVolume slice cache is full, all slices are pinned");
+            }
+            current = std::move(ref.handle);
+            current_slice = slice;
+        }
+        return current->data();
+    }
+
+    /**
+     * @brief Call func(x, y, z, row, count) for each x row of [src, dst) clipped to the volume, slices are pinned while visited.
+     */
+    template<typename Voxel, typename F>
+    void ForEachSliceRow(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, bool write, F&& func){
+        const int beg_x = std::max(srcX, 0), end_x = std::min<int>(dstX, desc.extend.width);
+        const int beg_y = std::max(srcY, 0), end_y = std::min<int>(dstY, desc.extend.height);
+        const int beg_z = std::max(srcZ, 0), end_z = std::min<int>(dstZ, desc.extend.depth);
+        if(beg_x >= end_x || beg_y >= end_y) return;
+        if(write) CheckWritable();
+        for(int z = beg_z; z < end_z; z++){
+            auto ref = GetSlice(z);
+            if(write) MarkDirty(z);
+            auto ptr = reinterpret_cast<Voxel*>(ref.data());
+            for(int y = beg_y; y < end_y; y++)
+                func(beg_x, y, z, ptr + (size_t)y * desc.extend.width + beg_x, end_x - beg_x);
+            ReleaseSlice(ref, write);
+        }
+    }
+
+    void FlushAll(){
+        StoreEvicted();
+        slices->for_each([this](const int& slice, const SliceData& data, bool pinned){
+            StoreSlice(slice, data, pinned);
+        });
+    }
+};
+
+template<typename Voxel>
+SlicedGridVolume<Voxel>::SlicedGridVolume(const SlicedGridVolumeDesc& desc, size_t cacheBytes)
+: RawGridVolume<Voxel>(desc, 0, {})
+{
+    if(!CheckValidation(desc) || GetVoxelSize(desc.voxel_info) != sizeof(Voxel)){
+        PrintVolumeDesc(desc);
+        throw VolumeFileContextError("SlicedGridVolumeDesc is invalid for create SlicedGridVolume");
+    }
+    _ = std::make_unique<SlicedGridVolumePrivate>();
+    _->desc = desc;
+    _->desc.Generate();
+    _->filename = desc.data_path;
+    // writer saves the descriptor file, so the stack can be opened for read back right after
+    _->writer = std::make_unique<SlicedGridVolumeWriter>(_->filename, _->desc);
+    _->reader = std::make_unique<SlicedGridVolumeReader>(_->filename);
+    _->Init(cacheBytes);
+}
+
+template<typename Voxel>
+SlicedGridVolume<Voxel>::SlicedGridVolume(const std::string& filename, size_t cacheBytes)
+: SlicedGridVolume(std::make_unique<SlicedGridVolumeReader>(filename), cacheBytes)
+{
+    _->filename = filename;
+}
+
+template<typename Voxel>
+SlicedGridVolume<Voxel>::SlicedGridVolume(std::unique_ptr<SlicedGridVolumeReader> reader, size_t cacheBytes)
+: RawGridVolume<Voxel>(reader->GetVolumeDesc(), 0, {})
+{
+    auto desc = reader->GetVolumeDesc();
+    if(GetVoxelSize(desc.voxel_info) != sizeof(Voxel)){
+        PrintVolumeDesc(desc);
+        throw VolumeFileContextError("SlicedGridVolume voxel type is not matched with slice stack");
+    }
+    _ = std::make_unique<SlicedGridVolumePrivate>();
+    _->desc = desc;
+    _->desc.Generate();
+    _->reader = std::move(reader);
+    _->writable = _->reader->GetSliceDataFormat() == ".tif";
+    _->Init(cacheBytes);
+    _->on_disk.assign(desc.extend.depth, 1);
+}
+
+template<typename Voxel>
+SlicedGridVolume<Voxel>::~SlicedGridVolume() {
+    _->current.release();
+    try{
+        Flush();
+    }
+    catch(const std::exception& err){
+        std::cerr << "SlicedGridVolume failed to store dirty slices : " << err.what() << std::endl;
+    }
+}
+
+template<typename Voxel>
+SlicedGridVolumeDesc SlicedGridVolume<Voxel>::GetVolumeDesc() const noexcept {
+    return _->desc;
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, Voxel *buf) {
+    assert(buf && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    _->template ForEachSliceRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                                       [&](int x, int y, int z, const Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(buf + offset, row, sizeof(Voxel) * count);
+    });
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::ReadVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeReadFunc<Voxel> reader) {
+    assert(reader && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    _->template ForEachSliceRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, false,
+                                       [&](int x, int y, int z, const Voxel* row, int count){
+        for(int i = 0; i < count; i++)
+            reader(x + i - srcX, y - srcY, z - srcZ, row[i]);
+    });
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, const Voxel *buf) {
+    assert(buf && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    size_t len_y = dstY - srcY, len_x = dstX - srcX;
+    _->template ForEachSliceRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, true,
+                                       [&](int x, int y, int z, Voxel* row, int count){
+        size_t offset = (size_t)(z - srcZ) * len_x * len_y + (size_t)(y - srcY) * len_x + x - srcX;
+        std::memcpy(row, buf + offset, sizeof(Voxel) * count);
+    });
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::WriteVoxels(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, TVolumeWriteFunc<Voxel> writer) {
+    assert(writer && srcX < dstX && srcY < dstY && srcZ < dstZ);
+    _->template ForEachSliceRow<Voxel>(srcX, srcY, srcZ, dstX, dstY, dstZ, true,
+                                       [&](int x, int y, int z, Voxel* row, int count){
+        for(int i = 0; i < count; i++)
+            writer(x + i - srcX, y - srcY, z - srcZ, row[i]);
+    });
+}
+
+template<typename Voxel>
+Voxel& SlicedGridVolume<Voxel>::operator()(int x, int y, int z) {
+    assert(x >= 0 && y >= 0 && z >= 0 && (uint32_t)x < _->desc.extend.width
+           && (uint32_t)y < _->desc.extend.height && (uint32_t)z < _->desc.extend.depth);
+    auto ptr = reinterpret_cast<Voxel*>(_->PinCurrent(z));
+    return ptr[(size_t)y * _->desc.extend.width + x];
+}
+
+template<typename Voxel>
+const Voxel& SlicedGridVolume<Voxel>::operator()(int x, int y, int z) const {
+    assert(x >= 0 && y >= 0 && z >= 0 && (uint32_t)x < _->desc.extend.width
+           && (uint32_t)y < _->desc.extend.height && (uint32_t)z < _->desc.extend.depth);
+    auto ptr = reinterpret_cast<const Voxel*>(_->PinCurrent(z));
+    return ptr[(size_t)y * _->desc.extend.width + x];
+}
+
+template<typename Voxel>
+VolumeType SlicedGridVolume<Voxel>::GetVolumeType() const noexcept {
+    return VolumeType::Grid_SLICED;
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::ReadSlice(SliceAxis axis, int sliceIndex, void* buf) {
+    const auto extend = GetPermutedExtend(_->desc.extend, axis);
+    ReadSlice(0, 0, extend.width, extend.height, axis, sliceIndex, buf);
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::ReadSlice(int srcX, int srcY, int dstX, int dstY, SliceAxis axis, int sliceIndex, void* buf) {
+    assert(buf && srcX < dstX && srcY < dstY);
+    auto dst_ptr = reinterpret_cast<Voxel*>(buf);
+    if(axis == SliceAxis::AXIS_Z){
+        ReadVoxels(srcX, srcY, sliceIndex, dstX, dstY, sliceIndex + 1, dst_ptr);
+    }
+    else if(axis == SliceAxis::AXIS_X){
+        // slice (y, z) is read as a one voxel wide box which already has y as the fastest axis
+        ReadVoxels(sliceIndex, srcX, srcY, sliceIndex + 1, dstX, dstY, dst_ptr);
+    }
+    else{
+        // slice (z, x) is read as (x, z) rows of a one voxel high box then transposed
+        const uint32_t len_z = dstX - srcX, len_x = dstY - srcY;
+        std::vector<Voxel> plane((size_t)len_z * len_x);
+        ReadVoxels(srcY, sliceIndex, srcX, dstY, sliceIndex + 1, dstX, plane.data());
+        TransposePlaneBytes(plane.data(), len_x, dst_ptr, len_z, len_z, len_x, sizeof(Voxel));
+    }
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::WriteSlice(SliceAxis axis, int sliceIndex, const void* buf) {
+    const auto extend = GetPermutedExtend(_->desc.extend, axis);
+    WriteSlice(0, 0, extend.width, extend.height, axis, sliceIndex, buf);
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::WriteSlice(int srcX, int srcY, int dstX, int dstY, SliceAxis axis, int sliceIndex, const void* buf) {
+    assert(buf && srcX < dstX && srcY < dstY);
+    auto src_ptr = reinterpret_cast<const Voxel*>(buf);
+    if(axis == SliceAxis::AXIS_Z){
+        WriteVoxels(srcX, srcY, sliceIndex, dstX, dstY, sliceIndex + 1, src_ptr);
+    }
+    else if(axis == SliceAxis::AXIS_X){
+        WriteVoxels(sliceIndex, srcX, srcY, sliceIndex + 1, dstX, dstY, src_ptr);
+    }
+    else{
+        const uint32_t len_z = dstX - srcX, len_x = dstY - srcY;
+        std::vector<Voxel> plane((size_t)len_z * len_x);
+        TransposePlaneBytes(src_ptr, len_z, plane.data(), len_x, len_x, len_z, sizeof(Voxel));
+        WriteVoxels(srcY, sliceIndex, srcX, dstY, sliceIndex + 1, dstX, plane.data());
+    }
+}
+
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::Flush() {
+    _->FlushAll();
+}
 
+template<typename Voxel>
+void SlicedGridVolume<Voxel>::MarkSliceDirty(int sliceIndex) {
+    if(sliceIndex < 0 || sliceIndex >= (int)_->desc.extend.depth)
+        throw std::out_of_range("SlicedGridVolume slice index out of range");
+    _->CheckWritable();
+    _->MarkDirty(sliceIndex);
+}
 
+template class SlicedGridVolume<VoxelRU8>;
+template class SlicedGridVolume<VoxelRU16>;
 
-VOL_END
\ No newline at end of file
+VOL_END
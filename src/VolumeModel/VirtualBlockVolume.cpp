@@ -0,0 +1,255 @@
+#include <VolumeUtils/Volume.hpp>
+
+#include "../Common/Utils.hpp"
+#include "../Common/Common.hpp"
+
+#include <condition_variable>
+#include <deque>
+
+VOL_BEGIN
+
+class VirtualBlockVolumePrivate{
+public:
+    EncodedBlockedGridVolumeDesc desc;
+    Extend3D block_dim;
+    size_t block_bytes = 0;
+    uint32_t slot_count = 0;
+
+    std::unique_ptr<uint8_t[]> pool;
+    std::unique_ptr<std::atomic<uint32_t>[]> page_table;
+    std::unique_ptr<std::atomic<uint32_t>[]> slot_frame;
+    const std::atomic<uint32_t>* frame = nullptr;
+
+    // slot bookkeeping is only touched by loaders under slot_mtx
+    std::mutex slot_mtx;
+    // page owning each slot, MissingPage if free and LoadingPage while filled
+    std::vector<uint32_t> slot_page;
+    // frame seen by the clock hand at its last pass, a newer lookup gives the slot a second chance
+    std::vector<uint32_t> slot_seen;
+    std::vector<uint32_t> free_slots;
+    uint32_t hand = 0;
+    std::atomic<uint32_t> resident_count{0};
+
+    std::mutex queue_mtx;
+    std::condition_variable queue_cv;
+    std::condition_variable idle_cv;
+    std::deque<uint32_t> queue;
+    int busy_count = 0;
+    bool stop = false;
+
+    std::vector<std::unique_ptr<EncodedBlockedGridVolumeReader>> readers;
+    std::vector<std::thread> loaders;
+
+    BlockIndex GetBlockIndex(uint32_t page) const noexcept {
+        const uint32_t x = page % block_dim.width;
+        const uint32_t y = page / block_dim.width % block_dim.height;
+        const uint32_t z = page / block_dim.width / block_dim.height;
+        return {(int)x, (int)y, (int)z};
+    }
+
+    /**
+     * @brief Try to take the slot from its page, fails if the page was looked up in the current frame meanwhile.
+     * Lookup stores the frame then reloads the entry, here the entry is stored then the frame reloaded,
+     * so with sequentially consistent order at least one side sees the other.
+     */
+    bool TryEvict(uint32_t slot, uint32_t current_frame){
+        const uint32_t page = slot_page[slot];
+        uint32_t expected = slot;
+        if(!page_table[page].compare_exchange_strong(expected, VirtualBlockVolume::MissingPage)){
+            // entry is published together with slot_page, a mismatch is never ours to take
+            return false;
+        }
+        if(slot_frame[slot].load() == current_frame){
+            expected = VirtualBlockVolume::MissingPage;
+            if(page_table[page].compare_exchange_strong(expected, slot))
+                return false;
+            // page is loading again elsewhere, keep the slot
+        }
+        resident_count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @return free or evicted slot marked as loading, MissingPage if every slot is used in the current frame.
+     */
+    uint32_t AcquireSlot(){
+        std::lock_guard<std::mutex> lk(slot_mtx);
+        if(!free_slots.empty()){
+            auto slot = free_slots.back();
+            free_slots.pop_back();
+            slot_page[slot] = VirtualBlockVolume::LoadingPage;
+            return slot;
+        }
+        const uint32_t current_frame = frame->load();
+        for(uint32_t step = 0; step < slot_count * 2 + 1; step++){
+            const uint32_t slot = hand;
+            hand = (hand + 1) % slot_count;
+            if(slot_page[slot] >= VirtualBlockVolume::LoadingPage) continue;
+            const uint32_t used = slot_frame[slot].load(std::memory_order_relaxed);
+            if(used == current_frame) continue;
+            if(used != slot_seen[slot]){
+                slot_seen[slot] = used;
+                continue;
+            }
+            if(!TryEvict(slot, current_frame)) continue;
+            slot_page[slot] = VirtualBlockVolume::LoadingPage;
+            return slot;
+        }
+        return VirtualBlockVolume::MissingPage;
+    }
+
+    void ReleaseSlot(uint32_t slot){
+        std::lock_guard<std::mutex> lk(slot_mtx);
+        slot_page[slot] = VirtualBlockVolume::MissingPage;
+        free_slots.push_back(slot);
+    }
+
+    void LoadPage(EncodedBlockedGridVolumeReader& reader, uint32_t page, Packets& packets){
+        const auto block_index = GetBlockIndex(page);
+        uint32_t slot = VirtualBlockVolume::MissingPage;
+        try{
+            packets.clear();
+            if(reader.ReadEncodedBlockData(block_index, packets) == 0){
+                page_table[page].store(VirtualBlockVolume::EmptyPage, std::memory_order_release);
+                return;
+            }
+            slot = AcquireSlot();
+            if(slot == VirtualBlockVolume::MissingPage){
+                // dropped, reported again by a later frame
+                page_table[page].store(VirtualBlockVolume::MissingPage, std::memory_order_release);
+                return;
+            }
+            reader.DecodeBlockData(block_index, packets, pool.get() + slot * block_bytes);
+        }
+        catch(const std::exception& err){
+            // page goes back to missing so a later frame can report it again
+            std::cerr << "VirtualBlockVolume failed to load block " << block_index << " : " << err.what() << std::endl;
+            if(slot != VirtualBlockVolume::MissingPage) ReleaseSlot(slot);
+            page_table[page].store(VirtualBlockVolume::MissingPage, std::memory_order_release);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(slot_mtx);
+            slot_page[slot] = page;
+            // fresh block is kept at least through the current frame
+            slot_frame[slot].store(frame->load(), std::memory_order_relaxed);
+            slot_seen[slot] = slot_frame[slot].load(std::memory_order_relaxed);
+            // published in the same section so the clock hand never sees the slot owned but the entry still loading
+            resident_count.fetch_add(1, std::memory_order_relaxed);
+            page_table[page].store(slot, std::memory_order_release);
+        }
+    }
+
+    void LoaderLoop(int loader_index){
+        auto& reader = *readers[loader_index];
+        Packets packets;
+        for(;;){
+            uint32_t page;
+            {
+                std::unique_lock<std::mutex> lk(queue_mtx);
+                queue_cv.wait(lk, [&]{ return stop || !queue.empty(); });
+                if(stop) return;
+                page = queue.front();
+                queue.pop_front();
+                busy_count++;
+            }
+            LoadPage(reader, page, packets);
+            {
+                std::lock_guard<std::mutex> lk(queue_mtx);
+                busy_count--;
+                if(queue.empty() && busy_count == 0) idle_cv.notify_all();
+            }
+        }
+    }
+};
+
+VirtualBlockVolume::VirtualBlockVolume(const std::string& filename, const VirtualBlockVolumeCreateInfo& info) {
+    if(info.physical_block_count == 0 || info.physical_block_count >= LoadingPage){
+        throw std::invalid_argument("VirtualBlockVolume physical block count is invalid : " + std::to_string(info.physical_block_count));
+    }
+    _ = std::make_unique<VirtualBlockVolumePrivate>();
+    const int loader_count = actual_worker_count(info.loader_count);
+    for(int i = 0; i < loader_count; i++)
+        _->readers.push_back(std::make_unique<EncodedBlockedGridVolumeReader>(filename));
+
+    _->desc = _->readers.front()->GetVolumeDesc();
+    auto dim = [&](uint32_t len){ return (len + _->desc.block_length - 1) / _->desc.block_length; };
+    _->block_dim = {dim(_->desc.extend.width), dim(_->desc.extend.height), dim(_->desc.extend.depth)};
+    const size_t block_size = _->desc.block_length + 2 * _->desc.padding;
+    _->block_bytes = block_size * block_size * block_size * GetVoxelSize(_->desc.voxel_info);
+    _->slot_count = info.physical_block_count;
+
+    _->pool = std::make_unique<uint8_t[]>(_->block_bytes * _->slot_count);
+    _->page_table = std::make_unique<std::atomic<uint32_t>[]>(_->block_dim.size());
+    for(size_t i = 0; i < _->block_dim.size(); i++)
+        _->page_table[i].store(MissingPage, std::memory_order_relaxed);
+    _->slot_frame = std::make_unique<std::atomic<uint32_t>[]>(_->slot_count);
+    _->slot_page.assign(_->slot_count, MissingPage);
+    _->slot_seen.assign(_->slot_count, 0);
+    _->free_slots.resize(_->slot_count);
+    // slot 0 is handed out first
+    for(uint32_t i = 0; i < _->slot_count; i++)
+        _->free_slots[i] = _->slot_count - 1 - i;
+    _->frame = &frame;
+
+    block_dim = _->block_dim;
+    block_bytes = _->block_bytes;
+    pool = _->pool.get();
+    page_table = _->page_table.get();
+    slot_frame = _->slot_frame.get();
+
+    for(int i = 0; i < loader_count; i++)
+        _->loaders.emplace_back([this, i]{ _->LoaderLoop(i); });
+}
+
+VirtualBlockVolume::~VirtualBlockVolume() {
+    {
+        std::lock_guard<std::mutex> lk(_->queue_mtx);
+        _->stop = true;
+    }
+    _->queue_cv.notify_all();
+    for(auto& loader : _->loaders)
+        loader.join();
+}
+
+EncodedBlockedGridVolumeDesc VirtualBlockVolume::GetVolumeDesc() const noexcept {
+    return _->desc;
+}
+
+uint32_t VirtualBlockVolume::GetPhysicalBlockCount() const noexcept {
+    return _->slot_count;
+}
+
+void VirtualBlockVolume::ReportMisses(std::span<const BlockIndex> blocks) {
+    size_t queued = 0;
+    {
+        std::lock_guard<std::mutex> lk(_->queue_mtx);
+        for(auto& block : blocks){
+            if(block.x < 0 || block.y < 0 || block.z < 0 || block.x >= (int)block_dim.width
+               || block.y >= (int)block_dim.height || block.z >= (int)block_dim.depth)
+                continue;
+            const uint32_t page = (uint32_t)(((size_t)block.z * block_dim.height + block.y) * block_dim.width + block.x);
+            uint32_t expected = MissingPage;
+            // duplicates in the batch or already queued ones fail here
+            if(!page_table[page].compare_exchange_strong(expected, LoadingPage)) continue;
+            _->queue.push_back(page);
+            queued++;
+        }
+    }
+    if(queued) _->queue_cv.notify_all();
+}
+
+void VirtualBlockVolume::BeginFrame() noexcept {
+    frame.fetch_add(1);
+}
+
+void VirtualBlockVolume::WaitIdle() {
+    std::unique_lock<std::mutex> lk(_->queue_mtx);
+    _->idle_cv.wait(lk, [&]{ return _->queue.empty() && _->busy_count == 0; });
+}
+
+uint32_t VirtualBlockVolume::GetResidentBlockCount() const noexcept {
+    return _->resident_count.load(std::memory_order_relaxed);
+}
+
+VOL_END
@@ -1,8 +1,37 @@
 #include <VolumeUtils/Volume.hpp>
+#include "../Common/Utils.hpp"
 
 VOL_BEGIN
 
+void ParallelForRange(int beg, int end, const std::function<void(int, int)>& func, int workerCount){
+    parallel_forrange(beg, end, func, workerCount);
+}
 
+void Permute3D(const void* src, const Extend3D& extend, size_t elementSize, SliceAxis axis, void* dst, int workerCount){
+    assert(src && dst && elementSize);
+    auto src_ptr = reinterpret_cast<const uint8_t*>(src);
+    auto dst_ptr = reinterpret_cast<uint8_t*>(dst);
+    const size_t w = extend.width, h = extend.height, d = extend.depth;
+    const size_t slice_bytes = w * h * elementSize;
+    if(axis == SliceAxis::AXIS_Y){
+        // dst(z, x, y) = src(x, y, z), each y plane is a d x w transpose with rows strided by a slice
+        parallel_forrange(0, (int)h, [&](int, int y){
+            TransposePlaneBytes(src_ptr + y * w * elementSize, w * h, dst_ptr + y * d * w * elementSize, d,
+                                (uint32_t)d, (uint32_t)w, elementSize);
+        }, workerCount);
+    }
+    else if(axis == SliceAxis::AXIS_X){
+        // dst(y, z, x) = src(x, y, z), each z slice is a h x w transpose scattered into rows of dst x planes
+        parallel_forrange(0, (int)d, [&](int, int z){
+            TransposePlaneBytes(src_ptr + z * slice_bytes, w, dst_ptr + z * h * elementSize, h * d,
+                                (uint32_t)h, (uint32_t)w, elementSize);
+        }, workerCount);
+    }
+    else{
+        parallel_forrange(0, (int)d, [&](int, int z){
+            std::memcpy(dst_ptr + z * slice_bytes, src_ptr + z * slice_bytes, slice_bytes);
+        }, workerCount);
+    }
+}
 
-
-VOL_END
\ No newline at end of file
+VOL_END
@@ -0,0 +1,638 @@
+#include <VolumeUtils/Volume.hpp>
+
+#include "../Common/Utils.hpp"
+#include "../Common/Common.hpp"
+#include "../Common/SIMD.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <json.hpp>
+
+VOL_BEGIN
+
+namespace{
+
+    // voxels counted by one task, small enough to balance the workers and to stay in cache for the float passes
+    constexpr size_t ChunkVoxelCount = 1ull << 18;
+
+    /**
+     * @brief Read [0, depth) in z slabs with halo slices on both sides, the next slab is read while func runs on the current one.
+     * @param func (const uint8_t* slab, int read_beg, int z_beg, int z_end), slab starts at slice read_beg.
+     */
+    template<typename Func>
+    void StreamSlabs(CVolumeReaderInterface& reader, const Extend3D& extend, size_t voxel_size, size_t slab_bytes, int halo, Func&& func){
+        const size_t slice_bytes = static_cast<size_t>(extend.width) * extend.height * voxel_size;
+        const int depth = static_cast<int>(extend.depth);
+        const size_t fit = slab_bytes / slice_bytes;
+        const size_t halo_slices = 2 * static_cast<size_t>(halo);
+        const int slab_depth = static_cast<int>(std::clamp<size_t>(fit > halo_slices ? fit - halo_slices : 1, 1, depth));
+        const size_t read_depth = (std::min)(slab_depth + 2 * halo, depth);
+
+        std::vector<uint8_t> slabs[2];
+        slabs[0].resize(read_depth * slice_bytes);
+        if(slab_depth < depth) slabs[1].resize(read_depth * slice_bytes);
+
+        auto read = [&](int z, uint8_t* buf){
+            reader.ReadVolumeData(0, 0, (std::max)(z - halo, 0), extend.width, extend.height,
+                                  (std::min)(z + slab_depth + halo, depth), buf);
+        };
+        read(0, slabs[0].data());
+        for(int z = 0, cur = 0; z < depth; z += slab_depth, cur ^= 1){
+            std::future<void> next;
+            if(z + slab_depth < depth)
+                next = std::async(std::launch::async, read, z + slab_depth, slabs[cur ^ 1].data());
+            func(slabs[cur].data(), (std::max)(z - halo, 0), z, (std::min)(z + slab_depth, depth));
+            if(next.valid()) next.get();
+        }
+    }
+
+    /**
+     * @param func (const uint8_t* slab, size_t voxel_count)
+     */
+    template<typename Func>
+    void StreamSlabs(CVolumeReaderInterface& reader, const Extend3D& extend, size_t voxel_size, size_t slab_bytes, Func&& func){
+        StreamSlabs(reader, extend, voxel_size, slab_bytes, 0, [&](const uint8_t* slab, int, int z_beg, int z_end){
+            func(slab, static_cast<size_t>(z_end - z_beg) * extend.width * extend.height);
+        });
+    }
+
+    template<typename Func>
+    void ForEachChunk(size_t voxel_count, int worker_count, Func&& func){
+        const size_t chunk_count = (voxel_count + ChunkVoxelCount - 1) / ChunkVoxelCount;
+        parallel_forrange(size_t(0), chunk_count, [&](int thread_index, size_t chunk){
+            const size_t beg = chunk * ChunkVoxelCount;
+            func(thread_index, beg, (std::min)(beg + ChunkVoxelCount, voxel_count));
+        }, worker_count);
+    }
+
+    inline bool IsFinite(float v) noexcept {
+        return v >= std::numeric_limits<float>::lowest() && v <= std::numeric_limits<float>::max();
+    }
+
+    template<typename T>
+    void CountValues(const T* src, size_t count, int stride, uint64_t* histogram){
+        if constexpr(sizeof(T) == 1){
+            // separate tables so runs of one value do not serialize on a single counter
+            uint32_t tables[4][256] = {};
+            size_t i = 0;
+            for(; i + 4 <= count; i += 4){
+                tables[0][src[(i + 0) * stride]]++;
+                tables[1][src[(i + 1) * stride]]++;
+                tables[2][src[(i + 2) * stride]]++;
+                tables[3][src[(i + 3) * stride]]++;
+            }
+            for(; i < count; i++)
+                tables[0][src[i * stride]]++;
+            for(int v = 0; v < 256; v++)
+                histogram[v] += static_cast<uint64_t>(tables[0][v]) + tables[1][v] + tables[2][v] + tables[3][v];
+        }
+        else{
+            for(size_t i = 0; i < count; i++)
+                histogram[src[i * stride]]++;
+        }
+    }
+
+}
+
+class VolumeStatisticsPrivate{
+public:
+    struct Moments{
+        uint64_t count = 0;
+        double mean = 0.0;
+        // sum of squared differences from mean
+        double m2 = 0.0;
+
+        void Merge(const Moments& other) noexcept {
+            if(other.count == 0) return;
+            const double n = static_cast<double>(count + other.count);
+            const double delta = other.mean - mean;
+            mean += delta * other.count / n;
+            m2 += other.m2 + delta * delta * (static_cast<double>(count) * other.count / n);
+            count += other.count;
+        }
+    };
+
+    VoxelInfo voxel_info = {VoxelType::unknown, VoxelFormat::NONE};
+    uint64_t count = 0;
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double variance = 0.0;
+    std::vector<uint64_t> histogram;
+    double histogram_min = 0.0;
+    double bin_width = 1.0;
+
+    int worker_count = 1;
+    int stride = 1;
+
+    template<typename T>
+    void ComputeInteger(CVolumeReaderInterface& reader, const Extend3D& extend, size_t slab_bytes){
+        const size_t bin_count = size_t(1) << (sizeof(T) * 8);
+        std::vector<std::vector<uint64_t>> thread_histograms(worker_count, std::vector<uint64_t>(bin_count, 0));
+        StreamSlabs(reader, extend, sizeof(T) * stride, slab_bytes, [&](const uint8_t* slab, size_t voxel_count){
+            auto src = reinterpret_cast<const T*>(slab);
+            ForEachChunk(voxel_count, worker_count, [&](int thread_index, size_t beg, size_t end){
+                CountValues(src + beg * stride, end - beg, stride, thread_histograms[thread_index].data());
+            });
+        });
+
+        histogram.assign(bin_count, 0);
+        for(auto& h : thread_histograms)
+            for(size_t v = 0; v < bin_count; v++)
+                histogram[v] += h[v];
+        FinishIntegerHistogram();
+    }
+
+    // every moment is exact from the full histogram
+    void FinishIntegerHistogram(){
+        const size_t bin_count = histogram.size();
+        double sum = 0.0;
+        size_t lo = bin_count, hi = 0;
+        for(size_t v = 0; v < bin_count; v++){
+            if(histogram[v] == 0) continue;
+            lo = (std::min)(lo, v);
+            hi = v;
+            count += histogram[v];
+            sum += static_cast<double>(v) * histogram[v];
+        }
+        histogram_min = 0.0;
+        bin_width = 1.0;
+        if(count == 0) return;
+        min = static_cast<double>(lo);
+        max = static_cast<double>(hi);
+        mean = sum / count;
+        double m2 = 0.0;
+        for(size_t v = lo; v <= hi; v++){
+            const double d = static_cast<double>(v) - mean;
+            m2 += d * d * histogram[v];
+        }
+        variance = m2 / count;
+    }
+
+    void ComputeFloat(CVolumeReaderInterface& reader, const Extend3D& extend, size_t slab_bytes, uint32_t bin_count){
+        struct ThreadState{
+            float lo = std::numeric_limits<float>::max();
+            float hi = std::numeric_limits<float>::lowest();
+            Moments moments;
+        };
+        std::vector<ThreadState> states(worker_count);
+        std::vector<float> scratch(static_cast<size_t>(worker_count) * (stride > 1 ? ChunkVoxelCount : 0));
+        auto chunk_values = [&](const float* src, int thread_index, size_t beg, size_t end) -> const float* {
+            if(stride == 1) return src + beg;
+            float* dst = scratch.data() + thread_index * ChunkVoxelCount;
+            for(size_t i = beg; i < end; i++)
+                dst[i - beg] = src[i * stride];
+            return dst;
+        };
+
+        // first pass : range and moments
+        StreamSlabs(reader, extend, sizeof(float) * stride, slab_bytes, [&](const uint8_t* slab, size_t voxel_count){
+            auto src = reinterpret_cast<const float*>(slab);
+            ForEachChunk(voxel_count, worker_count, [&](int thread_index, size_t beg, size_t end){
+                const float* values = chunk_values(src, thread_index, beg, end);
+                const size_t n = end - beg;
+                auto [lo, hi] = find_finite_min_max(values, n);
+                Moments m;
+                double sum = 0.0;
+                for(size_t i = 0; i < n; i++){
+                    if(!IsFinite(values[i])) continue;
+                    sum += values[i];
+                    m.count++;
+                }
+                if(m.count == 0) return;
+                m.mean = sum / m.count;
+                for(size_t i = 0; i < n; i++){
+                    if(!IsFinite(values[i])) continue;
+                    const double d = values[i] - m.mean;
+                    m.m2 += d * d;
+                }
+                auto& state = states[thread_index];
+                state.lo = (std::min)(state.lo, lo);
+                state.hi = (std::max)(state.hi, hi);
+                state.moments.Merge(m);
+            });
+        });
+
+        Moments total;
+        float lo = std::numeric_limits<float>::max();
+        float hi = std::numeric_limits<float>::lowest();
+        for(auto& state : states){
+            total.Merge(state.moments);
+            lo = (std::min)(lo, state.lo);
+            hi = (std::max)(hi, state.hi);
+        }
+        histogram.assign(bin_count, 0);
+        if(total.count == 0) return;
+        count = total.count;
+        min = lo;
+        max = hi;
+        mean = total.mean;
+        variance = total.m2 / count;
+        histogram_min = lo;
+        bin_width = hi > lo ? (static_cast<double>(hi) - lo) / bin_count : 1.0;
+
+        // second pass : bins over [min, max]
+        std::vector<std::vector<uint64_t>> thread_histograms(worker_count, std::vector<uint64_t>(bin_count, 0));
+        const double scale = 1.0 / bin_width;
+        StreamSlabs(reader, extend, sizeof(float) * stride, slab_bytes, [&](const uint8_t* slab, size_t voxel_count){
+            auto src = reinterpret_cast<const float*>(slab);
+            ForEachChunk(voxel_count, worker_count, [&](int thread_index, size_t beg, size_t end){
+                const float* values = chunk_values(src, thread_index, beg, end);
+                auto h = thread_histograms[thread_index].data();
+                for(size_t i = 0; i < end - beg; i++){
+                    if(!IsFinite(values[i])) continue;
+                    const auto bin = static_cast<size_t>((values[i] - histogram_min) * scale);
+                    h[(std::min)(bin, static_cast<size_t>(bin_count - 1))]++;
+                }
+            });
+        });
+        for(auto& h : thread_histograms)
+            for(uint32_t b = 0; b < bin_count; b++)
+                histogram[b] += h[b];
+    }
+};
+
+CVolumeStatistics::CVolumeStatistics(CVolumeReaderInterface& reader, const Extend3D& extend, const VoxelInfo& voxel_info,
+                                     const VolumeStatisticsCreateInfo& info) {
+    if(!CheckValidation(voxel_info)){
+        throw std::invalid_argument("VolumeStatistics invalid voxel info");
+    }
+    if(IsVoxelTypeInteger(voxel_info.type) == false && info.float_bin_count == 0){
+        throw std::invalid_argument("VolumeStatistics float bin count is zero");
+    }
+    _ = std::make_unique<VolumeStatisticsPrivate>();
+    _->voxel_info = voxel_info;
+    _->stride = GetVoxelSampleCount(voxel_info.format);
+#ifdef HIGH_PERFORMANCE
+    _->worker_count = actual_worker_count(info.thread_count);
+#endif
+    if(extend.size() == 0){
+        _->histogram.assign(voxel_info.type == VoxelType::float32 ? info.float_bin_count
+                            : (size_t(1) << GetVoxelBits(voxel_info.type)), 0);
+        return;
+    }
+
+    switch (voxel_info.type) {
+        case VoxelType::uint8 : _->ComputeInteger<uint8_t>(reader, extend, info.slab_bytes);
+            break;
+        case VoxelType::uint16 : _->ComputeInteger<uint16_t>(reader, extend, info.slab_bytes);
+            break;
+        case VoxelType::float32 : _->ComputeFloat(reader, extend, info.slab_bytes, info.float_bin_count);
+            break;
+        default : assert(false);
+    }
+}
+
+CVolumeStatistics::CVolumeStatistics(const VoxelInfo& voxel_info, std::vector<uint64_t> histogram) {
+    if(!CheckValidation(voxel_info) || !IsVoxelTypeInteger(voxel_info.type)
+       || histogram.size() != (size_t(1) << GetVoxelBits(voxel_info.type))){
+        throw std::invalid_argument("VolumeStatistics histogram does not match voxel info");
+    }
+    _ = std::make_unique<VolumeStatisticsPrivate>();
+    _->voxel_info = voxel_info;
+    _->histogram = std::move(histogram);
+    _->FinishIntegerHistogram();
+}
+
+CVolumeStatistics::~CVolumeStatistics() {
+
+}
+
+bool CVolumeStatistics::SaveToFile(const std::string& filename) const {
+    std::ofstream out(filename);
+    if(!out.is_open()){
+        std::cerr << "Open file failed : " << filename << std::endl;
+        return false;
+    }
+    nlohmann::json jj;
+    auto& j = jj["statistics"];
+    j[detail::voxel_type]   = VoxelTypeToStr(_->voxel_info.type);
+    j[detail::voxel_format] = VoxelFormatToStr(_->voxel_info.format);
+    j["voxel_count"] = _->count;
+    j["min"]         = _->min;
+    j["max"]         = _->max;
+    j["mean"]        = _->mean;
+    j["variance"]    = _->variance;
+    auto& percentiles = j["percentiles"];
+    for(int p : {1, 5, 25, 50, 75, 95, 99})
+        percentiles[std::to_string(p)] = GetPercentile(p);
+    auto& histogram = j["histogram"];
+    histogram["min"]       = _->histogram_min;
+    histogram["bin_width"] = _->bin_width;
+    histogram["bins"]      = _->histogram;
+
+    out << jj;
+    out.flush();
+    return out.good();
+}
+
+VoxelInfo CVolumeStatistics::GetVoxelInfo() const noexcept {
+    return _->voxel_info;
+}
+
+uint64_t CVolumeStatistics::GetVoxelCount() const noexcept {
+    return _->count;
+}
+
+double CVolumeStatistics::GetMin() const noexcept {
+    return _->min;
+}
+
+double CVolumeStatistics::GetMax() const noexcept {
+    return _->max;
+}
+
+double CVolumeStatistics::GetMean() const noexcept {
+    return _->mean;
+}
+
+double CVolumeStatistics::GetVariance() const noexcept {
+    return _->variance;
+}
+
+const std::vector<uint64_t>& CVolumeStatistics::GetHistogram() const noexcept {
+    return _->histogram;
+}
+
+double CVolumeStatistics::GetHistogramMin() const noexcept {
+    return _->histogram_min;
+}
+
+double CVolumeStatistics::GetHistogramBinWidth() const noexcept {
+    return _->bin_width;
+}
+
+double CVolumeStatistics::GetPercentile(double percent) const noexcept {
+    if(_->count == 0) return 0.0;
+    percent = std::clamp(percent, 0.0, 100.0);
+    const auto target = (std::max)(uint64_t(1), static_cast<uint64_t>(std::ceil(percent * 0.01 * _->count)));
+    const bool integer = IsVoxelTypeInteger(_->voxel_info.type);
+    uint64_t before = 0;
+    for(size_t i = 0; i < _->histogram.size(); i++){
+        const uint64_t n = _->histogram[i];
+        if(before + n < target){
+            before += n;
+            continue;
+        }
+        if(integer) return _->histogram_min + static_cast<double>(i);
+        const double value = _->histogram_min + _->bin_width * (i + static_cast<double>(target - before) / n);
+        return std::clamp(value, _->min, _->max);
+    }
+    return _->max;
+}
+
+class VolumeGradientHistogramPrivate{
+public:
+    struct GradientBinning{
+        float value_min;
+        float value_scale;
+        float gradient_scale;
+        int intensity_bins;
+        int gradient_bins;
+    };
+
+    // one row of voxels with the rows around it, inv_* is 1 / neighbor distance or 0 on a flat axis
+    template<typename T>
+    struct GradientRow{
+        const T* row;
+        const T* y_prev;
+        const T* y_next;
+        const T* z_prev;
+        const T* z_next;
+        float inv_y;
+        float inv_z;
+    };
+
+    static void CountGradientVoxel(float v, float gx, float gy, float gz, const GradientBinning& bin, uint64_t* histogram){
+        const float g = std::sqrt(gx * gx + gy * gy + gz * gz);
+        if(!IsFinite(v) || !IsFinite(g)) return;
+        const float i = std::clamp((v - bin.value_min) * bin.value_scale, 0.f, static_cast<float>(bin.intensity_bins - 1));
+        const float k = std::clamp(g * bin.gradient_scale, 0.f, static_cast<float>(bin.gradient_bins - 1));
+        histogram[static_cast<int>(k) * bin.intensity_bins + static_cast<int>(i)]++;
+    }
+
+    template<typename T>
+    static void CountGradientScalar(const GradientRow<T>& r, int x, int width, int stride, const GradientBinning& bin, uint64_t* histogram){
+        const int xp = (std::max)(x - 1, 0);
+        const int xn = (std::min)(x + 1, width - 1);
+        const float inv_x = xn > xp ? 1.f / static_cast<float>(xn - xp) : 0.f;
+        auto at = [stride](const T* p, int i){ return static_cast<float>(p[static_cast<size_t>(i) * stride]); };
+        CountGradientVoxel(at(r.row, x),
+                           (at(r.row, xn) - at(r.row, xp)) * inv_x,
+                           (at(r.y_next, x) - at(r.y_prev, x)) * r.inv_y,
+                           (at(r.z_next, x) - at(r.z_prev, x)) * r.inv_z,
+                           bin, histogram);
+    }
+
+#if defined(VOL_SIMD_AVX2)
+    template<typename T>
+    static __m256 load_float8(const T* p){
+        if constexpr(sizeof(T) == 1)
+            return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+        else if constexpr(sizeof(T) == 2)
+            return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+        else
+            return _mm256_loadu_ps(p);
+    }
+
+    // interior voxels [x, x + 8) of a single channel row
+    template<typename T>
+    static void CountGradient8(const GradientRow<T>& r, int x, const GradientBinning& bin, uint64_t* histogram){
+        const __m256 v = load_float8(r.row + x);
+        const __m256 gx = _mm256_mul_ps(_mm256_sub_ps(load_float8(r.row + x + 1), load_float8(r.row + x - 1)), _mm256_set1_ps(0.5f));
+        const __m256 gy = _mm256_mul_ps(_mm256_sub_ps(load_float8(r.y_next + x), load_float8(r.y_prev + x)), _mm256_set1_ps(r.inv_y));
+        const __m256 gz = _mm256_mul_ps(_mm256_sub_ps(load_float8(r.z_next + x), load_float8(r.z_prev + x)), _mm256_set1_ps(r.inv_z));
+        const __m256 g = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy)), _mm256_mul_ps(gz, gz)));
+
+        // max with 0 first also sends NaN to 0, those lanes are dropped by the finite mask
+        __m256 i = _mm256_mul_ps(_mm256_sub_ps(v, _mm256_set1_ps(bin.value_min)), _mm256_set1_ps(bin.value_scale));
+        i = _mm256_min_ps(_mm256_max_ps(i, _mm256_setzero_ps()), _mm256_set1_ps(static_cast<float>(bin.intensity_bins - 1)));
+        __m256 k = _mm256_mul_ps(g, _mm256_set1_ps(bin.gradient_scale));
+        k = _mm256_min_ps(_mm256_max_ps(k, _mm256_setzero_ps()), _mm256_set1_ps(static_cast<float>(bin.gradient_bins - 1)));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(k), _mm256_set1_epi32(bin.intensity_bins)),
+                                         _mm256_cvttps_epi32(i));
+        if constexpr(std::is_same_v<T, float>){
+            const __m256 lowest = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+            const __m256 highest = _mm256_set1_ps(std::numeric_limits<float>::max());
+            const __m256 finite = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(v, lowest, _CMP_GE_OQ), _mm256_cmp_ps(v, highest, _CMP_LE_OQ)),
+                                                _mm256_cmp_ps(g, highest, _CMP_LE_OQ));
+            index = _mm256_blendv_epi8(_mm256_set1_epi32(-1), index, _mm256_castps_si256(finite));
+        }
+        alignas(32) int32_t indices[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(indices), index);
+        for(int lane = 0; lane < 8; lane++){
+            if constexpr(std::is_same_v<T, float>){
+                if(indices[lane] < 0) continue;
+            }
+            histogram[indices[lane]]++;
+        }
+    }
+#endif
+
+    template<typename T>
+    static void CountGradientRow(const GradientRow<T>& r, int width, int stride, const GradientBinning& bin, uint64_t* histogram){
+        int x = 0;
+        CountGradientScalar(r, x++, width, stride, bin, histogram);
+#if defined(VOL_SIMD_AVX2)
+        if(stride == 1){
+            for(; x + 8 < width; x += 8)
+                CountGradient8(r, x, bin, histogram);
+        }
+#endif
+        for(; x < width; x++)
+            CountGradientScalar(r, x, width, stride, bin, histogram);
+    }
+
+    VoxelInfo voxel_info = {VoxelType::unknown, VoxelFormat::NONE};
+    uint32_t intensity_bin_count = 0;
+    uint32_t gradient_bin_count = 0;
+    double intensity_min = 0.0;
+    double intensity_max = 0.0;
+    double max_gradient = 0.0;
+    std::vector<uint64_t> histogram;
+
+    int worker_count = 1;
+    int stride = 1;
+
+    template<typename T>
+    void Compute(CVolumeReaderInterface& reader, const Extend3D& extend, size_t slab_bytes){
+        const GradientBinning bin = {
+            static_cast<float>(intensity_min),
+            static_cast<float>(intensity_bin_count / (intensity_max - intensity_min)),
+            static_cast<float>(gradient_bin_count / max_gradient),
+            static_cast<int>(intensity_bin_count),
+            static_cast<int>(gradient_bin_count)
+        };
+        const int width = static_cast<int>(extend.width);
+        const int height = static_cast<int>(extend.height);
+        const int depth = static_cast<int>(extend.depth);
+        const size_t row_size = static_cast<size_t>(width) * stride;
+        const size_t rows_per_chunk = (std::max<size_t>)(1, ChunkVoxelCount / width);
+
+        std::vector<std::vector<uint64_t>> thread_histograms(worker_count, std::vector<uint64_t>(histogram.size(), 0));
+        StreamSlabs(reader, extend, sizeof(T) * stride, slab_bytes, 1, [&](const uint8_t* slab, int read_beg, int z_beg, int z_end){
+            auto src = reinterpret_cast<const T*>(slab);
+            auto row_ptr = [&](int y, int z){ return src + (static_cast<size_t>(z - read_beg) * height + y) * row_size; };
+            const size_t row_count = static_cast<size_t>(z_end - z_beg) * height;
+            parallel_forrange(size_t(0), (row_count + rows_per_chunk - 1) / rows_per_chunk, [&](int thread_index, size_t chunk){
+                auto h = thread_histograms[thread_index].data();
+                const size_t row_end = (std::min)(row_count, (chunk + 1) * rows_per_chunk);
+                for(size_t row = chunk * rows_per_chunk; row < row_end; row++){
+                    const int y = static_cast<int>(row % height);
+                    const int z = z_beg + static_cast<int>(row / height);
+                    const int yp = (std::max)(y - 1, 0), yn = (std::min)(y + 1, height - 1);
+                    const int zp = (std::max)(z - 1, 0), zn = (std::min)(z + 1, depth - 1);
+                    const GradientRow<T> r = {
+                        row_ptr(y, z), row_ptr(yp, z), row_ptr(yn, z), row_ptr(y, zp), row_ptr(y, zn),
+                        yn > yp ? 1.f / static_cast<float>(yn - yp) : 0.f,
+                        zn > zp ? 1.f / static_cast<float>(zn - zp) : 0.f
+                    };
+                    CountGradientRow(r, width, stride, bin, h);
+                }
+            }, worker_count);
+        });
+
+        for(auto& h : thread_histograms)
+            for(size_t i = 0; i < histogram.size(); i++)
+                histogram[i] += h[i];
+    }
+};
+
+VolumeGradientHistogram::VolumeGradientHistogram(CVolumeReaderInterface& reader, const Extend3D& extend, const VoxelInfo& voxel_info,
+                                                 const VolumeGradientHistogramCreateInfo& info) {
+    if(!CheckValidation(voxel_info)){
+        throw std::invalid_argument("VolumeGradientHistogram invalid voxel info");
+    }
+    if(info.intensity_bin_count == 0 || info.gradient_bin_count == 0 || info.max_gradient < 0.f){
+        throw std::invalid_argument("VolumeGradientHistogram invalid histogram axes");
+    }
+    _ = std::make_unique<VolumeGradientHistogramPrivate>();
+    _->voxel_info = voxel_info;
+    _->stride = GetVoxelSampleCount(voxel_info.format);
+#ifdef HIGH_PERFORMANCE
+    _->worker_count = actual_worker_count(info.thread_count);
+#endif
+    _->intensity_bin_count = info.intensity_bin_count;
+    _->gradient_bin_count = info.gradient_bin_count;
+    if(IsVoxelTypeInteger(voxel_info.type)){
+        // one past the max value so each bin covers the same count of integers
+        _->intensity_min = 0.0;
+        _->intensity_max = static_cast<double>(size_t(1) << GetVoxelBits(voxel_info.type));
+    }
+    else{
+        if(!(info.value_max > info.value_min)){
+            throw std::invalid_argument("VolumeGradientHistogram invalid value range");
+        }
+        _->intensity_min = info.value_min;
+        _->intensity_max = info.value_max;
+    }
+    // interior central differences are at most half the range on each axis
+    _->max_gradient = info.max_gradient > 0.f ? info.max_gradient
+                      : (_->intensity_max - _->intensity_min) * 0.5 * std::sqrt(3.0);
+    _->histogram.assign(static_cast<size_t>(_->intensity_bin_count) * _->gradient_bin_count, 0);
+    if(extend.size() == 0) return;
+
+    switch (voxel_info.type) {
+        case VoxelType::uint8 : _->Compute<uint8_t>(reader, extend, info.slab_bytes);
+            break;
+        case VoxelType::uint16 : _->Compute<uint16_t>(reader, extend, info.slab_bytes);
+            break;
+        case VoxelType::float32 : _->Compute<float>(reader, extend, info.slab_bytes);
+            break;
+        default : assert(false);
+    }
+}
+
+VolumeGradientHistogram::~VolumeGradientHistogram() {
+
+}
+
+uint32_t VolumeGradientHistogram::GetIntensityBinCount() const noexcept {
+    return _->intensity_bin_count;
+}
+
+uint32_t VolumeGradientHistogram::GetGradientBinCount() const noexcept {
+    return _->gradient_bin_count;
+}
+
+double VolumeGradientHistogram::GetIntensityMin() const noexcept {
+    return _->intensity_min;
+}
+
+double VolumeGradientHistogram::GetIntensityMax() const noexcept {
+    return _->intensity_max;
+}
+
+double VolumeGradientHistogram::GetMaxGradient() const noexcept {
+    return _->max_gradient;
+}
+
+const std::vector<uint64_t>& VolumeGradientHistogram::GetHistogram() const noexcept {
+    return _->histogram;
+}
+
+bool VolumeGradientHistogram::SaveToFile(const std::string& filename) const {
+    std::ofstream out(filename);
+    if(!out.is_open()){
+        std::cerr << "Open file failed : " << filename << std::endl;
+        return false;
+    }
+    nlohmann::json jj;
+    auto& j = jj["gradient_histogram"];
+    j[detail::voxel_type]   = VoxelTypeToStr(_->voxel_info.type);
+    j[detail::voxel_format] = VoxelFormatToStr(_->voxel_info.format);
+    j["intensity_min"]       = _->intensity_min;
+    j["intensity_max"]       = _->intensity_max;
+    j["intensity_bin_count"] = _->intensity_bin_count;
+    j["max_gradient"]        = _->max_gradient;
+    j["gradient_bin_count"]  = _->gradient_bin_count;
+    j["bins"]                = _->histogram;
+
+    out << jj;
+    out.flush();
+    return out.good();
+}
+
+VOL_END
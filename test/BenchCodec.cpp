@@ -0,0 +1,292 @@
+//
+// Codec benchmark and rate-distortion sweep.
+// usage : bench_codec [--volume xxx.raw.desc.json]... [--block_lengths 64,128,256,512] [--paddings 0,2]
+//                     [--types uint8,uint16] [--codecs video,bits,video_hilo] [--presets ultrafast,medium]
+//                     [--threads 1,0] [--blocks 1] [--csv out.csv] [--json out.json]
+// without --volume only synthetic volumes are measured, thread count 0 is hardware concurrency.
+//
+#include <VolumeUtils/Volume.hpp>
+#include <Common.hpp>
+#include "TestUtils.hpp"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+using namespace vol;
+
+struct BenchConfig{
+    std::vector<std::string> volumes;
+    std::vector<int> block_lengths = {64, 128, 256, 512};
+    std::vector<int> paddings = {0, 2};
+    std::vector<VoxelType> types = {VoxelType::uint8, VoxelType::uint16};
+    std::vector<GridVolumeCodec> codecs = {GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO,
+                                           GridVolumeCodec::GRID_VOLUME_CODEC_BITS,
+                                           GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO};
+    std::vector<std::string> presets = {"ultrafast", "medium"};
+    std::vector<int> threads = {1, 0};
+    int blocks = 1;
+    std::string csv_path;
+    std::string json_path;
+};
+
+struct BenchResult{
+    std::string dataset;
+    std::string codec;
+    std::string type;
+    int block_length = 0;
+    int padding = 0;
+    std::string preset;
+    int threads = 0;
+    size_t raw_bytes = 0;
+    size_t encoded_bytes = 0;
+    double bits_per_voxel = 0.0;
+    double encode_mbps = 0.0;
+    double decode_mbps = 0.0;
+    double mse = 0.0;
+    double psnr = 0.0;
+    double max_error = 0.0;
+};
+
+// one block of voxels, uint8 or uint16 stored in bytes
+struct BenchBlock{
+    std::string dataset;
+    VoxelType type;
+    uint32_t length;
+    std::vector<uint8_t> data;
+};
+
+template<typename T>
+std::vector<T> ParseList(const std::string& str, std::function<T(const std::string&)> parse){
+    std::vector<T> ret;
+    size_t beg = 0;
+    while(beg <= str.size()){
+        auto end = str.find(',', beg);
+        if(end == std::string::npos) end = str.size();
+        if(end > beg) ret.push_back(parse(str.substr(beg, end - beg)));
+        beg = end + 1;
+    }
+    return ret;
+}
+
+BenchConfig ParseArgs(int argc, char** argv){
+    BenchConfig config;
+    auto to_int = [](const std::string& s){ return std::stoi(s); };
+    auto to_str = [](const std::string& s){ return s; };
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string key = argv[i], value = argv[i + 1];
+        if(key == "--volume") config.volumes.push_back(value);
+        else if(key == "--block_lengths") config.block_lengths = ParseList<int>(value, to_int);
+        else if(key == "--paddings") config.paddings = ParseList<int>(value, to_int);
+        else if(key == "--types") config.types = ParseList<VoxelType>(value, [](const std::string& s){ return StrToVoxelType(s); });
+        else if(key == "--codecs") config.codecs = ParseList<GridVolumeCodec>(value, [](const std::string& s){ return StrToGridVolumeDataCodec(s); });
+        else if(key == "--presets") config.presets = ParseList<std::string>(value, to_str);
+        else if(key == "--threads") config.threads = ParseList<int>(value, to_int);
+        else if(key == "--blocks") config.blocks = std::max(1, std::stoi(value));
+        else if(key == "--csv") config.csv_path = value;
+        else if(key == "--json") config.json_path = value;
+        else std::cerr << "Unknown argument : " << key << std::endl;
+    }
+    return config;
+}
+
+template<typename T>
+void GenerateSynthetic(const std::string& kind, uint32_t length, uint32_t seed, T* dst){
+    const double max_value = std::numeric_limits<T>::max();
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    // a few gaussian blobs for the sparse kind, like labeled cells in microscopy
+    struct Blob{ double x, y, z, r; };
+    std::vector<Blob> blobs(16);
+    for(auto& b : blobs) b = {uniform(rng) * length, uniform(rng) * length, uniform(rng) * length, 2.0 + uniform(rng) * length / 16.0};
+    size_t idx = 0;
+    for(uint32_t z = 0; z < length; z++){
+        for(uint32_t y = 0; y < length; y++){
+            for(uint32_t x = 0; x < length; x++){
+                double v = 0.0;
+                if(kind == "smooth"){
+                    const double f = 6.2831853 / length;
+                    v = 0.5 + 0.2 * std::sin(x * f * 2) * std::cos(y * f * 3) + 0.2 * std::sin(z * f * 1.5 + x * f) + noise(rng);
+                }
+                else if(kind == "sparse"){
+                    for(auto& b : blobs){
+                        double d2 = (x - b.x) * (x - b.x) + (y - b.y) * (y - b.y) + (z - b.z) * (z - b.z);
+                        v += std::exp(-d2 / (2.0 * b.r * b.r));
+                    }
+                }
+                else{
+                    v = uniform(rng);
+                }
+                dst[idx++] = static_cast<T>(std::clamp(v, 0.0, 1.0) * max_value + 0.5);
+            }
+        }
+    }
+}
+
+std::vector<BenchBlock> MakeSyntheticBlocks(VoxelType type, uint32_t length, int count){
+    std::vector<BenchBlock> blocks;
+    for(const char* kind : {"smooth", "sparse", "noise"}){
+        for(int i = 0; i < count; i++){
+            auto& block = blocks.emplace_back(BenchBlock{std::string("synthetic_") + kind, type, length, {}});
+            block.data.resize((size_t)length * length * length * GetVoxelBits(type) / 8);
+            if(type == VoxelType::uint8)
+                GenerateSynthetic(kind, length, i, block.data.data());
+            else
+                GenerateSynthetic(kind, length, i, reinterpret_cast<uint16_t*>(block.data.data()));
+        }
+    }
+    return blocks;
+}
+
+// blocks are taken evenly along the diagonal of the volume
+std::vector<BenchBlock> ReadVolumeBlocks(const std::string& filename, VoxelType type, uint32_t length, int count){
+    std::vector<BenchBlock> blocks;
+    RawGridVolumeReader reader(filename);
+    auto desc = reader.GetVolumeDesc();
+    if(desc.voxel_info.type != type || desc.voxel_info.format != VoxelFormat::R) return blocks;
+    const auto& extend = desc.extend;
+    if(extend.width < length || extend.height < length || extend.depth < length) return blocks;
+    for(int i = 0; i < count; i++){
+        const double t = count == 1 ? 0.5 : double(i) / (count - 1);
+        const int x = (int)((extend.width - length) * t);
+        const int y = (int)((extend.height - length) * t);
+        const int z = (int)((extend.depth - length) * t);
+        auto& block = blocks.emplace_back(BenchBlock{desc.volume_name, type, length, {}});
+        block.data.resize((size_t)length * length * length * GetVoxelSize(desc.voxel_info));
+        reader.ReadVolumeData(x, y, z, x + (int)length, y + (int)length, z + (int)length, block.data.data());
+    }
+    return blocks;
+}
+
+BenchResult RunOne(CVolumeCodecInterface& codec, const BenchBlock& block){
+    using Clock = std::chrono::steady_clock;
+    BenchResult result;
+    const Extend3D extend = {block.length, block.length, block.length};
+    const size_t voxel_count = extend.size();
+    result.raw_bytes = block.data.size();
+
+    PacketArena arena;
+    auto t0 = Clock::now();
+    codec.Encode(extend, block.data.data(), block.data.size(), arena);
+    auto t1 = Clock::now();
+    result.encoded_bytes = arena.size();
+
+    // record parsing is not counted in decode time
+    Packets packets;
+    ParsePacketRecords(arena.data(), arena.size(), packets);
+    std::vector<uint8_t> decoded(block.data.size());
+    auto t2 = Clock::now();
+    codec.Decode(extend, packets, decoded.data(), decoded.size());
+    auto t3 = Clock::now();
+
+    auto mbps = [&](Clock::duration d){
+        double s = std::chrono::duration<double>(d).count();
+        return s > 0.0 ? result.raw_bytes / (1024.0 * 1024.0) / s : 0.0;
+    };
+    result.encode_mbps = mbps(t1 - t0);
+    result.decode_mbps = mbps(t3 - t2);
+    result.bits_per_voxel = 8.0 * result.encoded_bytes / double(voxel_count);
+    const auto error = block.type == VoxelType::uint8
+            ? CalcError(block.data.data(), decoded.data(), voxel_count)
+            : CalcError(reinterpret_cast<const uint16_t*>(block.data.data()), reinterpret_cast<const uint16_t*>(decoded.data()), voxel_count);
+    result.mse = error.mse;
+    result.psnr = error.psnr;
+    result.max_error = error.max_error;
+    return result;
+}
+
+void WriteCSV(std::ostream& os, const std::vector<BenchResult>& results){
+    os << "dataset,codec,type,block_length,padding,preset,threads,raw_bytes,encoded_bytes,bits_per_voxel,"
+          "encode_mbps,decode_mbps,mse,psnr,max_error\n";
+    for(auto& r : results){
+        os << r.dataset << "," << r.codec << "," << r.type << "," << r.block_length << "," << r.padding << ","
+           << r.preset << "," << r.threads << "," << r.raw_bytes << "," << r.encoded_bytes << "," << r.bits_per_voxel << ","
+           << r.encode_mbps << "," << r.decode_mbps << "," << r.mse << "," << r.psnr << "," << r.max_error << "\n";
+    }
+}
+
+void WriteJson(std::ostream& os, const std::vector<BenchResult>& results){
+    nlohmann::json j = nlohmann::json::array();
+    for(auto& r : results){
+        j.push_back({
+            {"dataset", r.dataset}, {"codec", r.codec}, {"type", r.type},
+            {"block_length", r.block_length}, {"padding", r.padding}, {"preset", r.preset}, {"threads", r.threads},
+            {"raw_bytes", r.raw_bytes}, {"encoded_bytes", r.encoded_bytes}, {"bits_per_voxel", r.bits_per_voxel},
+            {"encode_mbps", r.encode_mbps}, {"decode_mbps", r.decode_mbps},
+            // json has no inf, lossless is written as null
+            {"mse", r.mse}, {"psnr", std::isinf(r.psnr) ? nlohmann::json() : nlohmann::json(r.psnr)}, {"max_error", r.max_error}
+        });
+    }
+    os << j.dump(4) << std::endl;
+}
+
+int main(int argc, char** argv){
+    auto config = ParseArgs(argc, argv);
+    std::vector<BenchResult> results;
+    for(auto type : config.types){
+        for(int block_length : config.block_lengths){
+            for(int padding : config.paddings){
+                const uint32_t length = block_length + 2 * padding;
+                auto blocks = MakeSyntheticBlocks(type, length, config.blocks);
+                for(auto& volume : config.volumes){
+                    auto volume_blocks = ReadVolumeBlocks(volume, type, length, config.blocks);
+                    blocks.insert(blocks.end(), std::make_move_iterator(volume_blocks.begin()), std::make_move_iterator(volume_blocks.end()));
+                }
+                for(auto codec_type : config.codecs){
+                    // presets only matter for video streams
+                    const bool is_video = codec_type != GridVolumeCodec::GRID_VOLUME_CODEC_BITS;
+                    const std::vector<std::string> presets = is_video ? config.presets : std::vector<std::string>{"none"};
+                    for(auto& preset : presets){
+                        for(int threads : config.threads){
+                            VideoEncodeSettings settings;
+                            if(is_video) settings.preset = preset;
+                            VolumeCodecCreateInfo info{
+                                .codec = codec_type,
+                                .voxel_info = {type, VoxelFormat::R},
+                                .device = CodecDevice::CPU,
+                                .thread_count = threads,
+                                .encode_settings = settings
+                            };
+                            if(!VolumeCodecRegistry::GetInstance().IsRegistered(info.codec, info.voxel_info, info.device)) continue;
+                            auto codec = VolumeCodecRegistry::GetInstance().Create(info);
+                            for(auto& block : blocks){
+                                try{
+                                    auto result = RunOne(*codec, block);
+                                    result.dataset = block.dataset;
+                                    result.codec = VolumeCodecToStr(codec_type);
+                                    result.type = VoxelTypeToStr(type);
+                                    result.block_length = block_length;
+                                    result.padding = padding;
+                                    result.preset = preset;
+                                    result.threads = threads;
+                                    std::cerr << result.dataset << " " << result.codec << " " << result.type
+                                              << " block " << block_length << " padding " << padding << " preset " << preset
+                                              << " threads " << threads << " : " << result.bits_per_voxel << " bpv, psnr "
+                                              << result.psnr << std::endl;
+                                    results.push_back(std::move(result));
+                                }
+                                catch(const std::exception& e){
+                                    std::cerr << "bench failed : " << e.what() << std::endl;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if(!config.csv_path.empty()){
+        std::ofstream out(config.csv_path);
+        WriteCSV(out, results);
+    }
+    if(!config.json_path.empty()){
+        std::ofstream out(config.json_path);
+        WriteJson(out, results);
+    }
+    if(config.csv_path.empty() && config.json_path.empty())
+        WriteCSV(std::cout, results);
+    return 0;
+}
@@ -0,0 +1,63 @@
+//
+// Tests ReadBlockSlices on blocks encoded with a fixed keyframe interval against a full block decode.
+//
+#include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
+#include <cmath>
+#include <filesystem>
+using namespace vol;
+
+std::vector<uint8_t> MakeBlock(uint32_t length){
+    std::vector<uint8_t> data((size_t)length * length * length);
+    size_t i = 0;
+    for(uint32_t z = 0; z < length; z++)
+        for(uint32_t y = 0; y < length; y++)
+            for(uint32_t x = 0; x < length; x++)
+                data[i++] = static_cast<uint8_t>(127.5 + 127.5 * std::sin(0.11 * x + 0.07 * y + 0.05 * z));
+    return data;
+}
+
+void TestKeyframeInterval(int keyframe_interval){
+    const std::string name = "test_block_slices_" + std::to_string(keyframe_interval);
+    EncodedBlockedGridVolumeDesc desc;
+    desc.volume_name = name;
+    desc.data_path = name + ".ebd";
+    desc.voxel_info = {VoxelType::uint8, VoxelFormat::R};
+    desc.extend = {62, 62, 62};
+    desc.space = {0.01f, 0.01f, 0.01f};
+    desc.block_length = 62;
+    desc.padding = 1;
+    desc.codec = GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO;
+    desc.encode_settings.keyframe_interval = keyframe_interval;
+
+    const uint32_t length = desc.block_length + 2 * desc.padding;
+    const size_t slice_bytes = (size_t)length * length;
+    const auto block = MakeBlock(length);
+    {
+        EncodedBlockedGridVolumeWriter writer(name + ".encoded_blocked.desc.json", desc);
+        writer.WriteBlockData({0, 0, 0}, block.data());
+    }
+
+    EncodedBlockedGridVolumeReader reader(name + ".encoded_blocked.desc.json");
+    std::vector<uint8_t> full(block.size());
+    reader.ReadBlockData({0, 0, 0}, full.data());
+
+    // ranges inside one gop, across gops, on gop borders and up to the last short gop
+    const std::pair<int, int> ranges[] = {{0, 1}, {0, (int)length}, {3, 5}, {8, 16}, {7, 9}, {13, 42}, {60, 64}, {63, 64}};
+    for(auto [z0, z1] : ranges){
+        std::vector<uint8_t> slices((z1 - z0) * slice_bytes, 0);
+        reader.ReadBlockSlices({0, 0, 0}, z0, z1, slices.data());
+        CHECK(std::memcmp(slices.data(), full.data() + z0 * slice_bytes, slices.size()) == 0);
+    }
+    std::filesystem::remove(name + ".encoded_blocked.desc.json");
+    std::filesystem::remove(desc.data_path);
+}
+
+int main(){
+    TestKeyframeInterval(8);
+    TestKeyframeInterval(5);
+    // no keyframe table, falls back to full block decode
+    TestKeyframeInterval(0);
+    std::cout << "TestBlockSlices passed" << std::endl;
+    return 0;
+}
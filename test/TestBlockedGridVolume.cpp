@@ -0,0 +1,104 @@
+//
+// Tests BlockedGridVolume voxel, region, brick and row access against a linear reference.
+//
+#include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
+#include <atomic>
+#include <utility>
+using namespace vol;
+
+uint16_t Value(int x, int y, int z){
+    return static_cast<uint16_t>(x + y * 37 + z * 1013);
+}
+
+void TestBlockedGridVolume(uint32_t block_length, uint32_t padding){
+    BlockedGridVolumeDesc desc;
+    desc.voxel_info = {VoxelType::uint16, VoxelFormat::R};
+    desc.extend = {37, 29, 23};
+    desc.space = {1.f, 1.f, 1.f};
+    desc.block_length = block_length;
+    desc.padding = padding;
+    const int w = desc.extend.width, h = desc.extend.height, d = desc.extend.depth;
+
+    std::vector<VoxelRU16> ref((size_t)w * h * d);
+    for(int z = 0; z < d; z++)
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++)
+                ref[((size_t)z * h + y) * w + x].x = Value(x, y, z);
+
+    BlockedGridVolume<VoxelRU16> volume(desc);
+    volume.WriteVoxels(0, 0, 0, w, h, d, ref.data());
+
+    for(int z = 0; z < d; z++)
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++)
+                CHECK(std::as_const(volume)(x, y, z).x == Value(x, y, z));
+
+    // region crossing brick borders
+    {
+        const int sx = 3, sy = 5, sz = 2, ex = 31, ey = 20, ez = 19;
+        std::vector<VoxelRU16> region((size_t)(ex - sx) * (ey - sy) * (ez - sz));
+        volume.ReadVoxels(sx, sy, sz, ex, ey, ez, region.data());
+        size_t i = 0;
+        for(int z = sz; z < ez; z++)
+            for(int y = sy; y < ey; y++)
+                for(int x = sx; x < ex; x++)
+                    CHECK(region[i++].x == Value(x, y, z));
+    }
+
+    // padding of every brick holds its neighbors
+    const auto dim = volume.GetBlockDim();
+    const int bs = block_length + 2 * padding;
+    for(int bz = 0; bz < (int)dim.depth; bz++)
+        for(int by = 0; by < (int)dim.height; by++)
+            for(int bx = 0; bx < (int)dim.width; bx++){
+                auto brick = std::as_const(volume).GetRawBlockData({bx, by, bz});
+                for(int k = 0; k < bs; k++)
+                    for(int j = 0; j < bs; j++)
+                        for(int i = 0; i < bs; i++){
+                            const int x = bx * (int)block_length - (int)padding + i;
+                            const int y = by * (int)block_length - (int)padding + j;
+                            const int z = bz * (int)block_length - (int)padding + k;
+                            if(x < 0 || y < 0 || z < 0 || x >= w || y >= h || z >= d) continue;
+                            CHECK(brick[((size_t)k * bs + j) * bs + i].x == Value(x, y, z));
+                        }
+            }
+
+    // rows visit each voxel of the clipped region once
+    for(bool parallel : {false, true}){
+        std::atomic<size_t> count = 0;
+        std::atomic<bool> ok = true;
+        volume.ForEachRow(-4, 2, 1, w + 3, h - 4, d - 1, [&](int x, int y, int z, const VoxelRU16* row, int n){
+            for(int i = 0; i < n; i++)
+                if(row[i].x != Value(x + i, y, z)) ok = false;
+            count += n;
+        }, parallel);
+        CHECK(ok && count == (size_t)w * (h - 6) * (d - 2));
+
+        count = 0;
+        volume.ForEachVoxel(0, 0, 0, w, h, d, [&](int x, int y, int z, VoxelRU16& voxel){
+            if(voxel.x != Value(x, y, z)) ok = false;
+            count++;
+        }, parallel);
+        CHECK(ok && count == ref.size());
+    }
+
+    // the linear walk of the base class does not fit bricks
+    RawGridVolume<VoxelRU16>& base = volume;
+    bool thrown = false;
+    try{
+        base.ForEachRow(0, 0, 0, 1, 1, 1, [](int, int, int, VoxelRU16*, int){});
+    }
+    catch(const std::logic_error&){
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main(){
+    TestBlockedGridVolume(8, 0);
+    TestBlockedGridVolume(8, 1);
+    TestBlockedGridVolume(14, 2);
+    std::cout << "TestBlockedGridVolume passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,108 @@
+//
+// Tests for clock_cache_t eviction order, pinned entries and byte budget.
+//
+#include <ClockCache.hpp>
+#include "TestUtils.hpp"
+#include <string>
+#include <vector>
+
+using Cache = clock_cache_t<int, std::string>;
+
+void Insert(Cache& cache, int key, size_t bytes = 1){
+    auto handle = cache.insert(key, std::to_string(key), bytes);
+    CHECK(handle && *handle == std::to_string(key));
+}
+
+// entries not referenced since the hand last passed are evicted first
+void TestEvictionOrder(){
+    Cache cache(1024, 3, 1);
+    std::vector<int> evicted;
+    cache.set_evict_callback([&](const int& key, std::string& value){
+        CHECK(value == std::to_string(key));
+        evicted.push_back(key);
+    });
+    Insert(cache, 0);
+    Insert(cache, 1);
+    Insert(cache, 2);
+    // all referenced, first round clears the bits and the oldest goes
+    Insert(cache, 3);
+    CHECK(evicted == std::vector<int>{0});
+    CHECK(!cache.exist_key(0));
+    // 1 gets a second chance, 2 was cleared and is not referenced again
+    CHECK(cache.get(1));
+    Insert(cache, 4);
+    CHECK(evicted == (std::vector<int>{0, 2}));
+    CHECK(cache.exist_key(1) && cache.exist_key(3) && cache.exist_key(4));
+
+    auto stats = cache.get_stats();
+    CHECK(stats.evictions == 2 && stats.count == 3 && stats.bytes == 3);
+    CHECK(stats.hits == 1);
+}
+
+void TestPinned(){
+    Cache cache(1024, 2, 1);
+    auto pinned = cache.insert(0, "0", 1);
+    CHECK(pinned);
+    for(int key = 1; key < 10; key++){
+        Insert(cache, key);
+        CHECK(cache.exist_key(0));
+    }
+    CHECK(!cache.erase(0));
+
+    // every entry pinned, insert fails and leaves the value to the caller
+    auto other = cache.get(9);
+    CHECK(other);
+    std::string value = "10";
+    CHECK(!cache.insert(10, std::move(value), 1));
+    CHECK(value == "10");
+
+    bool pinned_zero = false;
+    CHECK(cache.visit(0, [&](std::string& v, bool is_pinned){ pinned_zero = is_pinned && v == "0"; }));
+    CHECK(pinned_zero);
+    size_t pinned_count = 0;
+    cache.for_each([&](const int&, std::string&, bool is_pinned){ pinned_count += is_pinned; });
+    CHECK(pinned_count == 2);
+
+    // re-inserting an existing key returns the cached value
+    auto same = cache.insert(0, "x", 1);
+    CHECK(same && *same == "0");
+
+    pinned.release();
+    same.release();
+    CHECK(cache.erase(0));
+    CHECK(!cache.visit(0, [](std::string&, bool){}));
+    Insert(cache, 10);
+    CHECK(cache.exist_key(10) && cache.exist_key(9));
+}
+
+void TestByteBudget(){
+    Cache cache(100, 8, 1);
+    Insert(cache, 0, 40);
+    Insert(cache, 1, 40);
+    CHECK(cache.get_stats().bytes == 80);
+    // slots are free but bytes are not
+    Insert(cache, 2, 40);
+    auto stats = cache.get_stats();
+    CHECK(stats.bytes <= 100 && stats.count == 2 && !cache.exist_key(0));
+    // larger than the whole budget is rejected without evicting anything
+    CHECK(!cache.insert(3, "3", 101));
+    CHECK(cache.get_stats().count == 2);
+    Insert(cache, 4, 100);
+    stats = cache.get_stats();
+    CHECK(stats.bytes == 100 && stats.count == 1);
+
+    // budget is split between shards
+    Cache sharded(100, 8, 4);
+    CHECK(!sharded.insert(0, "0", 26));
+    Insert(sharded, 0, 25);
+    sharded.clear();
+    CHECK(sharded.get_stats().bytes == 0);
+}
+
+int main(){
+    TestEvictionOrder();
+    TestPinned();
+    TestByteBudget();
+    std::cout << "TestClockCache passed" << std::endl;
+    return 0;
+}
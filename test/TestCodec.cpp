@@ -0,0 +1,122 @@
+//
+// Round trip tests for the codecs created through VolumeCodecRegistry.
+//
+#include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
+#include <cmath>
+#include <random>
+using namespace vol;
+
+std::unique_ptr<CVolumeCodecInterface> CreateCodec(GridVolumeCodec codec, VoxelInfo voxel_info){
+    VolumeCodecCreateInfo info;
+    info.codec = codec;
+    info.voxel_info = voxel_info;
+    info.device = CodecDevice::CPU;
+    auto ret = VolumeCodecRegistry::GetInstance().Create(info);
+    CHECK(ret);
+    return ret;
+}
+
+/**
+ * @brief Smooth field plus noise, channels are offset so a swapped channel is caught.
+ */
+template<typename T>
+std::vector<T> MakeVolume(const Extend3D& extend, int channels, double noise, std::mt19937& rng){
+    std::vector<T> data(extend.size() * channels);
+    std::normal_distribution<double> dist(0.0, noise);
+    const double peak = std::numeric_limits<T>::max();
+    size_t i = 0;
+    for(uint32_t z = 0; z < extend.depth; z++)
+        for(uint32_t y = 0; y < extend.height; y++)
+            for(uint32_t x = 0; x < extend.width; x++)
+                for(int c = 0; c < channels; c++){
+                    double v = 0.5 + 0.4 * std::sin(0.09 * x + 0.05 * y + 0.03 * z + c) + (noise > 0.0 ? dist(rng) : 0.0);
+                    data[i++] = static_cast<T>(std::clamp(v, 0.0, 1.0) * peak);
+                }
+    return data;
+}
+
+template<typename T>
+std::vector<T> RoundTrip(CVolumeCodecInterface& codec, const Extend3D& extend, const std::vector<T>& src){
+    Packets packets;
+    codec.Encode(extend, src.data(), src.size() * sizeof(T), packets);
+    std::vector<T> dst(src.size(), 0);
+    codec.Decode(extend, packets, dst.data(), dst.size() * sizeof(T));
+    return dst;
+}
+
+template<typename Voxel>
+void TestBitsCodec(std::mt19937& rng){
+    using T = typename Voxel::VoxelDataType;
+    auto codec = CreateCodec(GridVolumeCodec::GRID_VOLUME_CODEC_BITS, {Voxel::type, Voxel::format});
+    // extents not a multiple of the 16 slice chunk or the residual group
+    const Extend3D extends[] = {{1, 1, 1}, {64, 64, 64}, {37, 29, 23}, {130, 3, 17}};
+    for(auto& extend : extends){
+        for(double noise : {0.0, 0.01, 1.0}){
+            auto src = MakeVolume<T>(extend, 1, noise, rng);
+            CHECK(RoundTrip(*codec, extend, src) == src);
+        }
+        // extreme residuals
+        std::vector<T> edge(extend.size());
+        for(size_t i = 0; i < edge.size(); i++)
+            edge[i] = (i & 1) ? std::numeric_limits<T>::max() : 0;
+        CHECK(RoundTrip(*codec, extend, edge) == edge);
+    }
+}
+
+void TestHiLoCodec(std::mt19937& rng){
+    auto codec = CreateCodec(GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO_HILO, {VoxelType::uint16, VoxelFormat::R});
+    const Extend3D extend = {64, 64, 64};
+    auto src = MakeVolume<uint16_t>(extend, 1, 0.01, rng);
+    Packets packets;
+    codec->Encode(extend, src.data(), src.size() * sizeof(uint16_t), packets);
+    std::vector<uint16_t> dst(src.size(), 0);
+    codec->Decode(extend, packets, dst.data(), dst.size() * sizeof(uint16_t));
+    // high byte goes through the lossless codec
+    for(size_t i = 0; i < src.size(); i++)
+        CHECK((src[i] >> 8) == (dst[i] >> 8));
+
+    auto throws = [&](const Packets& bad){
+        try{
+            codec->Decode(extend, bad, dst.data(), dst.size() * sizeof(uint16_t));
+        }
+        catch(const VolumeCodecError&){
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws({}));
+    auto bad = packets;
+    bad.pop_back();
+    CHECK(throws(bad));
+}
+
+template<typename Voxel>
+void TestMultiChannelVideoCodec(std::mt19937& rng){
+    using T = typename Voxel::VoxelDataType;
+    constexpr int channels = Voxel::size() / sizeof(T);
+    auto codec = CreateCodec(GridVolumeCodec::GRID_VOLUME_CODEC_VIDEO, {Voxel::type, Voxel::format});
+    const Extend3D extend = {64, 64, 64};
+    auto src = MakeVolume<T>(extend, channels, 0.0, rng);
+    auto dst = RoundTrip(*codec, extend, src);
+    // each channel is its own lossy stream, a swapped or shifted channel drops far below this
+    for(int c = 0; c < channels; c++){
+        auto error = CalcError(src.data() + c, dst.data() + c, extend.size(), channels);
+        CHECK(error.psnr > 30.0);
+    }
+}
+
+int main(){
+    std::mt19937 rng(42);
+    TestBitsCodec<VoxelRU8>(rng);
+    TestBitsCodec<VoxelRU16>(rng);
+    TestHiLoCodec(rng);
+    TestMultiChannelVideoCodec<VoxelRGU8>(rng);
+    TestMultiChannelVideoCodec<VoxelRGBU8>(rng);
+    TestMultiChannelVideoCodec<VoxelRGBAU8>(rng);
+    TestMultiChannelVideoCodec<VoxelRGU16>(rng);
+    TestMultiChannelVideoCodec<VoxelRGBU16>(rng);
+    TestMultiChannelVideoCodec<VoxelRGBAU16>(rng);
+    std::cout << "TestCodec passed" << std::endl;
+    return 0;
+}
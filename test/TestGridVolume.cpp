@@ -2,6 +2,7 @@
 // Created by wyz on 2022/4/29.
 //
 #include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
 #include <iostream>
 #include <fstream>
 #include <unordered_set>
@@ -52,15 +53,7 @@ void run(std::vector<std::string> raw_filenames, std::vector<std::string> eb_fil
 
     auto calc = [&](const std::vector<uint8_t>& a, const std::vector<uint8_t>& b){
         assert(a.size() == b.size());
-        size_t voxel_count = a.size();
-        double mse = 0.0;
-        for(int i = 0; i < voxel_count; i++){
-            int x = a[i], y = b[i];
-            mse += (x - y) * (x - y);
-        }
-        mse = mse / double(voxel_count) ;
-        double ret = 20.0 * std::log10(255) - 10.0 * std::log10(mse);
-        return ret;
+        return CalcError(a.data(), b.data(), a.size()).psnr;
     };
 
     double ret = 0.0;
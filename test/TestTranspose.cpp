@@ -0,0 +1,78 @@
+//
+// Tests for TransposeBlock8x8 and TransposePlane against a naive transpose.
+//
+#include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
+#include <random>
+using namespace vol;
+
+template<typename T>
+std::vector<T> RandomPlane(size_t count, std::mt19937& rng){
+    std::vector<T> plane(count);
+    for(auto& v : plane){
+        if constexpr(std::is_integral_v<T>)
+            v = static_cast<T>(rng());
+        else
+            v = static_cast<T>(rng()) / static_cast<T>(rng.max());
+    }
+    return plane;
+}
+
+template<typename T>
+void NaiveTranspose(const T* src, size_t srcPitch, T* dst, size_t dstPitch, uint32_t rows, uint32_t cols){
+    for(uint32_t r = 0; r < rows; r++)
+        for(uint32_t c = 0; c < cols; c++)
+            dst[c * dstPitch + r] = src[r * srcPitch + c];
+}
+
+#if defined(VOL_SIMD_SSE2)
+template<typename T>
+void TestBlock8x8(std::mt19937& rng){
+    // pitches larger than 8 make sure only the 8x8 block is read and written
+    const size_t src_pitch = 13, dst_pitch = 11;
+    auto src = RandomPlane<T>(src_pitch * 8, rng);
+    std::vector<T> dst(dst_pitch * 8, T(0x5a)), expected = dst;
+    TransposeBlock8x8(src.data(), src_pitch, dst.data(), dst_pitch);
+    NaiveTranspose(src.data(), src_pitch, expected.data(), dst_pitch, 8, 8);
+    CHECK(dst == expected);
+}
+#endif
+
+template<typename T>
+void TestPlane(uint32_t rows, uint32_t cols, size_t pad, std::mt19937& rng){
+    const size_t src_pitch = cols + pad, dst_pitch = rows + pad;
+    auto src = RandomPlane<T>(src_pitch * rows, rng);
+    std::vector<T> dst(dst_pitch * cols, T(0)), expected = dst;
+    TransposePlane(src.data(), src_pitch, dst.data(), dst_pitch, rows, cols);
+    NaiveTranspose(src.data(), src_pitch, expected.data(), dst_pitch, rows, cols);
+    CHECK(dst == expected);
+
+    std::vector<T> bytes(dst.size(), T(0));
+    TransposePlaneBytes(src.data(), src_pitch, bytes.data(), dst_pitch, rows, cols, sizeof(T));
+    CHECK(bytes == expected);
+}
+
+template<typename T>
+void TestPlanes(std::mt19937& rng){
+    // sizes cover full tiles, partial tiles and rows/cols not a multiple of 8
+    const uint32_t sizes[] = {1, 7, 8, 9, 63, 64, 65, 130};
+    for(auto rows : sizes)
+        for(auto cols : sizes)
+            for(size_t pad : {0, 3})
+                TestPlane<T>(rows, cols, pad, rng);
+}
+
+int main(){
+    std::mt19937 rng(42);
+#if defined(VOL_SIMD_SSE2)
+    TestBlock8x8<uint8_t>(rng);
+    TestBlock8x8<uint16_t>(rng);
+#endif
+    TestPlanes<uint8_t>(rng);
+    TestPlanes<uint16_t>(rng);
+    TestPlanes<uint32_t>(rng);
+    TestPlanes<float>(rng);
+    TestPlanes<uint64_t>(rng);
+    std::cout << "TestTranspose passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+// assert is compiled out in release test builds, CHECK always runs
+#define CHECK(expr) \
+    do{ \
+        if(!(expr)){ \
+            std::cerr << __FILE__ << ":" << __LINE__ << " check failed: " #expr << std::endl; \
+            std::exit(1); \
+        } \
+    } while(false)
+
+struct ErrorStats{
+    double mse = 0.0;
+    // inf for identical data
+    double psnr = 0.0;
+    double max_error = 0.0;
+};
+
+/**
+ * @brief Error of b against a over count elements taken every stride elements, peak is the max of T.
+ */
+template<typename T>
+ErrorStats CalcError(const T* a, const T* b, size_t count, size_t stride = 1){
+    ErrorStats stats;
+    double sum = 0.0;
+    for(size_t i = 0; i < count; i++){
+        const double d = double(a[i * stride]) - double(b[i * stride]);
+        sum += d * d;
+        stats.max_error = std::max(stats.max_error, std::abs(d));
+    }
+    const double peak = std::numeric_limits<T>::max();
+    stats.mse = count ? sum / double(count) : 0.0;
+    stats.psnr = stats.mse == 0.0 ? std::numeric_limits<double>::infinity()
+                                  : 20.0 * std::log10(peak) - 10.0 * std::log10(stats.mse);
+    return stats;
+}
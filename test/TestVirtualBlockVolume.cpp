@@ -0,0 +1,102 @@
+//
+// Tests VirtualBlockVolume page table states, CLOCK eviction and protection of blocks used in the current frame.
+//
+#include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
+#include <filesystem>
+using namespace vol;
+
+constexpr uint32_t BlockLength = 16;
+constexpr uint32_t Padding = 1;
+constexpr uint32_t BlockSize = BlockLength + 2 * Padding;
+
+std::vector<uint8_t> MakeBlock(const BlockIndex& block){
+    std::vector<uint8_t> data((size_t)BlockSize * BlockSize * BlockSize);
+    const uint32_t seed = (block.z * 7 + block.y) * 13 + block.x;
+    for(size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(seed * 31 + i);
+    return data;
+}
+
+bool IsResident(uint32_t entry){
+    return entry < VirtualBlockVolume::LoadingPage;
+}
+
+void CheckBlock(const VirtualBlockVolume& volume, const BlockIndex& block){
+    const uint32_t entry = volume.Lookup(block);
+    CHECK(IsResident(entry));
+    const auto expect = MakeBlock(block);
+    CHECK(std::memcmp(volume.GetBlockData(entry), expect.data(), expect.size()) == 0);
+}
+
+int main(){
+    const std::string name = "test_virtual_block_volume";
+    EncodedBlockedGridVolumeDesc desc;
+    desc.volume_name = name;
+    desc.data_path = name + ".ebd";
+    desc.voxel_info = {VoxelType::uint8, VoxelFormat::R};
+    desc.extend = {BlockLength * 3, BlockLength * 2, BlockLength};
+    desc.space = {0.01f, 0.01f, 0.01f};
+    desc.block_length = BlockLength;
+    desc.padding = Padding;
+    desc.codec = GridVolumeCodec::GRID_VOLUME_CODEC_BITS;
+
+    const BlockIndex a = {0, 0, 0}, b = {2, 0, 0}, c = {0, 1, 0}, d = {2, 1, 0};
+    // never written, so it has no encoded data
+    const BlockIndex empty = {1, 0, 0};
+    {
+        EncodedBlockedGridVolumeWriter writer(name + ".encoded_blocked.desc.json", desc);
+        for(auto& block : {a, b, c, d, BlockIndex{1, 1, 0}})
+            writer.WriteBlockData(block, MakeBlock(block).data());
+    }
+    {
+        // one loader keeps the load order of a batch
+        VirtualBlockVolume volume(name + ".encoded_blocked.desc.json", {.physical_block_count = 2, .loader_count = 1});
+        CHECK(volume.GetPhysicalBlockCount() == 2);
+        CHECK(volume.GetBlockBytes() == (size_t)BlockSize * BlockSize * BlockSize);
+        for(auto& block : {a, b, c, d, empty})
+            CHECK(volume.Lookup(block) == VirtualBlockVolume::MissingPage);
+
+        // missing -> loading -> resident, empty block never takes a slot
+        const BlockIndex first[] = {a, empty, a};
+        volume.ReportMisses(first);
+        CHECK(volume.Lookup(a) != VirtualBlockVolume::MissingPage);
+        volume.WaitIdle();
+        CheckBlock(volume, a);
+        CHECK(volume.Lookup(empty) == VirtualBlockVolume::EmptyPage);
+        CHECK(volume.GetResidentBlockCount() == 1);
+
+        // a is used in this frame and b is loaded in it, so c finds no slot and stays missing
+        volume.BeginFrame();
+        CheckBlock(volume, a);
+        const BlockIndex second[] = {b, c};
+        volume.ReportMisses(second);
+        volume.WaitIdle();
+        CheckBlock(volume, b);
+        CHECK(volume.Lookup(c) == VirtualBlockVolume::MissingPage);
+        CheckBlock(volume, a);
+        CHECK(volume.GetResidentBlockCount() == 2);
+
+        // only b is used now, a was not looked up since the hand passed it and is evicted for c
+        volume.BeginFrame();
+        CheckBlock(volume, b);
+        const BlockIndex third[] = {c};
+        volume.ReportMisses(third);
+        volume.WaitIdle();
+        CheckBlock(volume, c);
+        CheckBlock(volume, b);
+        CHECK(volume.Lookup(a) == VirtualBlockVolume::MissingPage);
+        CHECK(volume.GetResidentBlockCount() == 2);
+
+        // out of range and non missing entries are skipped
+        const BlockIndex skipped[] = {BlockIndex{-1, 0, 0}, BlockIndex{3, 0, 0}, empty, b};
+        volume.ReportMisses(skipped);
+        volume.WaitIdle();
+        CHECK(volume.Lookup(empty) == VirtualBlockVolume::EmptyPage);
+        CheckBlock(volume, b);
+    }
+    std::filesystem::remove(name + ".encoded_blocked.desc.json");
+    std::filesystem::remove(desc.data_path);
+    std::cout << "TestVirtualBlockVolume passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,174 @@
+//
+// Tests CVolumeStatistics against a serial reference over an in memory reader, with slabs smaller than the volume.
+//
+#include <VolumeUtils/Volume.hpp>
+#include "TestUtils.hpp"
+#include <random>
+using namespace vol;
+
+struct MemoryReader : CVolumeReaderInterface{
+    std::vector<uint8_t> data;
+    Extend3D extend;
+    size_t voxel_size = 0;
+
+    void ReadVolumeData(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, void* buf) override{
+        // statistics stream whole slices
+        CHECK(srcX == 0 && srcY == 0 && dstX == (int)extend.width && dstY == (int)extend.height);
+        CHECK(0 <= srcZ && srcZ < dstZ && dstZ <= (int)extend.depth);
+        const size_t slice_bytes = (size_t)extend.width * extend.height * voxel_size;
+        std::memcpy(buf, data.data() + srcZ * slice_bytes, (dstZ - srcZ) * slice_bytes);
+    }
+
+    void ReadVolumeData(int, int, int, int, int, int, VolumeReadFunc) override{
+        CHECK(false);
+    }
+};
+
+bool Near(double a, double b, double tolerance){
+    return std::abs(a - b) <= tolerance * (std::max)(1.0, std::abs(b));
+}
+
+/**
+ * @brief Serial statistics of finite values.
+ */
+struct Reference{
+    std::vector<double> values;
+    double min = 0.0, max = 0.0, mean = 0.0, variance = 0.0;
+
+    explicit Reference(std::vector<double> v) : values(std::move(v)){
+        std::sort(values.begin(), values.end());
+        if(values.empty()) return;
+        min = values.front();
+        max = values.back();
+        double sum = 0.0;
+        for(double x : values) sum += x;
+        mean = sum / values.size();
+        double m2 = 0.0;
+        for(double x : values) m2 += (x - mean) * (x - mean);
+        variance = m2 / values.size();
+    }
+
+    double Percentile(double percent) const{
+        const auto target = (std::max)(size_t(1), static_cast<size_t>(std::ceil(percent * 0.01 * values.size())));
+        return values[target - 1];
+    }
+};
+
+void CheckSummary(const CVolumeStatistics& stats, const Reference& ref){
+    CHECK(stats.GetVoxelCount() == ref.values.size());
+    CHECK(stats.GetMin() == ref.min && stats.GetMax() == ref.max);
+    CHECK(Near(stats.GetMean(), ref.mean, 1e-9));
+    CHECK(Near(stats.GetVariance(), ref.variance, 1e-6));
+    uint64_t total = 0;
+    for(auto n : stats.GetHistogram()) total += n;
+    CHECK(total == ref.values.size());
+}
+
+template<typename T>
+void TestInteger(VoxelFormat format, std::mt19937& rng){
+    const int channels = GetVoxelSampleCount(format);
+    MemoryReader reader;
+    reader.extend = {37, 23, 19};
+    reader.voxel_size = sizeof(T) * channels;
+    reader.data.resize(reader.extend.size() * reader.voxel_size);
+    auto src = reinterpret_cast<T*>(reader.data.data());
+    std::uniform_int_distribution<uint32_t> dist(20, (uint32_t)(std::numeric_limits<T>::max() - 20));
+    std::vector<double> values;
+    for(size_t i = 0; i < reader.extend.size(); i++){
+        for(int c = 0; c < channels; c++)
+            src[i * channels + c] = static_cast<T>(dist(rng));
+        values.push_back(src[i * channels]);
+    }
+    const Reference ref(values);
+    const VoxelInfo voxel_info = {sizeof(T) == 1 ? VoxelType::uint8 : VoxelType::uint16, format};
+    const size_t slice_bytes = (size_t)reader.extend.width * reader.extend.height * reader.voxel_size;
+
+    std::vector<uint64_t> histogram(size_t(std::numeric_limits<T>::max()) + 1, 0);
+    for(double v : values) histogram[(size_t)v]++;
+
+    // slabs of a few slices not dividing the depth, and thread counts around the chunk count
+    for(int thread_count : {1, 3, 4}){
+        VolumeStatisticsCreateInfo info;
+        info.slab_bytes = slice_bytes * 4 + 5;
+        info.thread_count = thread_count;
+        CVolumeStatistics stats(reader, reader.extend, voxel_info, info);
+        CheckSummary(stats, ref);
+        CHECK(stats.GetHistogramMin() == 0.0 && stats.GetHistogramBinWidth() == 1.0);
+        CHECK(stats.GetHistogram() == histogram);
+        for(double p : {0.0, 1.0, 50.0, 90.0, 99.5, 100.0})
+            CHECK(stats.GetPercentile(p) == ref.Percentile(p));
+    }
+
+    // the histogram constructor gives the same summary
+    CVolumeStatistics from_histogram(voxel_info, histogram);
+    CheckSummary(from_histogram, ref);
+}
+
+void TestFloat(std::mt19937& rng){
+    MemoryReader reader;
+    reader.extend = {100, 50, 41};
+    reader.voxel_size = sizeof(float);
+    reader.data.resize(reader.extend.size() * sizeof(float));
+    auto src = reinterpret_cast<float*>(reader.data.data());
+    std::normal_distribution<float> dist(5.f, 2.f);
+    std::vector<double> values;
+    for(size_t i = 0; i < reader.extend.size(); i++){
+        if(i % 97 == 0) src[i] = std::numeric_limits<float>::quiet_NaN();
+        else if(i % 101 == 0) src[i] = (i & 1) ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+        else{
+            src[i] = dist(rng);
+            values.push_back(src[i]);
+        }
+    }
+    const Reference ref(values);
+
+    std::vector<uint64_t> first;
+    for(int thread_count : {1, 4}){
+        VolumeStatisticsCreateInfo info;
+        info.float_bin_count = 256;
+        info.slab_bytes = (size_t)reader.extend.width * reader.extend.height * sizeof(float) * 3;
+        info.thread_count = thread_count;
+        CVolumeStatistics stats(reader, reader.extend, {VoxelType::float32, VoxelFormat::R}, info);
+        CheckSummary(stats, ref);
+        CHECK(stats.GetHistogram().size() == 256);
+        CHECK(stats.GetHistogramMin() == ref.min);
+
+        const double width = stats.GetHistogramBinWidth();
+        std::vector<uint64_t> histogram(256, 0);
+        for(double v : values){
+            const auto bin = static_cast<size_t>((v - ref.min) * (1.0 / width));
+            histogram[(std::min)(bin, size_t(255))]++;
+        }
+        CHECK(stats.GetHistogram() == histogram);
+        // interpolated inside the bin
+        for(double p : {1.0, 50.0, 90.0})
+            CHECK(std::abs(stats.GetPercentile(p) - ref.Percentile(p)) <= width);
+        CHECK(stats.GetPercentile(100.0) == ref.max);
+
+        if(first.empty()) first = stats.GetHistogram();
+        CHECK(stats.GetHistogram() == first);
+    }
+}
+
+void TestEmpty(){
+    MemoryReader reader;
+    reader.extend = {8, 8, 8};
+    reader.voxel_size = sizeof(float);
+    reader.data.assign(reader.extend.size() * sizeof(float), 0);
+    auto src = reinterpret_cast<float*>(reader.data.data());
+    for(size_t i = 0; i < reader.extend.size(); i++)
+        src[i] = std::numeric_limits<float>::quiet_NaN();
+    CVolumeStatistics stats(reader, reader.extend, {VoxelType::float32, VoxelFormat::R});
+    CHECK(stats.GetVoxelCount() == 0);
+    CHECK(stats.GetPercentile(50.0) == 0.0);
+}
+
+int main(){
+    std::mt19937 rng(1);
+    TestInteger<uint8_t>(VoxelFormat::RG, rng);
+    TestInteger<uint16_t>(VoxelFormat::R, rng);
+    TestFloat(rng);
+    TestEmpty();
+    std::cout << "TestVolumeStatistics passed" << std::endl;
+    return 0;
+}
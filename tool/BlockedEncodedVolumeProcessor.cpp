@@ -57,7 +57,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -100,7 +100,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -72,7 +72,17 @@ struct IOImpl {
         bool eb_has_ss = oblocked_encoded_unit.ops.op_mask & Statistics;
         auto eb_mapping_func = oblocked_encoded_unit.ops.mapping.GetOp();
 
-        StatisticsOp<Voxel> eb_ss;
+        auto eb_ss = oblocked_encoded_unit.ops.statistics;
+        // the writer visits the padding shared with neighbor blocks and the zero filled voxels past the range end,
+        // only the block's own voxels inside the range are counted
+        auto eb_ss_count = [&](int x_turn, int y_turn, int z_turn, int dx, int dy, int dz){
+            if(dx < padding || dy < padding || dz < padding
+               || dx >= padding + block_length || dy >= padding + block_length || dz >= padding + block_length)
+                return false;
+            return x_turn * block_length + dx - padding < read_x_size
+                   && y_turn * block_length + dy - padding < read_y_size
+                   && z_turn * block_length + dz - padding < read_z_size;
+        };
         progress_bar_t pb(30);
         auto startTime = std::chrono::system_clock::now();
         auto endTime = std::chrono::system_clock::now();
@@ -115,7 +125,8 @@ struct IOImpl {
                                                                       auto p = reinterpret_cast<Voxel *>(dst);
                                                                       int x = x_turn * block_length + dx;
                                                                       *p = eb_mapping_func(grid(x, dy, dz));
-                                                                      eb_ss.AddVoxel(*p);
+                                                                      if (eb_has_ss && eb_ss_count(x_turn, y_turn, z_turn, dx, dy, dz))
+                                                                          eb_ss.AddVoxel(*p);
                                                                   });
                         else
                             encoded_blocked_writer->WriteBlockData({x_turn, y_turn, z_turn},
@@ -124,6 +135,8 @@ struct IOImpl {
                                                                       auto p = reinterpret_cast<Voxel *>(dst);
                                                                       int x = x_turn * block_length + dx;
                                                                       *p = grid(x, dy, dz);
+                                                                      if (eb_has_ss && eb_ss_count(x_turn, y_turn, z_turn, dx, dy, dz))
+                                                                          eb_ss.AddVoxel(*p);
                                                                   });
                         endTime = std::chrono::system_clock::now();
                         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
@@ -182,6 +195,21 @@ struct IOImpl {
             }
         }
         pb.done();
+        if(WriteEB && eb_has_ss){
+            const uint64_t range_size = (uint64_t)read_x_size * read_y_size * read_z_size;
+            if(eb_ss.GetVoxelCount() != range_size)
+                throw std::runtime_error(std::format("Statistics counted {} voxels, expect {} in the range",
+                                                     eb_ss.GetVoxelCount(), range_size));
+            eb_ss.Finish();
+        }
+        FinishStatistics(params);
+    }
+
+    static void FinishStatistics(const PackedParams &params) {
+        for(auto& param : params.writers){
+            if(param.other_has_ss)
+                param.other_ss_func->Finish();
+        }
     }
 
 
@@ -276,7 +304,7 @@ struct IOImpl {
             startTime = std::chrono::system_clock::now();
             lastZ = z + 1;
         }
-
+        FinishStatistics(params);
     }
 
 };
\ No newline at end of file
@@ -54,7 +54,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -98,7 +98,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -139,7 +139,7 @@ public:
                 bool has_ds = op_mask & DownSampling;
                 bool has_ss = op_mask & Statistics;
 
-                auto ss = std::make_shared<StatisticsOp<Voxel>>();
+                auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
                 auto down_sampling_func = unit.ops.down_sampling.GetOp();
                 auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -171,7 +171,7 @@ public:
                 bool has_ds = op_mask & DownSampling;
                 bool has_ss = op_mask & Statistics;
 
-                auto ss = std::make_shared<StatisticsOp<Voxel>>();
+                auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
                 auto down_sampling_func = unit.ops.down_sampling.GetOp();
                 auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -232,7 +232,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -267,7 +267,7 @@ public:
         auto oblocked_encoded_unit = unit_mp[VolumeType::Grid_BLOCKED_ENCODED].front();
         unit_mp[VolumeType::Grid_BLOCKED_ENCODED].pop();
         auto oslice_desc = oslice_unit.desc.sliced_desc;
-        auto other_ss = std::make_shared<StatisticsOp<Voxel>>();
+        auto other_ss = std::make_shared<StatisticsOp<Voxel>>(oslice_unit.ops.statistics);
         SlicedGridVolumeWriter other_writer(oslice_unit.desc_filename, oslice_desc);
         typename IOImpl<Voxel>::PackedParams0 packed{
                 .reader = raw_reader.get(),
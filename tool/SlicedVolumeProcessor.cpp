@@ -85,7 +85,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -127,7 +127,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -170,7 +170,7 @@ public:
                 bool has_ds = op_mask & DownSampling;
                 bool has_ss = op_mask & Statistics;
 
-                auto ss = std::make_shared<StatisticsOp<Voxel>>();
+                auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
                 auto down_sampling_func = unit.ops.down_sampling.GetOp();
                 auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -202,7 +202,7 @@ public:
                 bool has_ds = op_mask & DownSampling;
                 bool has_ss = op_mask & Statistics;
 
-                auto ss = std::make_shared<StatisticsOp<Voxel>>();
+                auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
                 auto down_sampling_func = unit.ops.down_sampling.GetOp();
                 auto mapping_func = unit.ops.mapping.GetOp();
 
@@ -255,7 +255,7 @@ public:
         auto oblocked_encoded_unit = unit_mp[VolumeType::Grid_BLOCKED_ENCODED].front();
         unit_mp[VolumeType::Grid_BLOCKED_ENCODED].pop();
         auto oslice_desc = oslice_unit.desc.sliced_desc;
-        auto other_ss = std::make_shared<StatisticsOp<Voxel>>();
+        auto other_ss = std::make_shared<StatisticsOp<Voxel>>(oslice_unit.ops.statistics);
         SlicedGridVolumeWriter other_writer(oslice_unit.desc_filename, oslice_desc);
         typename IOImpl<Voxel>::PackedParams0 packed{
                 .reader = sliced_reader.get(),
@@ -303,7 +303,7 @@ public:
             bool has_ds = op_mask & DownSampling;
             bool has_ss = op_mask & Statistics;
 
-            auto ss = std::make_shared<StatisticsOp<Voxel>>();
+            auto ss = std::make_shared<StatisticsOp<Voxel>>(unit.ops.statistics);
             auto down_sampling_func = unit.ops.down_sampling.GetOp();
             auto mapping_func = unit.ops.mapping.GetOp();
 
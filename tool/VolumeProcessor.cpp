@@ -48,6 +48,9 @@ namespace{
                 std::string volume_desc_file;
                 VolumeDescT desc;
                 VoxelInfo voxel_info;
+                // intensity x gradient magnitude histogram of the source range, skipped if empty
+                std::string gradient_histogram_filename;
+                VolumeGradientHistogramCreateInfo gradient_histogram;
             };
 
             struct DstNode {
@@ -140,6 +143,9 @@ namespace{
                 desc.padding = eb.at(padding);
                 desc.codec = StrToGridVolumeDataCodec(eb.at(volume_codec));
                 desc.data_path = eb.at(data_path);
+                ReadEncodeSettingsFromJson(desc.encode_settings, eb);
+                if(eb.count(quantized_type) != 0)
+                    desc.quantized_type = StrToVoxelType(std::string(eb.at(quantized_type)));
             }
         };
 
@@ -228,6 +234,18 @@ namespace{
                 task_node.src.volume_desc_file = src.at(volume_desc_file);
                 task_node.src.voxel_info.type = StrToVoxelType(src.at(voxel_type));
                 task_node.src.voxel_info.format = StrToVoxelFormat(src.at(voxel_format));
+                if(src.count("gradient_histogram") != 0 && src.at("gradient_histogram") == "yes"){
+                    task_node.src.gradient_histogram_filename = src.at("gradient_histogram_filename");
+                    auto& gh = task_node.src.gradient_histogram;
+                    if(src.count("gradient_histogram_bins") != 0){
+                        std::array<uint32_t, 2> bins = src.at("gradient_histogram_bins");
+                        gh.intensity_bin_count = bins[0];
+                        gh.gradient_bin_count = bins[1];
+                    }
+                    if(src.count("max_gradient") != 0)
+                        gh.max_gradient = src.at("max_gradient");
+                    gh.slab_bytes = std::min<size_t>(gh.slab_bytes, (size_t(process->memory_limit_gb) << 30) / 4);
+                }
 
                 int dst_count = task.at("dst_count");
                 for(int k = 0; k < dst_count; k++){
@@ -282,6 +300,46 @@ void Run(std::unique_ptr<Processor<Voxel>> processor){
     }
 }
 
+/**
+ * @brief Reads the source range as a volume starting at the origin.
+ */
+class VolumeRangeReader : public CVolumeReaderInterface{
+public:
+    VolumeRangeReader(CVolumeReaderInterface& reader, const VolumeRange& range)
+    :reader(reader), range(range)
+    {}
+
+    void ReadVolumeData(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, void *buf) override{
+        reader.ReadVolumeData(srcX + range.src_x, srcY + range.src_y, srcZ + range.src_z,
+                              dstX + range.src_x, dstY + range.src_y, dstZ + range.src_z, buf);
+    }
+
+    void ReadVolumeData(int srcX, int srcY, int srcZ, int dstX, int dstY, int dstZ, VolumeReadFunc func) override{
+        reader.ReadVolumeData(srcX + range.src_x, srcY + range.src_y, srcZ + range.src_z,
+                              dstX + range.src_x, dstY + range.src_y, dstZ + range.src_z, std::move(func));
+    }
+private:
+    CVolumeReaderInterface& reader;
+    VolumeRange range;
+};
+
+template<typename Voxel, VolumeType type>
+void ComputeGradientHistogram(const Process::TaskNode::SrcNode& src){
+    try{
+        typename VolumeTypeTraits<Voxel, type>::ReaderT reader(src.volume_desc_file);
+        VolumeRangeReader range_reader(reader, src.range);
+        const Extend3D extend{(uint32_t)(src.range.dst_x - src.range.src_x),
+                              (uint32_t)(src.range.dst_y - src.range.src_y),
+                              (uint32_t)(src.range.dst_z - src.range.src_z)};
+        VolumeGradientHistogram gh(range_reader, extend, {Voxel::type, Voxel::format}, src.gradient_histogram);
+        if(gh.SaveToFile(src.gradient_histogram_filename))
+            std::cout << "Write gradient histogram to " << src.gradient_histogram_filename << std::endl;
+    }
+    catch (const std::exception& err) {
+        std::cerr << "Compute gradient histogram failed : " << err.what() << std::endl;
+    }
+}
+
 template<typename Voxel, VolumeType type>
 void Parse(const Process::TaskNode& task){
     std::unique_ptr<Processor<Voxel>> processor = std::make_unique<VolumeProcessor<Voxel, type>>();
@@ -313,6 +371,9 @@ void Parse(const Process::TaskNode& task){
     }
 
     Run(std::move(processor));
+
+    if(!task.src.gradient_histogram_filename.empty())
+        ComputeGradientHistogram<Voxel, type>(task.src);
 }
 
 
@@ -5,6 +5,8 @@
 #include <variant>
 #include <queue>
 #include <unordered_map>
+#include <mutex>
+#include <thread>
 using namespace vol;
 
 enum VolumeTypeBits : int{
@@ -81,24 +83,102 @@ private:
     Func func;
 
 };
+/**
+ * @brief Dense histogram of the written voxels with one bin per value.
+ * Copies share the counters and every thread counts into its own table, so AddVoxel takes no lock
+ * from writer callbacks running in parallel. Tables are merged by Finish once the writers are done.
+ */
 template<typename Voxel>
 class StatisticsOp{
 public:
+    using VoxelDataType = typename Voxel::VoxelDataType;
+    static_assert(IsVoxelTypeInteger(Voxel::type) && sizeof(VoxelDataType) <= 2, "statistics only support 8/16-bit voxel");
+    static constexpr size_t BinCount = size_t(1) << (sizeof(VoxelDataType) * 8);
+
+    /**
+     * @brief Disabled op, AddVoxel does nothing.
+     */
     StatisticsOp(){
 
     }
-    StatisticsOp(std::string_view filename){
-
+    StatisticsOp(std::string_view filename)
+    :shared(std::make_shared<Shared>())
+    {
+        shared->filename = filename;
     }
     ~StatisticsOp(){
 
     }
     using ArgT = std::conditional_t<sizeof(Voxel) >= 9, const Voxel&, Voxel>;
     void AddVoxel(ArgT voxel) const {
-//        his[voxel.r] += 1;
+        if(!shared) return;
+        LocalTable()[voxel.r] += 1;
+    }
+
+    /**
+     * @note Not safe while other threads are still counting.
+     */
+    std::vector<uint64_t> GetHistogram() const {
+        std::vector<uint64_t> his(BinCount, 0);
+        if(!shared) return his;
+        std::lock_guard<std::mutex> lk(shared->mtx);
+        for(auto& [tid, table] : shared->tables)
+            for(size_t i = 0; i < BinCount; i++)
+                his[i] += table[i];
+        return his;
+    }
+
+    /**
+     * @note Not safe while other threads are still counting.
+     */
+    uint64_t GetVoxelCount() const {
+        uint64_t count = 0;
+        if(!shared) return count;
+        std::lock_guard<std::mutex> lk(shared->mtx);
+        for(auto& [tid, table] : shared->tables)
+            for(size_t i = 0; i < BinCount; i++)
+                count += table[i];
+        return count;
+    }
+
+    /**
+     * @brief Merge thread tables and write the .ss.json file, call after every writer finished.
+     */
+    void Finish() const {
+        if(!shared || shared->filename.empty()) return;
+        CVolumeStatistics ss({Voxel::type, Voxel::format}, GetHistogram());
+        if(ss.SaveToFile(shared->filename))
+            std::cout << "Write statistics to " << shared->filename << std::endl;
     }
 private:
-    std::unordered_map<typename Voxel::VoxelDataType,size_t> his;
+    struct Shared{
+        std::string filename;
+        // never reused unlike the address, so a thread can not pick up a stale table
+        uint64_t id = next_id.fetch_add(1);
+        std::mutex mtx;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<uint64_t[]>>> tables;
+    };
+
+    uint64_t* LocalTable() const {
+        // last table this thread counted into, switching ops only happens between writer calls
+        thread_local uint64_t cached_id = 0;
+        thread_local uint64_t* cached_table = nullptr;
+        if(cached_id == shared->id) return cached_table;
+
+        std::lock_guard<std::mutex> lk(shared->mtx);
+        const auto tid = std::this_thread::get_id();
+        auto it = std::find_if(shared->tables.begin(), shared->tables.end(), [&](auto& t){ return t.first == tid; });
+        if(it == shared->tables.end()){
+            shared->tables.emplace_back(tid, std::make_unique<uint64_t[]>(BinCount));
+            it = std::prev(shared->tables.end());
+        }
+        cached_id = shared->id;
+        cached_table = it->second.get();
+        return cached_table;
+    }
+
+    inline static std::atomic<uint64_t> next_id{1};
+    std::shared_ptr<Shared> shared;
 };
 enum class MappingOps{
     ADD,